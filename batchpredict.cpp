@@ -0,0 +1,77 @@
+#include "batchpredict.h"
+
+namespace batch {
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i)
+    workers_.emplace_back(&ThreadPool::Work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+size_t ThreadPool::size() const {
+  return workers_.size();
+}
+
+void ThreadPool::Run(size_t count, const Task& task) {
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    active_ = workers_.size();
+    ++generation_;
+    start_cv_.notify_all();
+    done_cv_.wait(lock, [this] { return active_ == 0; });
+    task_ = nullptr;
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::Work(size_t worker) {
+  uint64_t generation = 0;
+  while (true) {
+    const Task* task = nullptr;
+    size_t count = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock,
+                     [&] { return stop_ || generation_ != generation; });
+      if (stop_)
+        return;
+      generation = generation_;
+      task = task_;
+      count = count_;
+    }
+    for (size_t i = next_++; i < count; i = next_++) {
+      try {
+        (*task)(i, worker);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_)
+          error_ = std::current_exception();
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_cv_.notify_one();
+    }
+  }
+}
+
+}  // namespace batch
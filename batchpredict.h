@@ -0,0 +1,146 @@
+#ifndef BATCHPREDICT_H
+#define BATCHPREDICT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace batch {
+
+/*
+ * Fixed set of worker threads, which run indexed tasks. Workers are kept
+ * between runs, so a service doesn't pay for thread creation per request.
+ */
+class ThreadPool {
+ public:
+  using Task = std::function<void(size_t index, size_t worker)>;
+
+  // 0 means number of hardware threads
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const;
+
+  /*
+   * Calls task(index, worker) for every index in [0, count) and waits for
+   * completion, the first exception thrown by a task is rethrown. Runs
+   * should not be started concurrently.
+   */
+  void Run(size_t count, const Task& task);
+
+ private:
+  void Work(size_t worker);
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const Task* task_{nullptr};
+  size_t count_{0};
+  std::atomic<size_t> next_{0};
+  size_t active_{0};
+  uint64_t generation_{0};
+  bool stop_{false};
+  std::exception_ptr error_;
+};
+
+struct Predictions {
+  std::vector<uint32_t> labels;
+  std::vector<float> scores;  // confidence of the predicted label
+};
+
+/*
+ * Splits `count` contiguous rows to blocks and runs the predictor on them in
+ * the pool. Predictor is called as
+ * predictor(const T* rows, size_t rows_count, uint32_t* labels,
+ *           float* scores, size_t worker)
+ * and should be safe to call concurrently with different workers.
+ */
+template <typename T, typename Predictor>
+Predictions Predict(ThreadPool& pool,
+                    const T* rows,
+                    size_t count,
+                    size_t cols,
+                    Predictor& predictor,
+                    size_t block_rows = 256) {
+  Predictions predictions;
+  predictions.labels.resize(count);
+  predictions.scores.resize(count);
+  size_t blocks = (count + block_rows - 1) / block_rows;
+  pool.Run(blocks, [&](size_t block, size_t worker) {
+    size_t first = block * block_rows;
+    size_t n = std::min(block_rows, count - first);
+    predictor(rows + first * cols, n, predictions.labels.data() + first,
+              predictions.scores.data() + first, worker);
+  });
+  return predictions;
+}
+
+template <typename L>
+double Accuracy(const Predictions& predictions, const L& labels) {
+  size_t matches = 0;
+  for (size_t i = 0; i < predictions.labels.size(); ++i) {
+    if (predictions.labels[i] == static_cast<uint32_t>(labels[i]))
+      ++matches;
+  }
+  return predictions.labels.empty()
+             ? 0
+             : static_cast<double>(matches) / predictions.labels.size();
+}
+
+/*
+ * Reports rows/sec of batch prediction for pools with 1, 2, 4 ... up to
+ * the hardware number of threads. Rows are repeated up to `min_rows` to have
+ * stable timings. `make_predictor(workers)` should return a predictor which
+ * supports given number of workers.
+ */
+template <typename T, typename PredictorFactory>
+void BenchmarkThroughput(const std::string& name,
+                         const T* rows,
+                         size_t count,
+                         size_t cols,
+                         PredictorFactory&& make_predictor,
+                         size_t min_rows = 100000) {
+  if (count == 0)
+    return;
+  size_t repeats = (min_rows + count - 1) / count;
+  std::vector<T> data(repeats * count * cols);
+  for (size_t r = 0; r < repeats; ++r)
+    std::copy(rows, rows + count * cols, data.begin() + r * count * cols);
+  size_t total = repeats * count;
+
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<size_t> threads_counts;
+  for (size_t threads = 1; threads < max_threads; threads *= 2)
+    threads_counts.push_back(threads);
+  threads_counts.push_back(max_threads);
+
+  for (auto threads : threads_counts) {
+    ThreadPool pool(threads);
+    auto predictor = make_predictor(pool.size());
+    Predict(pool, data.data(), std::min(total, size_t{1024}), cols,
+            predictor);  // warm up
+    auto start = std::chrono::steady_clock::now();
+    Predict(pool, data.data(), total, cols, predictor);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << name << " threads = " << threads
+              << " rows/sec = " << total / elapsed.count() << std::endl;
+  }
+}
+
+}  // namespace batch
+
+#endif  // BATCHPREDICT_H
@@ -0,0 +1,95 @@
+#include "benchutils.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+namespace bench {
+
+Dataset MakeClassificationData(size_t rows,
+                               size_t cols,
+                               size_t classes,
+                               uint32_t seed) {
+  if (classes == 0)
+    throw std::runtime_error("Number of classes should be positive");
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> center_distribution(-5., 5.);
+  std::normal_distribution<double> noise(0., 1.);
+  std::uniform_int_distribution<uint32_t> class_distribution(
+      0, static_cast<uint32_t>(classes - 1));
+
+  std::vector<double> centers(classes * cols);
+  for (auto& value : centers)
+    value = center_distribution(generator);
+
+  Dataset data;
+  data.rows = rows;
+  data.cols = cols;
+  data.classes = classes;
+  data.features.resize(rows * cols);
+  data.labels.resize(rows);
+  for (size_t r = 0; r < rows; ++r) {
+    auto label = class_distribution(generator);
+    data.labels[r] = label;
+    const double* center = centers.data() + label * cols;
+    double* row = data.features.data() + r * cols;
+    for (size_t c = 0; c < cols; ++c)
+      row[c] = center[c] + noise(generator);
+  }
+  return data;
+}
+
+Percentiles GetPercentiles(std::vector<double> values) {
+  Percentiles result;
+  if (values.empty())
+    return result;
+  std::sort(values.begin(), values.end());
+  auto at = [&](double p) {
+    auto index = static_cast<size_t>(std::ceil(p * values.size()));
+    return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+  };
+  result.p50 = at(0.5);
+  result.p90 = at(0.9);
+  result.p99 = at(0.99);
+  result.max = values.back();
+  return result;
+}
+
+double GetPeakRSSMb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return usage.ru_maxrss / 1024.;  // kilobytes on Linux
+}
+
+Options::Options(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string name = argv[i];
+    if (name.size() < 3 || name.compare(0, 2, "--") != 0 || i + 1 >= argc)
+      throw std::runtime_error("Wrong option " + name +
+                               ", expected --name value");
+    values_[name.substr(2)] = argv[++i];
+  }
+}
+
+size_t Options::Get(const std::string& name, size_t default_value) const {
+  auto i = values_.find(name);
+  size_t value = i != values_.end() ? std::stoul(i->second) : default_value;
+  used_[name] = value;
+  return value;
+}
+
+void Options::Print() const {
+  for (auto& option : used_)
+    std::cout << option.first << " = " << option.second << std::endl;
+  for (auto& option : values_) {
+    if (used_.find(option.first) == used_.end())
+      std::cout << "unknown option " << option.first << std::endl;
+  }
+}
+
+}  // namespace bench
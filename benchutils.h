@@ -0,0 +1,70 @@
+#ifndef BENCHUTILS_H
+#define BENCHUTILS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/*
+ * Synthetic classification data: every class is a gaussian blob around a
+ * random center, features are stored row major.
+ */
+struct Dataset {
+  size_t rows{0};
+  size_t cols{0};
+  size_t classes{0};
+  std::vector<double> features;
+  std::vector<uint32_t> labels;
+};
+
+Dataset MakeClassificationData(size_t rows,
+                               size_t cols,
+                               size_t classes,
+                               uint32_t seed = 5489);
+
+struct Percentiles {
+  double p50{0};
+  double p90{0};
+  double p99{0};
+  double max{0};
+};
+
+Percentiles GetPercentiles(std::vector<double> values);
+
+// Peak resident set size of the process in megabytes
+double GetPeakRSSMb();
+
+class Timer {
+ public:
+  Timer() : start_(std::chrono::steady_clock::now()) {}
+  double GetElapsedMs() const {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start_;
+    return elapsed.count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+/*
+ * Command line options in the "--name value" form.
+ */
+class Options {
+ public:
+  Options(int argc, char** argv);
+  size_t Get(const std::string& name, size_t default_value) const;
+  void Print() const;
+
+ private:
+  std::map<std::string, std::string> values_;
+  mutable std::map<std::string, size_t> used_;
+};
+
+}  // namespace bench
+
+#endif  // BENCHUTILS_H
@@ -0,0 +1,115 @@
+#ifndef CHUNKPREFETCHER_H
+#define CHUNKPREFETCHER_H
+
+#include "csvreader.h"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace csv {
+
+/*
+ * Reads the file chunk by chunk with a background thread, which parses the
+ * next chunk while the caller processes the current one. There are only two
+ * chunk buffers, they are reused for the whole file, so memory doesn't depend
+ * on the file size. Parsing errors are rethrown from Next().
+ */
+template <typename T>
+class ChunkPrefetcher {
+ public:
+  explicit ChunkPrefetcher(Reader& reader) : reader_(reader) {
+    thread_ = std::thread([this]() { Produce(); });
+  }
+
+  ~ChunkPrefetcher() {
+    {
+      std::lock_guard<std::mutex> lock(guard_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+  ChunkPrefetcher(const ChunkPrefetcher&) = delete;
+  ChunkPrefetcher& operator=(const ChunkPrefetcher&) = delete;
+
+  /*
+   * Waits for the next chunk, returns false at the end of the file. Buffers
+   * are valid until the next call.
+   */
+  bool Next(const T** features, const uint32_t** labels, size_t* rows) {
+    std::unique_lock<std::mutex> lock(guard_);
+    if (consumed_ != nullptr) {
+      // the previous chunk buffer can be refilled now
+      consumed_->ready = false;
+      consumed_ = nullptr;
+      cond_.notify_all();
+    }
+    auto& slot = slots_[read_];
+    cond_.wait(lock, [&slot]() { return slot.ready; });
+    if (slot.error)
+      std::rethrow_exception(slot.error);
+    if (slot.rows == 0)
+      return false;
+    consumed_ = &slot;
+    read_ ^= 1;
+    *features = slot.features.data();
+    *labels = slot.labels.data();
+    *rows = slot.rows;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::vector<T> features;
+    std::vector<uint32_t> labels;
+    size_t rows{0};
+    std::exception_ptr error;
+    bool ready{false};
+  };
+
+  void Produce() {
+    size_t offset = 0;
+    size_t write = 0;
+    bool done = false;
+    while (!done) {
+      auto& slot = slots_[write];
+      {
+        std::unique_lock<std::mutex> lock(guard_);
+        cond_.wait(lock, [this, &slot]() { return stop_ || !slot.ready; });
+        if (stop_)
+          return;
+      }
+      // the slot isn't used by the consumer, so it's filled without lock
+      try {
+        slot.rows = reader_.ReadChunk(&offset, &slot.features, &slot.labels);
+      } catch (...) {
+        slot.error = std::current_exception();
+      }
+      done = slot.rows == 0 || slot.error;
+      {
+        std::lock_guard<std::mutex> lock(guard_);
+        slot.ready = true;
+      }
+      cond_.notify_all();
+      write ^= 1;
+    }
+  }
+
+ private:
+  Reader& reader_;
+  Slot slots_[2];
+  size_t read_{0};
+  Slot* consumed_{nullptr};
+  bool stop_{false};
+  std::mutex guard_;
+  std::condition_variable cond_;
+  std::thread thread_;
+};
+
+}  // namespace csv
+
+#endif  // CHUNKPREFETCHER_H
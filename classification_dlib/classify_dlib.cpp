@@ -7,37 +7,53 @@
 #include <plot.h>
 
 // stl includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <experimental/filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <regex>
-#include <streambuf>
+#include <stdexcept>
+#include <thread>
 
 // application includes
+#include "../batchpredict.h"
+#include "../csvreader.h"
 #include "../ioutils.h"
 #include "../utils.h"
+#include "model_io.h"
+#include "sample_set.h"
+#include "svm_search.h"
 
 // Namespace and type aliases
 namespace fs = std::experimental::filesystem;
-using DType = double;  // DLib internally uses double - so in many cases it is
-                       // impossible to use float
-using Matrix = dlib::matrix<DType>;
-using DataSet = std::pair<std::vector<Matrix>, std::vector<DType>>;
+#ifdef USE_FLOAT
+using DType = float;  // halves memory and doubles SIMD width for kernels
+#else
+using DType = double;
+#endif
+using Sample = SampleRef<DType>;
+using Samples = std::vector<Sample>;
+using Labels = std::vector<double>;
 //  SVM types
-using svm_kernel_type = dlib::radial_basis_kernel<Matrix>;
-using svm_ova_trainer = dlib::one_vs_all_trainer<dlib::any_trainer<Matrix>>;
-using svm_dec_funct_type = dlib::one_vs_all_decision_function<svm_ova_trainer>;
-// using svm_normalizer_type = dlib::vector_normalizer_pca<Matrix>;
-using svm_normalizer_type = dlib::vector_normalizer<Matrix>;
-using svm_funct_type =
-    dlib::normalized_function<svm_dec_funct_type, svm_normalizer_type>;
+using svm_kernel_type = rbf_row_kernel<DType>;
+using svm_ova_trainer = svm_ova_trainer_t<DType>;
+using svm_funct_type = svm_function_t<DType>;
+//  NN type, rows are copied from the samples buffer to the input tensor
+using nn_type = dlib::loss_multiclass_log<dlib::fc<
+    3,
+    dlib::relu<dlib::fc<10, dlib::relu<dlib::fc<5, input_rows<DType>>>>>>>;
+
+// Trained models are loaded from these files if they exist
+static const std::string svm_model_file{"dlib_svm.dat"};
+static const std::string nn_model_file{"dlib_nn.dat"};
 
 static const std::string train_data_url =
     "https://raw.githubusercontent.com/pandas-dev/pandas/master/pandas/tests/"
     "data/iris.csv";
 
-DataSet LoadData() {
+std::pair<SampleSet<DType>, Labels> LoadData() {
   // ----------- Download the data
   const std::string data_path{"iris.csv"};
   if (!fs::exists(data_path)) {
@@ -47,111 +63,42 @@ DataSet LoadData() {
       return {};
     }
   }
-  // ----------- Load data to string
-  std::ifstream data_file(data_path);
-  std::string train_data_str((std::istreambuf_iterator<char>(data_file)),
-                             std::istreambuf_iterator<char>());
-
-  // ----------- Remove first line - columns labels
-  train_data_str.erase(0, train_data_str.find_first_of("\n") + 1);
-
-  // ----------- Replace string labels with ints
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-setosa"), "0");
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-versicolor"), "1");
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-virginica"), "2");
-
-  // ----------- Load data to matrix
-  Matrix train_data(150, 5);
-  std::stringstream ss(train_data_str);
-  ss >> train_data;
-  // ----------- Extract labels
-  Matrix labels = dlib::colm(train_data, 4);
-  // std::cout << dlib::csv << labels << std::endl;
-  // ----------- Extract and transpose samples
-  Matrix samples = dlib::subm_clipped(train_data, 0, 0, train_data.nr(),
-                                      train_data.nc() - 1);
-  // std::cout << dlib::csv << samples << std::endl;
-  // convert to matrices to vectors, because algorithms require such data types
-  DataSet ds;
-  for (long row = 0; row < samples.nr(); ++row) {
-    ds.first.push_back(dlib::reshape_to_column_vector(
-        dlib::subm_clipped(samples, row, 0, 1, samples.nc())));
-  }
-  ds.second.assign(labels.begin(), labels.end());
-  return ds;
+  // ----------- Parse CSV straight to the samples buffer, string labels are
+  // mapped to ints in order of appearance
+  csv::Reader reader(data_path);
+  auto rows = reader.GetRowsCount();
+  auto columns = reader.GetFeaturesCount();
+  SampleSet<DType> samples(rows, columns);
+  std::vector<uint32_t> class_ids(rows);
+  reader.Read(samples.data(), columns, class_ids.data());
+  return {std::move(samples), Labels(class_ids.begin(), class_ids.end())};
 }
 
-svm_funct_type TrainSVMClassifier(DataSet dataset) {
+svm_funct_type TrainSVMClassifier(const Samples& samples,
+                                  const Labels& labels,
+                                  SVMSearchParams* params) {
   // based on http://dlib.net/model_selection_ex.cpp.html
 
-  auto& [samples, labels] = dataset;
-  // ----------- Pre-process data
-  // Here we normalize all the samples by subtracting their mean and
-  // dividing by their standard deviation.
-  svm_normalizer_type normalizer;
-  // Let the normalizer learn the mean and standard deviation of the samples
-  // normalizer.train(samples, 0.9); // configure how much dimensions will be
-  // left after PCA
-  normalizer.train(samples);
-  std::cout << "Dimension of sample vector = " << normalizer.out_vector_size()
-            << " after PCA" << std::endl;
-  // now normalize each sample
-  for (size_t i = 0; i < samples.size(); ++i) {
-    samples[i] = normalizer(samples[i]);
-  }
-
   // ----------- Select best parameters for svm model
 
-  //  Here we define a function, that will do the cross-validation and return
-  //  a number indicating how good a particular setting of gamma, c1, and c2
-  //  is.
-  auto cross_validation_score = [&](const DType gamma, const DType c1,
-                                    const DType c2) {
-    // Make a RBF SVM trainer and tell it what the parameters are supposed to
-    // be.
-    dlib::svm_c_trainer<svm_kernel_type> svm_trainer;
-    svm_trainer.set_kernel(svm_kernel_type(gamma));
-    svm_trainer.set_c_class1(c1);
-    svm_trainer.set_c_class2(c2);
-
-    svm_ova_trainer trainer;
-    trainer.set_num_threads(4);
-    trainer.set_trainer(svm_trainer);
-
-    // Perform 10-fold cross validation and then print and return the
-    // results - confusion matrix.
-    Matrix result =
-        dlib::cross_validate_multiclass_trainer(trainer, samples, labels, 10);
-    auto accuracy = sum(diag(result)) / sum(result);
-    std::cout << "gamma: " << gamma << "  c1: " << c1 << "  c2: " << c2
-              << "\ncross validation accuracy: " << accuracy
-              << "\nconfusion matrix:\n"
-              << dlib::csv << result << std::endl;
-
-    // Now return a number indicating how good the parameters are.  Bigger is
-    // better in this example.
-    return accuracy;
-  };
-
-  // Call this global optimizer that will search for the best
-  // parameters. It will call cross_validation_score() 50 times with different
-  // settings and return the best parameter setting it finds.
-  auto result = dlib::find_max_global(
-      cross_validation_score,
+  // Search evaluates several parameter settings concurrently, each
+  // setting is scored with 10-fold cross-validation accuracy. It makes 50
+  // evaluations and returns the best setting it finds.
+  auto result = SearchSVMParams(
+      samples, labels,
       {1e-5, 1e-5,
        1e-5},  // lower bound constraints on gamma, c1, and c2, respectively
       {100, 1e6,
        1e6},  // upper bound constraints on gamma, c1, and c2, respectively
-      dlib::max_function_calls(50));
+      50, 10);
 
-  double best_gamma = result.x(0);
-  double best_c1 = result.x(1);
-  double best_c2 = result.x(2);
+  *params = result;
+  double best_gamma = result.gamma;
+  double best_c1 = result.c1;
+  double best_c2 = result.c2;
 
-  std::cout << " best cross-validation score: " << result.y << std::endl;
+  std::cout << " best cross-validation score: " << result.accuracy
+            << std::endl;
   std::cout << " best gamma: " << best_gamma << "   best c1: " << best_c1
             << "    best c2: " << best_c2 << std::endl;
 
@@ -162,91 +109,166 @@ svm_funct_type TrainSVMClassifier(DataSet dataset) {
   svm_trainer.set_c_class1(best_c1);
   svm_trainer.set_c_class2(best_c2);
   svm_ova_trainer trainer;
-  trainer.set_num_threads(4);
+  trainer.set_num_threads(std::max(1u, std::thread::hardware_concurrency()));
   trainer.set_trainer(svm_trainer);
 
-  svm_funct_type learned_function;
-  learned_function.normalizer = normalizer;  // save normalization information
-  learned_function.function = trainer.train(
+  return trainer.train(
       samples,
       labels);  // perform the actual SVM training and save the results
-  return learned_function;
 }
 
-auto TrainNNClassifier(DataSet dataset) {
+auto TrainNNClassifier(const Samples& samples, const Labels& real_labels) {
   // based on http://dlib.net/dnn_introduction_ex.cpp.html
   using namespace dlib;
 
-  auto& [samples, real_labels] = dataset;
   std::vector<unsigned long> labels;
   labels.assign(real_labels.begin(), real_labels.end());
-  // ----------- Pre-process data
-  // Here we normalize all the samples by subtracting their mean and
-  // dividing by their standard deviation.
-  vector_normalizer<Matrix> normalizer;
-  // let the normalizer learn the mean and standard deviation of the samples
-  normalizer.train(samples);
-  // now normalize each sample
-  for (size_t i = 0; i < samples.size(); ++i) {
-    samples[i] = normalizer(samples[i]);
-  }
 
-  using net_type = loss_multiclass_log<
-      fc<3, relu<fc<10, relu<fc<5, input<matrix<DType>>>>>>>>;
-  net_type net;
-  dnn_trainer<net_type> trainer(net);
+  nn_type net;
+  dnn_trainer<nn_type> trainer(net);
   trainer.set_learning_rate(0.01);
   trainer.set_min_learning_rate(0.00001);
   trainer.set_mini_batch_size(8);
   trainer.be_verbose();
   trainer.train(samples, labels);
   net.clean();
-  return std::make_pair(net, normalizer);
+  return net;
 }
 
-// ---------- Evaluate model on samples
-template <typename Classfier>
-void TestSVMClassfier(const std::string& name,
-                      const Classfier& classifier,
-                      DataSet dataset) {
-  auto& [test_data, test_labels] = dataset;
-  DType matches_num = 0;
-  for (size_t i = 0; i < test_data.size(); ++i) {
-    auto predicted_class = classifier(test_data[i]);
-    auto true_class = test_labels[i];
-    if (predicted_class == true_class) {
-      ++matches_num;
-    }
-  }
-  std::cout << name << " test accuracy = " << matches_num / test_data.size()
+void SaveNNClassifier(const std::string& file_name,
+                      const nn_type& net,
+                      const SampleNormalizer<DType>& normalizer) {
+  using dlib::serialize;
+  std::ofstream out(file_name, std::ios::binary);
+  serialize(std::string("dlib_nn_v1"), out);
+  serialize(static_cast<unsigned long>(sizeof(DType)), out);
+  serialize(normalizer, out);
+  serialize(net, out);
+  if (!out)
+    throw std::runtime_error("Can't write file " + file_name);
+}
+
+void LoadNNClassifier(const std::string& file_name,
+                      nn_type* net,
+                      SampleNormalizer<DType>* normalizer) {
+  using dlib::deserialize;
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Can't open file " + file_name);
+  std::string version;
+  unsigned long type_size = 0;
+  deserialize(version, in);
+  deserialize(type_size, in);
+  if (version != "dlib_nn_v1" || type_size != sizeof(DType))
+    throw std::runtime_error("Unsupported NN model file " + file_name);
+  deserialize(*normalizer, in);
+  deserialize(*net, in);
+}
+
+void PrintLoadTime(const std::string& file_name,
+                   std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Loaded " << file_name << " in " << elapsed.count() << " ms"
             << std::endl;
 }
 
-template <typename Classfier>
-void TestNNClassfier(const std::string& name,
-                     Classfier& classifier,
-                     DataSet dataset) {
-  auto& [test_data, test_labels] = dataset;
-  for (auto& ts : test_data)
-    ts = classifier.second(ts);  // normalize
-
-  auto predicted_labels = classifier.first(test_data);
-  DType matches_num = 0;
-  for (size_t i = 0; i < test_data.size(); ++i) {
-    auto predicted_class = predicted_labels[i];
-    auto true_class = test_labels[i];
-    if (predicted_class == true_class) {
-      ++matches_num;
+// ---------- Batch prediction
+// Raw rows are normalized in bulk in a per worker buffer, then classified.
+class SVMPredictor {
+ public:
+  SVMPredictor(const svm_funct_type& classifier,
+               const SampleNormalizer<DType>& normalizer,
+               size_t cols,
+               size_t workers)
+      : classifier_(classifier),
+        normalizer_(normalizer),
+        cols_(cols),
+        buffers_(workers) {}
+
+  void operator()(const DType* rows,
+                  size_t count,
+                  uint32_t* labels,
+                  float* scores,
+                  size_t worker) {
+    auto& buffer = buffers_[worker];
+    buffer.assign(rows, rows + count * cols_);
+    normalizer_.Apply(buffer.data(), count);
+    for (size_t i = 0; i < count; ++i) {
+      auto prediction = classifier_.predict(
+          Sample{buffer.data() + i * cols_, static_cast<long>(cols_)});
+      labels[i] = static_cast<uint32_t>(prediction.first);
+      scores[i] = static_cast<float>(prediction.second);
     }
   }
-  std::cout << name << " test accuracy = " << matches_num / test_data.size()
-            << std::endl;
-}
+
+ private:
+  const svm_funct_type& classifier_;
+  const SampleNormalizer<DType>& normalizer_;
+  size_t cols_;
+  std::vector<std::vector<DType>> buffers_;
+};
+
+// dlib networks keep intermediate outputs, so every worker has its own copy
+class NNPredictor {
+ public:
+  NNPredictor(const nn_type& net,
+              const SampleNormalizer<DType>& normalizer,
+              size_t cols,
+              size_t workers)
+      : nets_(workers, net),
+        normalizer_(normalizer),
+        cols_(cols),
+        buffers_(workers),
+        refs_(workers),
+        tensors_(workers) {}
+
+  void operator()(const DType* rows,
+                  size_t count,
+                  uint32_t* labels,
+                  float* scores,
+                  size_t worker) {
+    auto& buffer = buffers_[worker];
+    buffer.assign(rows, rows + count * cols_);
+    normalizer_.Apply(buffer.data(), count);
+    auto& refs = refs_[worker];
+    refs.resize(count);
+    for (size_t i = 0; i < count; ++i)
+      refs[i] = {buffer.data() + i * cols_, static_cast<long>(cols_)};
+
+    auto& net = nets_[worker];
+    auto& input = tensors_[worker];
+    net.to_tensor(refs.begin(), refs.end(), input);
+    const auto& output = net.subnet().forward(input);
+    const long classes = output.k();
+    const float* logits = output.host();
+    for (size_t i = 0; i < count; ++i, logits += classes) {
+      auto max = std::max_element(logits, logits + classes);
+      double sum = 0;
+      for (long c = 0; c < classes; ++c)
+        sum += std::exp(logits[c] - *max);
+      labels[i] = static_cast<uint32_t>(max - logits);
+      scores[i] = static_cast<float>(1 / sum);  // softmax of the max logit
+    }
+  }
+
+ private:
+  std::vector<nn_type> nets_;
+  const SampleNormalizer<DType>& normalizer_;
+  size_t cols_;
+  std::vector<std::vector<DType>> buffers_;
+  std::vector<Samples> refs_;
+  std::vector<dlib::resizable_tensor> tensors_;
+};
 
 int main(int, char* []) {
   using namespace std::string_literals;
   try {
-    auto [samples, labels] = LoadData();
+    auto [data, labels] = LoadData();
+    const size_t cols = data.cols();
+    // references to the rows of `data`, so shuffling and splitting don't
+    // move feature values
+    auto samples = data.GetRefs();
 
     // ----------- Pre-process data
     // It have sense to compile DLib in debug mode with DLIB_ENABLE_ASSERTS
@@ -254,24 +276,85 @@ int main(int, char* []) {
 
     dlib::randomize_samples(samples, labels);
 
-    // exctract some samples as test data
-    std::vector<Matrix> test_data;
-    std::ptrdiff_t split_point = 135;
-    test_data.assign(samples.begin() + split_point, samples.end());
+    // exctract some samples as test data, they are kept as raw contiguous
+    // rows like a prediction request
+    auto split_point =
+        static_cast<std::ptrdiff_t>(samples.size() * 9 / 10);  // 135 for iris
+    std::vector<DType> test_rows;
+    for (auto i = samples.begin() + split_point; i != samples.end(); ++i)
+      test_rows.insert(test_rows.end(), i->data, i->data + cols);
+    const size_t test_count = samples.size() - split_point;
     samples.erase(samples.begin() + split_point, samples.end());
-    std::vector<double> test_labels;
-    test_labels.assign(labels.begin() + split_point, labels.end());
+    Labels test_labels(labels.begin() + split_point, labels.end());
     labels.erase(labels.begin() + split_point, labels.end());
 
+    // Here we normalize all the samples by subtracting their mean and
+    // dividing by their standard deviation. Statistics are taken from the
+    // train samples only, all rows are normalized in place. It's done only
+    // when a model is trained, saved models have their own normalizers.
+    SampleNormalizer<DType> normalizer;
+    bool normalized = false;
+    auto normalize_train_samples = [&]() {
+      if (normalized)
+        return;
+      normalizer.Train(samples);
+      normalizer.Apply(data);
+      normalized = true;
+    };
+
+    batch::ThreadPool pool;
+
     // ----------- SVM
-    auto svm_classifier = TrainSVMClassifier({samples, labels});
-    TestSVMClassfier("SVM"s, svm_classifier, {test_data, test_labels});
+    // A saved model is used as is, so scoring doesn't wait for training
+    SVMArtifact<DType> svm_model;
+    if (fs::exists(svm_model_file)) {
+      auto start = std::chrono::steady_clock::now();
+      svm_model = LoadSVM<DType>(svm_model_file);
+      PrintLoadTime(svm_model_file, start);
+    } else {
+      normalize_train_samples();
+      svm_model.normalizer = normalizer;
+      svm_model.function =
+          TrainSVMClassifier(samples, labels, &svm_model.params);
+      SaveSVM(svm_model_file, svm_model);
+    }
+    auto make_svm_predictor = [&](size_t workers) {
+      return SVMPredictor(svm_model.function, svm_model.normalizer, cols,
+                          workers);
+    };
+    auto svm_predictor = make_svm_predictor(pool.size());
+    auto svm_predictions = batch::Predict(pool, test_rows.data(), test_count,
+                                          cols, svm_predictor);
+    std::cout << "SVM test accuracy = "
+              << batch::Accuracy(svm_predictions, test_labels) << std::endl;
+    batch::BenchmarkThroughput("dlib SVM"s, test_rows.data(), test_count, cols,
+                               make_svm_predictor);
 
     // Decision trees and Random Forest algorithms are missed in DLib
 
     // ----------- Neural Net
-    auto nn_classifier = TrainNNClassifier({samples, labels});
-    TestNNClassfier("NN"s, nn_classifier, {test_data, test_labels});
+    nn_type nn_classifier;
+    SampleNormalizer<DType> nn_normalizer;
+    if (fs::exists(nn_model_file)) {
+      auto start = std::chrono::steady_clock::now();
+      LoadNNClassifier(nn_model_file, &nn_classifier, &nn_normalizer);
+      PrintLoadTime(nn_model_file, start);
+    } else {
+      normalize_train_samples();
+      nn_normalizer = normalizer;
+      nn_classifier = TrainNNClassifier(samples, labels);
+      SaveNNClassifier(nn_model_file, nn_classifier, nn_normalizer);
+    }
+    auto make_nn_predictor = [&](size_t workers) {
+      return NNPredictor(nn_classifier, nn_normalizer, cols, workers);
+    };
+    auto nn_predictor = make_nn_predictor(pool.size());
+    auto nn_predictions = batch::Predict(pool, test_rows.data(), test_count,
+                                         cols, nn_predictor);
+    std::cout << "NN test accuracy = "
+              << batch::Accuracy(nn_predictions, test_labels) << std::endl;
+    batch::BenchmarkThroughput("dlib NN"s, test_rows.data(), test_count, cols,
+                               make_nn_predictor);
 
   } catch (const std::exception& err) {
     std::cout << "Program crashed : " << err.what() << std::endl;
@@ -0,0 +1,142 @@
+#ifndef MODEL_IO_H
+#define MODEL_IO_H
+
+#include <dlib/serialize.h>
+#include <dlib/svm_threaded.h>
+
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sample_set.h"
+#include "svm_search.h"
+
+template <typename T>
+using svm_ova_trainer_t =
+    dlib::one_vs_all_trainer<dlib::any_trainer<SampleRef<T>>>;
+template <typename T>
+using svm_function_t = dlib::one_vs_all_decision_function<svm_ova_trainer_t<T>>;
+
+/*
+ * Trained SVM with everything required for scoring. Support vectors of a
+ * loaded model are kept in `support_vectors` and the decision functions
+ * refer to its rows, for a freshly trained model they refer to the train
+ * samples. So the artifact can be moved, but not copied.
+ */
+template <typename T>
+struct SVMArtifact {
+  SVMArtifact() = default;
+  SVMArtifact(const SVMArtifact&) = delete;
+  SVMArtifact& operator=(const SVMArtifact&) = delete;
+  SVMArtifact(SVMArtifact&&) = default;
+  SVMArtifact& operator=(SVMArtifact&&) = default;
+
+  svm_function_t<T> function;
+  SampleNormalizer<T> normalizer;
+  SVMSearchParams params;
+  std::vector<T> support_vectors;
+};
+
+/*
+ * Binary format: version string, hyper-parameters, normalizer and for every
+ * binary (one vs all) function its label, bias, weights and support vectors
+ * rows. Rows are written as values, so the file doesn't depend on the
+ * samples buffer used for training.
+ */
+template <typename T>
+void SaveSVM(const std::string& file_name, const SVMArtifact<T>& model) {
+  using df_type = dlib::decision_function<rbf_row_kernel<T>>;
+  std::ofstream out(file_name, std::ios::binary);
+  if (!out)
+    throw std::runtime_error("Can't create file " + file_name);
+  dlib::serialize(std::string("dlib_svm_v1"), out);
+  dlib::serialize(static_cast<unsigned long>(sizeof(T)), out);
+  dlib::serialize(model.params.gamma, out);
+  dlib::serialize(model.params.c1, out);
+  dlib::serialize(model.params.c2, out);
+  dlib::serialize(model.params.accuracy, out);
+  serialize(model.normalizer, out);
+
+  auto& functions = model.function.get_binary_decision_functions();
+  dlib::serialize(static_cast<unsigned long>(functions.size()), out);
+  std::vector<T> rows;
+  for (auto& item : functions) {
+    auto& df = item.second.template cast_to<df_type>();
+    long cols = df.basis_vectors.size() > 0 ? df.basis_vectors(0).size : 0;
+    rows.clear();
+    for (long i = 0; i < df.basis_vectors.size(); ++i) {
+      auto& sv = df.basis_vectors(i);
+      rows.insert(rows.end(), sv.data, sv.data + sv.size);
+    }
+    dlib::serialize(item.first, out);
+    dlib::serialize(df.b, out);
+    dlib::serialize(df.kernel_function.gamma, out);
+    dlib::serialize(df.alpha, out);
+    dlib::serialize(cols, out);
+    dlib::serialize(rows, out);
+  }
+  if (!out)
+    throw std::runtime_error("Can't write file " + file_name);
+}
+
+template <typename T>
+SVMArtifact<T> LoadSVM(const std::string& file_name) {
+  using df_type = dlib::decision_function<rbf_row_kernel<T>>;
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Can't open file " + file_name);
+  std::string version;
+  dlib::deserialize(version, in);
+  unsigned long type_size = 0;
+  dlib::deserialize(type_size, in);
+  if (version != "dlib_svm_v1" || type_size != sizeof(T))
+    throw std::runtime_error("Unsupported SVM model file " + file_name);
+
+  SVMArtifact<T> model;
+  dlib::deserialize(model.params.gamma, in);
+  dlib::deserialize(model.params.c1, in);
+  dlib::deserialize(model.params.c2, in);
+  dlib::deserialize(model.params.accuracy, in);
+  deserialize(model.normalizer, in);
+
+  unsigned long count = 0;
+  dlib::deserialize(count, in);
+  std::vector<double> labels(count);
+  std::vector<df_type> functions(count);
+  std::vector<long> cols(count);
+  std::vector<size_t> offsets(count + 1, 0);
+  std::vector<T> rows;
+  for (unsigned long f = 0; f < count; ++f) {
+    T gamma = 0;
+    dlib::deserialize(labels[f], in);
+    dlib::deserialize(functions[f].b, in);
+    dlib::deserialize(gamma, in);
+    functions[f].kernel_function = rbf_row_kernel<T>(gamma);
+    dlib::deserialize(functions[f].alpha, in);
+    dlib::deserialize(cols[f], in);
+    dlib::deserialize(rows, in);
+    model.support_vectors.insert(model.support_vectors.end(), rows.begin(),
+                                 rows.end());
+    offsets[f + 1] = model.support_vectors.size();
+  }
+
+  // rows are referenced only when the buffer doesn't grow anymore
+  typename svm_function_t<T>::binary_function_table table;
+  for (unsigned long f = 0; f < count; ++f) {
+    auto& df = functions[f];
+    auto values = static_cast<long>(offsets[f + 1] - offsets[f]);
+    long sv_count = cols[f] > 0 ? values / cols[f] : 0;
+    df.basis_vectors.set_size(sv_count);
+    for (long i = 0; i < sv_count; ++i) {
+      df.basis_vectors(i) = {
+          model.support_vectors.data() + offsets[f] + i * cols[f], cols[f]};
+    }
+    table[labels[f]] = df;
+  }
+  model.function = svm_function_t<T>(table);
+  return model;
+}
+
+#endif  // MODEL_IO_H
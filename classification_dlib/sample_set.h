@@ -0,0 +1,188 @@
+#ifndef SAMPLE_SET_H
+#define SAMPLE_SET_H
+
+#include <dlib/dnn.h>
+#include <dlib/matrix.h>
+
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/*
+ * Samples are stored as rows of one contiguous buffer, algorithms get
+ * SampleRef objects pointing to the rows instead of per sample matrices.
+ * Data type is float or double.
+ */
+template <typename T>
+struct SampleRef {
+  const T* data{nullptr};
+  long size{0};
+};
+
+template <typename T>
+class SampleSet {
+ public:
+  SampleSet() = default;
+  SampleSet(size_t rows, size_t cols)
+      : rows_(rows), cols_(cols), data_(rows * cols) {}
+  SampleSet(const SampleSet&) = delete;  // references point to the buffer
+  SampleSet& operator=(const SampleSet&) = delete;
+  SampleSet(SampleSet&&) = default;
+  SampleSet& operator=(SampleSet&&) = default;
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  T* data() { return data_.data(); }
+  T* row(size_t index) { return data_.data() + index * cols_; }
+  const T* row(size_t index) const { return data_.data() + index * cols_; }
+
+  std::vector<SampleRef<T>> GetRefs() const {
+    std::vector<SampleRef<T>> refs(rows_);
+    for (size_t i = 0; i < rows_; ++i)
+      refs[i] = {row(i), static_cast<long>(cols_)};
+    return refs;
+  }
+
+ private:
+  size_t rows_{0};
+  size_t cols_{0};
+  std::vector<T> data_;
+};
+
+template <typename T>
+inline T SquaredDistance(const SampleRef<T>& a, const SampleRef<T>& b) {
+  const T* x = a.data;
+  const T* y = b.data;
+  T sum = 0;
+#pragma omp simd reduction(+ : sum)
+  for (long i = 0; i < a.size; ++i) {
+    T d = x[i] - y[i];
+    sum += d * d;
+  }
+  return sum;
+}
+
+/*
+ * Normalizes features to zero mean and unit variance, same as
+ * dlib::vector_normalizer, but changes rows in place.
+ */
+template <typename T>
+class SampleNormalizer {
+ public:
+  void Train(const std::vector<SampleRef<T>>& samples) {
+    size_t cols = samples.empty() ? 0 : static_cast<size_t>(samples[0].size);
+    std::vector<double> sum(cols, 0), sum_sq(cols, 0);
+    for (auto& sample : samples) {
+      for (size_t i = 0; i < cols; ++i) {
+        sum[i] += sample.data[i];
+        sum_sq[i] += static_cast<double>(sample.data[i]) * sample.data[i];
+      }
+    }
+    mean_.assign(cols, 0);
+    inv_std_.assign(cols, 1);
+    auto n = static_cast<double>(samples.size());
+    for (size_t i = 0; i < cols; ++i) {
+      double mean = sum[i] / n;
+      double var = n > 1 ? (sum_sq[i] - n * mean * mean) / (n - 1) : 0;
+      mean_[i] = static_cast<T>(mean);
+      inv_std_[i] = static_cast<T>(var > 0 ? 1 / std::sqrt(var) : 1);
+    }
+  }
+
+  void Apply(SampleSet<T>& samples) const {
+    Apply(samples.data(), samples.rows());
+  }
+
+  void Apply(T* rows, size_t count) const {
+    const size_t cols = mean_.size();
+    for (size_t r = 0; r < count; ++r, rows += cols) {
+      for (size_t i = 0; i < cols; ++i)
+        rows[i] = (rows[i] - mean_[i]) * inv_std_[i];
+    }
+  }
+
+  friend void serialize(const SampleNormalizer& item, std::ostream& out) {
+    dlib::serialize(item.mean_, out);
+    dlib::serialize(item.inv_std_, out);
+  }
+
+  friend void deserialize(SampleNormalizer& item, std::istream& in) {
+    dlib::deserialize(item.mean_, in);
+    dlib::deserialize(item.inv_std_, in);
+  }
+
+ private:
+  std::vector<T> mean_;
+  std::vector<T> inv_std_;
+};
+
+/*
+ * RBF kernel over sample rows, can be used with dlib kernel based trainers.
+ */
+template <typename T>
+struct rbf_row_kernel {
+  using scalar_type = T;
+  using sample_type = SampleRef<T>;
+  using mem_manager_type = dlib::default_memory_manager;
+
+  rbf_row_kernel(const T gamma = 0.1) : gamma(gamma) {}
+
+  scalar_type operator()(const sample_type& a, const sample_type& b) const {
+    return std::exp(-gamma * SquaredDistance(a, b));
+  }
+
+  bool operator==(const rbf_row_kernel& k) const { return gamma == k.gamma; }
+
+  T gamma;
+};
+
+/*
+ * dlib dnn input layer which copies sample rows to the input tensor.
+ */
+template <typename T>
+class input_rows {
+ public:
+  const static unsigned int sample_expansion_factor = 1;
+  using input_type = SampleRef<T>;
+
+  template <typename forward_iterator>
+  void to_tensor(forward_iterator ibegin,
+                 forward_iterator iend,
+                 dlib::resizable_tensor& data) const {
+    auto num = std::distance(ibegin, iend);
+    DLIB_CASSERT(num > 0, "No samples");
+    const long cols = ibegin->size;
+    data.set_size(num, 1, cols, 1);
+    float* dst = data.host();
+    for (auto i = ibegin; i != iend; ++i) {
+      DLIB_CASSERT(i->size == cols, "All samples should have same size");
+      for (long c = 0; c < cols; ++c)
+        *dst++ = static_cast<float>(i->data[c]);
+    }
+  }
+
+  friend void serialize(const input_rows&, std::ostream& out) {
+    dlib::serialize("input_rows", out);
+  }
+
+  friend void deserialize(input_rows&, std::istream& in) {
+    std::string version;
+    dlib::deserialize(version, in);
+    if (version != "input_rows")
+      throw dlib::serialization_error(
+          "Unexpected version found while deserializing input_rows.");
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, const input_rows&) {
+    out << "input_rows";
+    return out;
+  }
+
+  friend void to_xml(const input_rows&, std::ostream& out) {
+    out << "<input_rows/>";
+  }
+};
+
+#endif  // SAMPLE_SET_H
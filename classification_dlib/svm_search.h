@@ -0,0 +1,168 @@
+#ifndef SVM_SEARCH_H
+#define SVM_SEARCH_H
+
+#include <dlib/global_optimization.h>
+#include <dlib/matrix.h>
+#include <dlib/svm_threaded.h>
+#include <dlib/threads.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "sample_set.h"
+
+/*
+ * RBF kernel over sample indices, values are taken from the shared matrix of
+ * squared distances, so it is computed only once for all gamma values:
+ * k(a, b) = exp(-gamma * |a - b|^2)
+ */
+struct precomputed_rbf_kernel {
+  using scalar_type = double;
+  using sample_type = unsigned long;
+  using mem_manager_type = dlib::default_memory_manager;
+
+  precomputed_rbf_kernel() = default;
+  precomputed_rbf_kernel(std::shared_ptr<const dlib::matrix<double>> distances,
+                         double gamma)
+      : distances(std::move(distances)), gamma(gamma) {}
+
+  scalar_type operator()(const sample_type& a, const sample_type& b) const {
+    return std::exp(-gamma * (*distances)(static_cast<long>(a),
+                                          static_cast<long>(b)));
+  }
+
+  bool operator==(const precomputed_rbf_kernel& k) const {
+    return gamma == k.gamma && distances == k.distances;
+  }
+
+  std::shared_ptr<const dlib::matrix<double>> distances;
+  double gamma{0.1};
+};
+
+struct SVMSearchParams {
+  double gamma{0};
+  double c1{0};
+  double c2{0};
+  double accuracy{0};
+};
+
+/*
+ * Searches RBF SVM parameters (gamma, c1, c2) with cross-validation.
+ * Candidates are requested from dlib global search in batches and every
+ * (candidate, fold) pair is trained on a separate thread. Folds are split
+ * once and kernel values come from the shared squared distances matrix.
+ * Ranges span several orders of magnitude, so the search runs over the
+ * logarithms of the parameters and the bounds should be positive.
+ */
+template <typename Sample>
+SVMSearchParams SearchSVMParams(const std::vector<Sample>& samples,
+                                const std::vector<double>& labels,
+                                const dlib::matrix<double, 0, 1>& lower,
+                                const dlib::matrix<double, 0, 1>& upper,
+                                size_t max_calls,
+                                size_t folds_num = 10,
+                                unsigned num_threads = 0) {
+  using kernel_type = precomputed_rbf_kernel;
+  using ova_trainer =
+      dlib::one_vs_all_trainer<dlib::any_trainer<unsigned long>>;
+
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  const long n = static_cast<long>(samples.size());
+
+  // ----------- Squared distances for all pairs of samples
+  auto distances = std::make_shared<dlib::matrix<double>>(n, n);
+  dlib::parallel_for(num_threads, 0, n, [&](long i) {
+    for (long j = 0; j < n; ++j)
+      (*distances)(i, j) = SquaredDistance(samples[i], samples[j]);
+  });
+  std::shared_ptr<const dlib::matrix<double>> shared_distances = distances;
+
+  // ----------- Stratified folds, each class is spread over folds evenly
+  std::vector<std::vector<unsigned long>> train_folds(folds_num);
+  std::vector<std::vector<unsigned long>> test_folds(folds_num);
+  std::vector<std::vector<double>> train_labels(folds_num);
+  {
+    std::map<double, size_t> class_counts;
+    for (long i = 0; i < n; ++i) {
+      size_t fold = class_counts[labels[i]]++ % folds_num;
+      for (size_t f = 0; f < folds_num; ++f) {
+        if (f == fold) {
+          test_folds[f].push_back(static_cast<unsigned long>(i));
+        } else {
+          train_folds[f].push_back(static_cast<unsigned long>(i));
+          train_labels[f].push_back(labels[i]);
+        }
+      }
+    }
+  }
+
+  auto fold_matches = [&](const dlib::matrix<double, 0, 1>& log_x,
+                          size_t fold) {
+    dlib::matrix<double, 0, 1> x = dlib::exp(log_x);
+    dlib::svm_c_trainer<kernel_type> svm_trainer;
+    svm_trainer.set_kernel(kernel_type(shared_distances, x(0)));
+    svm_trainer.set_c_class1(x(1));
+    svm_trainer.set_c_class2(x(2));
+    ova_trainer trainer;
+    trainer.set_num_threads(1);  // parallelism is on candidates level
+    trainer.set_trainer(svm_trainer);
+    auto df = trainer.train(train_folds[fold], train_labels[fold]);
+    size_t matches = 0;
+    for (auto i : test_folds[fold]) {
+      if (df(i) == labels[i])
+        ++matches;
+    }
+    return matches;
+  };
+
+  // ----------- Evaluate candidates in batches
+  if (dlib::min(lower) <= 0)
+    throw std::invalid_argument("SVM parameters bounds should be positive");
+  dlib::global_function_search search(
+      dlib::function_spec(dlib::log(lower), dlib::log(upper)));
+  size_t calls = 0;
+  while (calls < max_calls) {
+    // every candidate gives folds_num tasks, so only a few candidates are
+    // requested at once to keep the search adaptive
+    size_t batch = std::min<size_t>(
+        std::max<size_t>(1, num_threads / folds_num + 1), max_calls - calls);
+    std::vector<dlib::function_evaluation_request> requests;
+    for (size_t i = 0; i < batch; ++i)
+      requests.push_back(search.get_next_x());
+
+    std::vector<size_t> matches(batch * folds_num, 0);
+    dlib::parallel_for(num_threads, 0, static_cast<long>(matches.size()),
+                       [&](long task) {
+                         matches[task] = fold_matches(
+                             requests[task / folds_num].x(), task % folds_num);
+                       });
+
+    for (size_t i = 0; i < batch; ++i) {
+      size_t candidate_matches = 0;
+      for (size_t f = 0; f < folds_num; ++f)
+        candidate_matches += matches[i * folds_num + f];
+      auto accuracy = static_cast<double>(candidate_matches) / n;
+      dlib::matrix<double, 0, 1> x = dlib::exp(requests[i].x());
+      std::cout << "gamma: " << x(0) << "  c1: " << x(1) << "  c2: " << x(2)
+                << "\ncross validation accuracy: " << accuracy << std::endl;
+      requests[i].set(accuracy);
+    }
+    calls += batch;
+  }
+
+  dlib::matrix<double, 0, 1> best_log_x;
+  double best_y = 0;
+  size_t function_idx = 0;
+  search.get_best_function_eval(best_log_x, best_y, function_idx);
+  dlib::matrix<double, 0, 1> best_x = dlib::exp(best_log_x);
+  return {best_x(0), best_x(1), best_x(2), best_y};
+}
+
+#endif  // SVM_SEARCH_H
@@ -0,0 +1,110 @@
+#ifndef CLASS_INDEX_H
+#define CLASS_INDEX_H
+
+#include <shark/Data/Dataset.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// Iterates one column of row major values
+struct ColumnIterator {
+  // iterator traits
+  using difference_type = std::ptrdiff_t;
+  using value_type = double;
+  using pointer = const double*;
+  using reference = const double&;
+  using iterator_category = std::forward_iterator_tag;
+  ColumnIterator() : value(nullptr), stride(0) {}
+  ColumnIterator(const double* value, size_t stride)
+      : value(value), stride(stride) {}
+  ColumnIterator& operator++() {
+    value += stride;
+    return *this;
+  }
+  const double& operator*() const { return *value; }
+  const double* value;
+  size_t stride;
+};
+
+inline bool operator==(const ColumnIterator& a, const ColumnIterator& b) {
+  return a.value == b.value;
+}
+
+inline bool operator!=(const ColumnIterator& a, const ColumnIterator& b) {
+  return a.value != b.value;
+}
+
+/*
+ * Per class index of a dataset built once in two linear passes. Rows are
+ * grouped by class in CSR layout: rows of class `c` are stored
+ * contiguously from offsets[c] to offsets[c + 1], so per class views don't
+ * search labels.
+ */
+class ClassIndex {
+ public:
+  ClassIndex(const shark::Data<shark::RealVector>& data,
+             const shark::Data<unsigned int>& labels) {
+    // ----------- Count elements of every class
+    for (auto label : labels.elements()) {
+      if (label + 1 >= offsets_.size())
+        offsets_.resize(label + 2, 0);
+      ++offsets_[label + 1];
+    }
+    if (offsets_.empty())
+      offsets_.push_back(0);
+    for (size_t c = 1; c < offsets_.size(); ++c)
+      offsets_[c] += offsets_[c - 1];
+
+    // ----------- Put rows to the class ranges
+    dims_ = data.numberOfElements() > 0 ? data.element(0).size() : 0;
+    rows_.resize(offsets_.back());
+    values_.resize(offsets_.back() * dims_);
+    std::vector<size_t> positions(offsets_.begin(), offsets_.end() - 1);
+    auto label = labels.elements().begin();
+    size_t row = 0;
+    for (auto&& element : data.elements()) {
+      auto position = positions[*label]++;
+      rows_[position] = row;
+      std::copy(element.begin(), element.end(),
+                values_.begin() + position * dims_);
+      ++label;
+      ++row;
+    }
+  }
+
+  size_t GetClassesCount() const { return offsets_.size() - 1; }
+
+  size_t GetClassSize(unsigned int label) const {
+    return label < GetClassesCount() ? offsets_[label + 1] - offsets_[label]
+                                     : 0;
+  }
+
+  // Original indices of the class elements
+  const size_t* RowsBegin(unsigned int label) const {
+    return rows_.data() + offsets_[std::min<size_t>(label, GetClassesCount())];
+  }
+  const size_t* RowsEnd(unsigned int label) const {
+    return RowsBegin(label) + GetClassSize(label);
+  }
+
+  // Values of the `column` for the class elements
+  ColumnIterator begin(unsigned int label, size_t column) const {
+    auto first = offsets_[std::min<size_t>(label, GetClassesCount())];
+    return ColumnIterator(values_.data() + first * dims_ + column, dims_);
+  }
+  ColumnIterator end(unsigned int label, size_t column) const {
+    auto first = offsets_[std::min<size_t>(label, GetClassesCount())];
+    return ColumnIterator(
+        values_.data() + (first + GetClassSize(label)) * dims_ + column,
+        dims_);
+  }
+
+ private:
+  size_t dims_{0};
+  std::vector<size_t> offsets_;  // classes count + 1 elements
+  std::vector<size_t> rows_;
+  std::vector<double> values_;  // rows grouped by class, row major
+};
+
+#endif  // CLASS_INDEX_H
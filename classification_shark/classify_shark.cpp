@@ -1,12 +1,15 @@
 // third party includes
 #include <plot.h>
+#include <boost/archive/polymorphic_binary_iarchive.hpp>
+#include <boost/archive/polymorphic_binary_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
 #include <shark/Algorithms/DirectSearch/GridSearch.h>
 #include <shark/Algorithms/JaakkolaHeuristic.h>
 #include <shark/Algorithms/Trainers/CSvmTrainer.h>
 #include <shark/Algorithms/Trainers/NormalizeComponentsUnitVariance.h>
 #include <shark/Algorithms/Trainers/PCA.h>
 #include <shark/Algorithms/Trainers/RFTrainer.h>
-#include <shark/Data/Csv.h>
+#include <shark/Data/Dataset.h>
 #include <shark/Models/ConcatenatedModel.h>
 #include <shark/Models/Kernels/GaussianRbfKernel.h>
 #include <shark/Models/Normalizer.h>
@@ -14,21 +17,28 @@
 #include <shark/ObjectiveFunctions/Loss/ZeroOneLoss.h>
 
 // stl includes
+#include <chrono>
+#include <cmath>
 #include <experimental/filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <regex>
-#include <streambuf>
+#include <stdexcept>
 
 // application includes
+#include "../batchpredict.h"
+#include "../csvreader.h"
 #include "../ioutils.h"
 #include "../utils.h"
-#include "class_iterator.h"
+#include "class_index.h"
 
 // Namespace and type aliases
 namespace fs = std::experimental::filesystem;
 
+// Trained models are loaded from these files if they exist
+static const std::string svm_model_file{"shark_svm.model"};
+static const std::string rf_model_file{"shark_rf.model"};
+
 static const std::string train_data_url =
     "https://raw.githubusercontent.com/pandas-dev/pandas/master/pandas/tests/"
     "data/iris.csv";
@@ -46,25 +56,24 @@ shark::ClassificationDataset LoadData() {
       return 1;
     }
   }
-  // ----------- Load data to string
-  std::ifstream data_file(data_path);
-  std::string train_data_str((std::istreambuf_iterator<char>(data_file)),
-                             std::istreambuf_iterator<char>());
-
-  // ----------- Remove first line - columns labels
-  train_data_str.erase(0, train_data_str.find_first_of("\n") + 1);
-
-  // ----------- Replace string labels with ints
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-setosa"), "0");
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-versicolor"), "1");
-  train_data_str =
-      std::regex_replace(train_data_str, std::regex("Iris-virginica"), "2");
-
-  // ----------- Load data to Dataset
-  shark::ClassificationDataset train_data;
-  shark::csvStringToData(train_data, train_data_str, shark::LAST_COLUMN);
+  // ----------- Parse CSV directly into the dataset elements, string labels
+  // are mapped to ints in order of appearance
+  csv::Reader reader(data_path);
+  auto columns = reader.GetFeaturesCount();
+  shark::ClassificationDataset train_data(
+      reader.GetRowsCount(), shark::ClassificationDataset::element_type(
+                                 shark::RealVector(columns), 0u));
+  auto elements = train_data.elements();
+  auto element = elements.begin();
+  reader.ForEachChunk<double>(
+      [&](const double* features, const uint32_t* labels, size_t rows) {
+        for (size_t row = 0; row < rows; ++row, ++element) {
+          auto&& pair = *element;
+          std::copy(features, features + columns, pair.input.begin());
+          pair.label = labels[row];
+          features += columns;
+        }
+      });
   return train_data;
 }
 
@@ -76,41 +85,34 @@ void ShowModel(const shark::ClassificationDataset& true_data,
   shark::LinearModel<> enc;
   pca.encoder(enc, 2);
   shark::Data<shark::RealVector> encoded_data = enc(true_data.inputs());
-  auto& lables = true_data.labels();
-
-  ClassIterator di_0_x(&encoded_data, &lables, 0, 0);
-  ClassIterator di_0_y(&encoded_data, &lables, 0, 1);
-
-  ClassIterator di_1_x(&encoded_data, &lables, 1, 0);
-  ClassIterator di_1_y(&encoded_data, &lables, 1, 1);
-
-  ClassIterator di_2_x(&encoded_data, &lables, 2, 0);
-  ClassIterator di_2_y(&encoded_data, &lables, 2, 1);
-
-  ClassIterator pdi_0_x(&encoded_data, &predictions, 0, 0);
-  ClassIterator pdi_0_y(&encoded_data, &predictions, 0, 1);
-
-  ClassIterator pdi_1_x(&encoded_data, &predictions, 1, 0);
-  ClassIterator pdi_1_y(&encoded_data, &predictions, 1, 1);
-
-  ClassIterator pdi_2_x(&encoded_data, &predictions, 2, 0);
-  ClassIterator pdi_2_y(&encoded_data, &predictions, 2, 1);
+  // elements are grouped by class once, instead of label scans per point
+  ClassIndex true_index(encoded_data, true_data.labels());
+  ClassIndex predicted_index(encoded_data, predictions);
 
   plotcpp::Plot plt(true);
   plt.SetTerminal("qt");
   plt.SetAutoscale();
   plt.GnuplotCommand("set grid");
-  plt.Draw2D(plotcpp::Points(di_0_x, ClassIterator(), di_0_y, "class 0",
+  plt.Draw2D(plotcpp::Points(true_index.begin(0, 0), true_index.end(0, 0),
+                             true_index.begin(0, 1), "class 0",
                              "lc rgb 'red' pt 4"),
-             plotcpp::Points(di_1_x, ClassIterator(), di_1_y, "class 1",
+             plotcpp::Points(true_index.begin(1, 0), true_index.end(1, 0),
+                             true_index.begin(1, 1), "class 1",
                              "lc rgb 'green' pt 4"),
-             plotcpp::Points(di_2_x, ClassIterator(), di_2_y, "class 2",
+             plotcpp::Points(true_index.begin(2, 0), true_index.end(2, 0),
+                             true_index.begin(2, 1), "class 2",
                              "lc rgb 'blue' pt 4"),
-             plotcpp::Points(pdi_0_x, ClassIterator(), pdi_0_y, "predict 0",
+             plotcpp::Points(predicted_index.begin(0, 0),
+                             predicted_index.end(0, 0),
+                             predicted_index.begin(0, 1), "predict 0",
                              "lc rgb 'red' pt 1"),
-             plotcpp::Points(pdi_1_x, ClassIterator(), pdi_1_y, "predict 1",
+             plotcpp::Points(predicted_index.begin(1, 0),
+                             predicted_index.end(1, 0),
+                             predicted_index.begin(1, 1), "predict 1",
                              "lc rgb 'green' pt 1"),
-             plotcpp::Points(pdi_2_x, ClassIterator(), pdi_2_y, "predict 2",
+             plotcpp::Points(predicted_index.begin(2, 0),
+                             predicted_index.end(2, 0),
+                             predicted_index.begin(2, 1), "predict 2",
                              "lc rgb 'blue' pt 1"));
   plt.Flush();
 }
@@ -119,23 +121,95 @@ void ShowModel(const shark::ClassificationDataset& true_data,
 using Model = shark::AbstractModel<remora::vector<double, remora::cpu_tag>,
                                    unsigned int,
                                    remora::vector<double, remora::cpu_tag>>;
-void EvaluateModel(const std::string& name,
-                   const Model& model,
-                   const shark::Normalizer<shark::RealVector>& normalizer,
-                   const shark::ClassificationDataset& train_data,
-                   const shark::ClassificationDataset& test_data) {
+// Train error and plot are shown only for a trained model, its train data is
+// normalized already
+void EvaluateTraining(const std::string& name,
+                      const Model& model,
+                      const shark::ClassificationDataset& train_data) {
   shark::ZeroOneLoss<unsigned int> loss;
   auto output = model(train_data.inputs());
   auto train_error = loss.eval(train_data.labels(), output);
   std::cout << name << " train error = " << train_error << std::endl;
 
   ShowModel(train_data, output);
+}
 
-  output = model(normalizer(test_data.inputs()));
+void EvaluateModel(const std::string& name,
+                   const Model& model,
+                   const shark::Normalizer<shark::RealVector>& normalizer,
+                   const shark::ClassificationDataset& test_data) {
+  shark::ZeroOneLoss<unsigned int> loss;
+  auto output = model(normalizer(test_data.inputs()));
   auto test_error = loss.eval(test_data.labels(), output);
   std::cout << name << " test error = " << test_error << std::endl;
 }
 
+// ----------- Batch prediction
+// Rows of a block are copied to a batch matrix, normalized and passed to the
+// decision function with one call, so models evaluate whole batches.
+template <typename Classifier>
+class BatchPredictor {
+ public:
+  BatchPredictor(const Classifier& classifier,
+                 const shark::Normalizer<shark::RealVector>& normalizer,
+                 size_t cols)
+      : classifier_(classifier), normalizer_(normalizer), cols_(cols) {}
+
+  void operator()(const double* rows,
+                  size_t count,
+                  uint32_t* labels,
+                  float* scores,
+                  size_t /*worker*/) const {
+    shark::RealMatrix batch(count, cols_);
+    for (size_t i = 0; i < count; ++i) {
+      for (size_t j = 0; j < cols_; ++j)
+        batch(i, j) = rows[i * cols_ + j];
+    }
+    shark::RealMatrix outputs =
+        classifier_.decisionFunction()(normalizer_(batch));
+    for (size_t i = 0; i < count; ++i) {
+      if (outputs.size2() == 1) {  // binary decision
+        labels[i] = outputs(i, 0) > 0 ? 1 : 0;
+        scores[i] = static_cast<float>(std::abs(outputs(i, 0)));
+      } else {
+        size_t best = 0;
+        for (size_t j = 1; j < outputs.size2(); ++j) {
+          if (outputs(i, j) > outputs(i, best))
+            best = j;
+        }
+        labels[i] = static_cast<uint32_t>(best);
+        scores[i] = static_cast<float>(outputs(i, best));
+      }
+    }
+  }
+
+ private:
+  const Classifier& classifier_;
+  const shark::Normalizer<shark::RealVector>& normalizer_;
+  size_t cols_;
+};
+
+template <typename Classifier>
+void EvaluateBatchPrediction(
+    const std::string& name,
+    const Classifier& classifier,
+    const shark::Normalizer<shark::RealVector>& normalizer,
+    const std::vector<double>& rows,
+    const std::vector<unsigned int>& labels) {
+  const size_t count = labels.size();
+  const size_t cols = count > 0 ? rows.size() / count : 0;
+  auto make_predictor = [&](size_t /*workers*/) {
+    return BatchPredictor<Classifier>(classifier, normalizer, cols);
+  };
+  batch::ThreadPool pool;
+  auto predictor = make_predictor(pool.size());
+  auto predictions = batch::Predict(pool, rows.data(), count, cols, predictor);
+  std::cout << name << " batch test accuracy = "
+            << batch::Accuracy(predictions, labels) << std::endl;
+  batch::BenchmarkThroughput("shark " + name, rows.data(), count, cols,
+                             make_predictor);
+}
+
 // ----------- SVM classificatoin
 // https://github.com/Shark-ML/Shark/blob/master/examples/Supervised/McSvm.tpp
 // http://www.shark-ml.org/sphinx_pages/build/html/rest_sources/tutorials/algorithms/svm.html
@@ -146,6 +220,7 @@ struct SVMModel {
   shark::GaussianRbfKernel<> kernel;
   // template parameter is input type
   shark::KernelClassifier<shark::RealVector> model;
+  double c{0};  // chosen regularization parameter
 };
 auto TrySVM(const shark::ClassificationDataset& train_data,
             const shark::CVFolds<shark::ClassificationDataset>& folds) {
@@ -189,6 +264,7 @@ auto TrySVM(const shark::ClassificationDataset& train_data,
 
   trainer.setParameterVector(grid.solution().point);
   trainer.train(svm->model, train_data);
+  svm->c = trainer.C();
   return svm;
 }
 
@@ -203,6 +279,55 @@ auto TryRF(const shark::ClassificationDataset& train_data,
   return rf;
 }
 
+// ----------- Model artifacts
+// Binary archive with hyper-parameters, normalizer and trained model, so a
+// scoring process loads it instead of training
+template <typename Model>
+void SaveModel(const std::string& file_name,
+               const Model& model,
+               const shark::Normalizer<shark::RealVector>& normalizer,
+               const std::vector<double>& hyper_parameters) {
+  std::ofstream file(file_name, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Can't create file " + file_name);
+  boost::archive::polymorphic_binary_oarchive archive(file);
+  archive << hyper_parameters;
+  normalizer.write(archive);
+  model.write(archive);
+}
+
+template <typename Model>
+void LoadModel(const std::string& file_name,
+               Model* model,
+               shark::Normalizer<shark::RealVector>* normalizer,
+               std::vector<double>* hyper_parameters) {
+  auto start = std::chrono::steady_clock::now();
+  std::ifstream file(file_name, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Can't open file " + file_name);
+  boost::archive::polymorphic_binary_iarchive archive(file);
+  archive >> *hyper_parameters;
+  normalizer->read(archive);
+  model->read(archive);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Loaded " << file_name << " in " << elapsed.count() << " ms"
+            << std::endl;
+}
+
+std::shared_ptr<SVMModel> LoadSVM(
+    const std::string& file_name,
+    shark::Normalizer<shark::RealVector>* normalizer) {
+  auto svm = std::make_shared<SVMModel>(1.0, true);
+  // kernel parameters are read to the kernel object used by the expansion
+  svm->model.decisionFunction().setKernel(&svm->kernel);
+  std::vector<double> hyper_parameters;
+  LoadModel(file_name, &svm->model, normalizer, &hyper_parameters);
+  if (hyper_parameters.size() == 2)
+    svm->c = hyper_parameters[1];
+  return svm;
+}
+
 int main(int, char* []) {
   try {
     shark::ClassificationDataset train_data = LoadData();
@@ -210,27 +335,71 @@ int main(int, char* []) {
     // www.shark-ml.org/sphinx_pages/build/html/rest_sources/tutorials/concepts/data/normalization.html
     train_data.shuffle();
     auto test_data = shark::splitAtElement(train_data, 120);
+    // raw test rows, in the same form as a prediction request
+    std::vector<double> test_rows;
+    std::vector<unsigned int> test_labels;
+    for (auto&& element : test_data.elements()) {
+      test_rows.insert(test_rows.end(), element.input.begin(),
+                       element.input.end());
+      test_labels.push_back(element.label);
+    }
 
-    bool remove_mean = true;
+    // Normalization and CV folds are prepared only when a model is trained,
+    // saved models are used as is with their own normalizers, so scoring
+    // doesn't wait for them
     shark::Normalizer<shark::RealVector> normalizer;
-    shark::NormalizeComponentsUnitVariance<shark::RealVector>
-        normalizing_trainer(remove_mean);
-    normalizing_trainer.train(normalizer, train_data.inputs());
-    train_data = shark::transformInputs(train_data, normalizer);
-
-    // ----------- Split data in folds for CV training
-    const unsigned int k = 5;  // number of folds
-    shark::CVFolds<shark::ClassificationDataset> folds =
-        shark::createCVSameSizeBalanced(train_data, k);
+    std::unique_ptr<shark::CVFolds<shark::ClassificationDataset>> folds;
+    auto prepare_training = [&]() {
+      if (folds)
+        return;
+      bool remove_mean = true;
+      shark::NormalizeComponentsUnitVariance<shark::RealVector>
+          normalizing_trainer(remove_mean);
+      normalizing_trainer.train(normalizer, train_data.inputs());
+      train_data = shark::transformInputs(train_data, normalizer);
+
+      // ----------- Split data in folds for CV training
+      const unsigned int k = 5;  // number of folds
+      folds = std::make_unique<shark::CVFolds<shark::ClassificationDataset>>(
+          shark::createCVSameSizeBalanced(train_data, k));
+    };
 
     // ----------- SVM classificatoin
-    auto svm_model = TrySVM(train_data, folds);
-    EvaluateModel("svm", svm_model->model, normalizer, train_data, test_data);
+    std::shared_ptr<SVMModel> svm_model;
+    shark::Normalizer<shark::RealVector> svm_normalizer;
+    if (fs::exists(svm_model_file)) {
+      svm_model = LoadSVM(svm_model_file, &svm_normalizer);
+    } else {
+      prepare_training();
+      svm_model = TrySVM(train_data, *folds);
+      svm_normalizer = normalizer;
+      SaveModel(svm_model_file, svm_model->model, normalizer,
+                {svm_model->kernel.gamma(), svm_model->c});
+      EvaluateTraining("svm", svm_model->model, train_data);
+    }
+    EvaluateModel("svm", svm_model->model, svm_normalizer, test_data);
+    EvaluateBatchPrediction("svm", svm_model->model, svm_normalizer,
+                            test_rows, test_labels);
 
     // ----------- Random Forest classificatoin
-    auto rf_model = TryRF(train_data, folds);
-    EvaluateModel("random forest", *rf_model, normalizer, train_data,
-                  test_data);
+    // RF is trained with the default trainer settings, so it has no
+    // hyper-parameters to store
+    auto rf_model = std::make_shared<shark::RFClassifier<unsigned int>>();
+    shark::Normalizer<shark::RealVector> rf_normalizer;
+    if (fs::exists(rf_model_file)) {
+      std::vector<double> hyper_parameters;
+      LoadModel(rf_model_file, rf_model.get(), &rf_normalizer,
+                &hyper_parameters);
+    } else {
+      prepare_training();
+      rf_model = TryRF(train_data, *folds);
+      rf_normalizer = normalizer;
+      SaveModel(rf_model_file, *rf_model, normalizer, {});
+      EvaluateTraining("random forest", *rf_model, train_data);
+    }
+    EvaluateModel("random forest", *rf_model, rf_normalizer, test_data);
+    EvaluateBatchPrediction("random forest", *rf_model, rf_normalizer,
+                            test_rows, test_labels);
 
   } catch (const std::exception& err) {
     std::cout << "Program crashed : " << err.what() << std::endl;
@@ -0,0 +1,106 @@
+// Random forest training and prediction benchmark on synthetic data
+// usage: rf_bench [--rows N] [--features N] [--classes N] [--trees N]
+//                 [--threads N] [--batch N] [--requests N]
+
+// third party includes
+#include <shark/Algorithms/Trainers/RFTrainer.h>
+#include <shark/Data/Dataset.h>
+
+#include <omp.h>
+
+// stl includes
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// application includes
+#include "../batchpredict.h"
+#include "../benchutils.h"
+
+int main(int argc, char** argv) {
+  try {
+    bench::Options options(argc, argv);
+    auto rows = options.Get("rows", 100000);
+    auto cols = options.Get("features", 20);
+    auto classes = options.Get("classes", 3);
+    auto trees = options.Get("trees", 100);
+    auto threads = options.Get(
+        "threads", std::max(1u, std::thread::hardware_concurrency()));
+    auto batch_size = std::min(options.Get("batch", 1), rows);
+    auto requests = options.Get("requests", 1000);
+    options.Print();
+
+    // RFTrainer builds trees in parallel with OpenMP
+    omp_set_num_threads(static_cast<int>(threads));
+
+    auto data = bench::MakeClassificationData(rows, cols, classes);
+    shark::ClassificationDataset dataset(
+        rows, shark::ClassificationDataset::element_type(
+                  shark::RealVector(cols), 0u));
+    size_t row = 0;
+    for (auto&& element : dataset.elements()) {
+      const double* features = data.features.data() + row * cols;
+      std::copy(features, features + cols, element.input.begin());
+      element.label = data.labels[row];
+      ++row;
+    }
+    std::cout << "data peak RSS = " << bench::GetPeakRSSMb() << " Mb"
+              << std::endl;
+
+    // ----------- Training
+    shark::RFTrainer<unsigned int> trainer;
+    trainer.setNTrees(trees);
+    shark::RFClassifier<unsigned int> forest;
+    bench::Timer train_timer;
+    trainer.train(forest, dataset);
+    std::cout << "shark train time = " << train_timer.GetElapsedMs() << " ms"
+              << std::endl;
+    std::cout << "train peak RSS = " << bench::GetPeakRSSMb() << " Mb"
+              << std::endl;
+
+    // ----------- Prediction latency, one request is a batch of rows
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    shark::RealMatrix batch(batch_size, cols);
+    for (size_t r = 0; r < requests; ++r) {
+      size_t first = (r * batch_size) % (rows - batch_size + 1);
+      for (size_t i = 0; i < batch_size; ++i) {
+        for (size_t j = 0; j < cols; ++j)
+          batch(i, j) = data.features[(first + i) * cols + j];
+      }
+      bench::Timer timer;
+      auto predictions = forest(batch);
+      latencies.push_back(timer.GetElapsedMs());
+      (void)predictions;
+    }
+    auto percentiles = bench::GetPercentiles(latencies);
+    std::cout << "shark predict latency (batch " << batch_size
+              << ") p50 = " << percentiles.p50 << " ms p90 = "
+              << percentiles.p90 << " ms p99 = " << percentiles.p99
+              << " ms max = " << percentiles.max << " ms" << std::endl;
+
+    // ----------- Prediction throughput
+    auto make_predictor = [&](size_t /*workers*/) {
+      return [&](const double* block, size_t count, uint32_t* labels,
+                 float* scores, size_t /*worker*/) {
+        shark::RealMatrix inputs(count, cols);
+        for (size_t i = 0; i < count; ++i) {
+          for (size_t j = 0; j < cols; ++j)
+            inputs(i, j) = block[i * cols + j];
+        }
+        auto outputs = forest(inputs);
+        for (size_t i = 0; i < count; ++i) {
+          labels[i] = outputs(i);
+          scores[i] = 1.f;
+        }
+      };
+    };
+    batch::BenchmarkThroughput("shark rf", data.features.data(), rows, cols,
+                               make_predictor);
+    std::cout << "peak RSS = " << bench::GetPeakRSSMb() << " Mb" << std::endl;
+  } catch (const std::exception& err) {
+    std::cout << "Program crashed : " << err.what() << std::endl;
+  }
+  return 0;
+}
@@ -11,6 +11,7 @@
 #include <shogun/features/CombinedFeatures.h>
 #include <shogun/features/DenseFeatures.h>
 #include <shogun/io/File.h>
+#include <shogun/io/SerializableAsciiFile.h>
 #include <shogun/kernel/GaussianKernel.h>
 #include <shogun/kernel/LinearKernel.h>
 #include <shogun/labels/MulticlassLabels.h>
@@ -28,13 +29,25 @@
 #include <omp.h>
 
 // stl includes
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <vector>
 
+// application includes
+#include "../batchpredict.h"
+#include "../csvreader.h"
+
 const std::string train_data_file_name =
     "/home/kirill/development/dataset/iris/iris.csv";
+// Trained models are loaded from these files if they exist
+const std::string svm_model_file = "shogun_svm.model";
+const std::string forest_model_file = "shogun_forest.model";
 
 // Namespace and type aliases
 using DType = float64_t;  // Offten it is impossible to use 32 bit float because
@@ -48,31 +61,16 @@ Data load_data(const std::string& file_name) {
   // algorithms use reference counting for such types of objects, and take it as
   // input parameter by pointer.
 
-  auto data_file = shogun::some<shogun::CCSVFile>(file_name.c_str());
-
-  // skip lables row
-  data_file->set_lines_to_skip(1);
-
-  // Shogun csv reader transpose data from file - restore right order
-  // commented because some time leads to crash ???
-  // data_file->set_transpose(true);
-
-  // Load data from CSV to matrix
-  // Matrix object can be created on stack
-  Matrix data;
-  data.load(data_file);
-
-  Matrix::transpose_matrix(data.matrix, data.num_rows, data.num_cols);
+  // Shogun expects samples in columns, so the column major feature matrix
+  // has the same layout as CSV rows and they are parsed directly into it
+  csv::Reader reader(file_name);
+  auto rows = reader.GetRowsCount();
+  auto columns = reader.GetFeaturesCount();
+  Matrix data(static_cast<index_t>(columns), static_cast<index_t>(rows));
+  std::vector<uint32_t> class_ids(rows);
+  reader.Read(data.matrix, columns, class_ids.data());
 
-  // Exclude classification info from data
-  Matrix data_no_class = data.submatrix(0, data.num_cols - 1);  // make a view
-  data_no_class = data_no_class.clone();  // copy exact data
-
-  // Transpose because shogun algorithms expect that samples are in colums
-  Matrix::transpose_matrix(data_no_class.matrix, data_no_class.num_rows,
-                           data_no_class.num_cols);
-
-  auto features = shogun::some<shogun::CDenseFeatures<DType>>(data_no_class);
+  auto features = shogun::some<shogun::CDenseFeatures<DType>>(data);
 
   // features->get_feature_matrix().display_matrix();
 
@@ -84,10 +82,9 @@ Data load_data(const std::string& file_name) {
 
   std::cout << "labels = " << labels->get_num_labels() << std::endl;
 
-  for (int i = 0; i < labels->get_num_labels() / 3; ++i) {
-    labels->set_int_label(i, 0);
-    labels->set_int_label(i + 50, 1);
-    labels->set_int_label(i + 100, 2);
+  // String labels are mapped to ints in order of appearance
+  for (index_t i = 0; i < labels->get_num_labels(); ++i) {
+    labels->set_int_label(i, static_cast<int32_t>(class_ids[i]));
   }
 
   // shuffle data
@@ -115,7 +112,7 @@ void show_accuracy(shogun::Some<shogun::CMulticlassLabels> prediction,
   }
 }
 
-void random_forest(Data train_data) {
+shogun::Some<shogun::CMachine> random_forest(Data train_data) {
   std::cout << "Train Random Forest ..." << std::endl;
   auto vote = shogun::some<shogun::CMajorityVote>();
   auto rand_forest = shogun::some<shogun::CRandomForest>(0, 10);
@@ -140,9 +137,10 @@ void random_forest(Data train_data) {
 
   // estimate accuracy
   show_accuracy(forest_predict, std::get<1>(train_data));
+  return shogun::wrap(static_cast<shogun::CMachine*>(rand_forest));
 }
 
-void svm(Data train_data) {
+shogun::Some<shogun::CMachine> svm(Data train_data) {
   std::cout << "Train SVM ..." << std::endl;
 
   auto kernel = shogun::wrap(new shogun::CGaussianKernel(5));
@@ -151,6 +149,9 @@ void svm(Data train_data) {
   svm->set_kernel(kernel);
   svm->set_C(1);
   svm->set_epsilon(0.00001);
+  // keep support vectors in the machine, so it can be saved and applied
+  // without the train features
+  svm->set_store_model_features(true);
 
   const int num_subsets = 2;
   auto splitting_strategy = shogun::some<shogun::CCrossValidationSplitting>(
@@ -183,17 +184,119 @@ void svm(Data train_data) {
 
   // estimate accuracy
   show_accuracy(svm_predict, std::get<1>(train_data));
+  return shogun::wrap(machine);
 }
 
-int main(int, char* []) {
-  shogun::init_shogun_with_defaults();
-  // shogun::sg_io->set_loglevel(shogun::MSG_INFO);
-  shogun::sg_rand->set_seed(10);
+// ----------- Batch prediction
+// Rows of a block are copied to a feature matrix, preprocessed and
+// classified with one apply call. Machines keep applied features, so every
+// worker has its own clone.
+class BatchPredictor {
+ public:
+  BatchPredictor(shogun::CMachine* machine,
+                 std::vector<shogun::CDensePreprocessor<DType>*> preprocessors,
+                 size_t cols,
+                 size_t workers)
+      : preprocessors_(std::move(preprocessors)), cols_(cols) {
+    for (size_t i = 0; i < workers; ++i) {
+      machines_.push_back(
+          shogun::wrap(static_cast<shogun::CMachine*>(machine->clone())));
+    }
+  }
 
-  // load data
-  std::cout << "Loading train data ..." << std::endl;
-  auto train_data = load_data(train_data_file_name);
+  void operator()(const DType* rows,
+                  size_t count,
+                  uint32_t* labels,
+                  float* scores,
+                  size_t worker) {
+    // column major matrix with samples in columns has the rows layout
+    Matrix block(static_cast<index_t>(cols_), static_cast<index_t>(count));
+    std::copy(rows, rows + count * cols_, block.matrix);
+    auto features = shogun::some<shogun::CDenseFeatures<DType>>(block);
+    for (auto* preprocessor : preprocessors_)
+      preprocessor->apply_to_feature_matrix(features);
+
+    auto predictions =
+        shogun::wrap(machines_[worker]->apply_multiclass(features));
+    for (index_t i = 0; i < static_cast<index_t>(count); ++i) {
+      labels[i] = static_cast<uint32_t>(predictions->get_int_label(i));
+      // some machines give only hard labels
+      auto confidences = predictions->get_multiclass_confidences(i);
+      scores[i] = confidences.vlen > 0
+                      ? static_cast<float>(shogun::CMath::max(
+                            confidences.vector, confidences.vlen))
+                      : 1.f;
+    }
+  }
+
+ private:
+  std::vector<shogun::Some<shogun::CMachine>> machines_;
+  std::vector<shogun::CDensePreprocessor<DType>*> preprocessors_;
+  size_t cols_;
+};
+
+void evaluate_batch_prediction(
+    const std::string& name,
+    shogun::CMachine* machine,
+    const std::vector<shogun::CDensePreprocessor<DType>*>& preprocessors,
+    const std::vector<DType>& rows,
+    const std::vector<uint32_t>& labels) {
+  const size_t count = labels.size();
+  const size_t cols = count > 0 ? rows.size() / count : 0;
+  auto make_predictor = [&](size_t workers) {
+    return BatchPredictor(machine, preprocessors, cols, workers);
+  };
+  batch::ThreadPool pool;
+  auto predictor = make_predictor(pool.size());
+  auto predictions = batch::Predict(pool, rows.data(), count, cols, predictor);
+  std::cout << name << " batch accuracy = "
+            << batch::Accuracy(predictions, labels) << std::endl;
+  batch::BenchmarkThroughput("shogun " + name, rows.data(), count, cols,
+                             make_predictor);
+}
 
+// ----------- Model artifacts
+// Machine is saved together with the preprocessors, hyper-parameters
+// (kernel, C, forest settings) are parameters of the serialized machine.
+struct Model {
+  shogun::Some<shogun::CMachine> machine;
+  shogun::Some<shogun::CRescaleFeatures> scaler;
+  shogun::Some<shogun::CPCA> pca;
+};
+
+void save_model(const std::string& file_name, const Model& model) {
+  auto file = shogun::some<shogun::CSerializableAsciiFile>(file_name.c_str(),
+                                                           'w');
+  if (!model.scaler->save_serializable(file, "scaler_") ||
+      !model.pca->save_serializable(file, "pca_") ||
+      !model.machine->save_serializable(file, "machine_"))
+    throw std::runtime_error("Can't save model to " + file_name);
+}
+
+template <typename Machine>
+Model load_model(const std::string& file_name) {
+  auto start = std::chrono::steady_clock::now();
+  auto file = shogun::some<shogun::CSerializableAsciiFile>(file_name.c_str(),
+                                                           'r');
+  auto machine = shogun::some<Machine>();
+  auto scaler = shogun::some<shogun::CRescaleFeatures>();
+  auto pca = shogun::some<shogun::CPCA>();
+  if (!scaler->load_serializable(file, "scaler_") ||
+      !pca->load_serializable(file, "pca_") ||
+      !machine->load_serializable(file, "machine_"))
+    throw std::runtime_error("Can't load model from " + file_name);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Loaded " << file_name << " in " << elapsed.count() << " ms"
+            << std::endl;
+  return {shogun::wrap(static_cast<shogun::CMachine*>(machine)), scaler, pca};
+}
+
+using Transforms = std::tuple<shogun::Some<shogun::CRescaleFeatures>,
+                              shogun::Some<shogun::CPCA>>;
+
+// Fits the scaler and PCA on the train data and applies them to it in place
+Transforms fit_transforms(Data train_data) {
   // rescale
   std::cout << "Rescale data ..." << std::endl;
   auto scaler = shogun::wrap(new shogun::CRescaleFeatures());
@@ -206,10 +309,61 @@ int main(int, char* []) {
   pca->set_target_dim(2);  // before init
   pca->init(std::get<0>(train_data));
   pca->apply_to_feature_matrix(std::get<0>(train_data));
+  return {scaler, pca};
+}
+
+bool file_exists(const std::string& file_name) {
+  return std::ifstream(file_name).good();
+}
+
+int main(int, char* []) {
+  shogun::init_shogun_with_defaults();
+  // shogun::sg_io->set_loglevel(shogun::MSG_INFO);
+  shogun::sg_rand->set_seed(10);
+
+  // load data
+  std::cout << "Loading train data ..." << std::endl;
+  auto train_data = load_data(train_data_file_name);
 
-  // Try models
-  svm(train_data);
-  random_forest(train_data);
+  // keep raw rows for batch prediction, in the same form as a request
+  auto raw_matrix = std::get<0>(train_data)->get_feature_matrix();
+  std::vector<DType> raw_rows(
+      raw_matrix.matrix,
+      raw_matrix.matrix + raw_matrix.num_rows * raw_matrix.num_cols);
+  auto raw_labels_vector = std::get<1>(train_data)->get_int_labels();
+  std::vector<uint32_t> raw_labels(
+      raw_labels_vector.vector,
+      raw_labels_vector.vector + raw_labels_vector.vlen);
+
+  // Try models, saved models are used as is with their own scaler and PCA,
+  // so scoring doesn't wait for fitting transforms or training
+  std::unique_ptr<Transforms> transforms;
+  auto train_model = [&](auto train) {
+    if (!transforms)
+      transforms = std::make_unique<Transforms>(fit_transforms(train_data));
+    return Model{train(train_data), std::get<0>(*transforms),
+                 std::get<1>(*transforms)};
+  };
+
+  bool svm_saved = file_exists(svm_model_file);
+  auto svm_model = svm_saved
+                       ? load_model<shogun::CMulticlassLibSVM>(svm_model_file)
+                       : train_model(svm);
+  if (!svm_saved)
+    save_model(svm_model_file, svm_model);
+  evaluate_batch_prediction("svm", svm_model.machine,
+                            {svm_model.scaler, svm_model.pca}, raw_rows,
+                            raw_labels);
+
+  bool forest_saved = file_exists(forest_model_file);
+  auto forest_model =
+      forest_saved ? load_model<shogun::CRandomForest>(forest_model_file)
+                   : train_model(random_forest);
+  if (!forest_saved)
+    save_model(forest_model_file, forest_model);
+  evaluate_batch_prediction("random forest", forest_model.machine,
+                            {forest_model.scaler, forest_model.pca}, raw_rows,
+                            raw_labels);
 
   shogun::exit_shogun();
   return 0;
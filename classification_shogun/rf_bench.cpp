@@ -0,0 +1,134 @@
+// Random forest training and prediction benchmark on synthetic data
+// usage: rf_bench [--rows N] [--features N] [--classes N] [--trees N]
+//                 [--threads N] [--batch N] [--requests N]
+
+// third party includes
+#include <shogun/base/init.h>
+#include <shogun/base/Parallel.h>
+#include <shogun/base/some.h>
+#include <shogun/ensemble/MajorityVote.h>
+#include <shogun/features/DenseFeatures.h>
+#include <shogun/labels/MulticlassLabels.h>
+#include <shogun/lib/SGMatrix.h>
+#include <shogun/lib/SGVector.h>
+#include <shogun/machine/RandomForest.h>
+
+#include <omp.h>
+
+// stl includes
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// application includes
+#include "../batchpredict.h"
+#include "../benchutils.h"
+
+using DType = float64_t;
+using Matrix = shogun::SGMatrix<DType>;
+
+// Shogun expects samples in columns, so the column major matrix has the
+// layout of row major rows
+shogun::Some<shogun::CDenseFeatures<DType>> MakeFeatures(const DType* rows,
+                                                         size_t count,
+                                                         size_t cols) {
+  Matrix matrix(static_cast<index_t>(cols), static_cast<index_t>(count));
+  std::copy(rows, rows + count * cols, matrix.matrix);
+  return shogun::some<shogun::CDenseFeatures<DType>>(matrix);
+}
+
+int main(int argc, char** argv) {
+  shogun::init_shogun_with_defaults();
+  try {
+    bench::Options options(argc, argv);
+    auto rows = options.Get("rows", 100000);
+    auto cols = options.Get("features", 20);
+    auto classes = options.Get("classes", 3);
+    auto trees = options.Get("trees", 100);
+    auto threads = options.Get(
+        "threads", std::max(1u, std::thread::hardware_concurrency()));
+    auto batch_size = std::min(options.Get("batch", 1), rows);
+    auto requests = options.Get("requests", 1000);
+    options.Print();
+
+    // Bagging machine trains trees in parallel with OpenMP
+    shogun::get_global_parallel()->set_num_threads(static_cast<int>(threads));
+    omp_set_num_threads(static_cast<int>(threads));
+
+    auto data = bench::MakeClassificationData(rows, cols, classes);
+    auto features = MakeFeatures(data.features.data(), rows, cols);
+    auto labels = shogun::wrap(
+        new shogun::CMulticlassLabels(static_cast<int32_t>(rows)));
+    for (index_t i = 0; i < static_cast<index_t>(rows); ++i)
+      labels->set_int_label(i, static_cast<int32_t>(data.labels[i]));
+    std::cout << "data peak RSS = " << bench::GetPeakRSSMb() << " Mb"
+              << std::endl;
+
+    // ----------- Training
+    auto vote = shogun::some<shogun::CMajorityVote>();
+    auto forest = shogun::some<shogun::CRandomForest>(
+        0, static_cast<int32_t>(trees));
+    forest->set_combination_rule(vote);
+    shogun::SGVector<bool> feature_types(static_cast<index_t>(cols));
+    shogun::SGVector<bool>::fill_vector(feature_types.vector,
+                                        feature_types.size(),
+                                        false);  // features are continuous
+    forest->set_feature_types(feature_types);
+    forest->set_labels(labels);
+    forest->set_machine_problem_type(shogun::EProblemType::PT_MULTICLASS);
+    bench::Timer train_timer;
+    if (!forest->train(features)) {
+      std::cout << "Failed to train Random Forest\n";
+      return 1;
+    }
+    std::cout << "shogun train time = " << train_timer.GetElapsedMs()
+              << " ms" << std::endl;
+    std::cout << "train peak RSS = " << bench::GetPeakRSSMb() << " Mb"
+              << std::endl;
+
+    // ----------- Prediction latency, one request is a batch of rows
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    for (size_t r = 0; r < requests; ++r) {
+      size_t first = (r * batch_size) % (rows - batch_size + 1);
+      bench::Timer timer;
+      auto batch = MakeFeatures(data.features.data() + first * cols,
+                                batch_size, cols);
+      auto predictions = shogun::wrap(forest->apply_multiclass(batch));
+      latencies.push_back(timer.GetElapsedMs());
+    }
+    auto percentiles = bench::GetPercentiles(latencies);
+    std::cout << "shogun predict latency (batch " << batch_size
+              << ") p50 = " << percentiles.p50 << " ms p90 = "
+              << percentiles.p90 << " ms p99 = " << percentiles.p99
+              << " ms max = " << percentiles.max << " ms" << std::endl;
+
+    // ----------- Prediction throughput
+    // machine keeps applied features, so every worker has its own clone
+    auto make_predictor = [&](size_t workers) {
+      std::vector<shogun::Some<shogun::CMachine>> machines;
+      for (size_t i = 0; i < workers; ++i) {
+        machines.push_back(
+            shogun::wrap(static_cast<shogun::CMachine*>(forest->clone())));
+      }
+      return [&, machines](const DType* block, size_t count, uint32_t* out,
+                           float* scores, size_t worker) {
+        auto predictions = shogun::wrap(
+            machines[worker]->apply_multiclass(MakeFeatures(block, count,
+                                                            cols)));
+        for (index_t i = 0; i < static_cast<index_t>(count); ++i) {
+          out[i] = static_cast<uint32_t>(predictions->get_int_label(i));
+          scores[i] = 1.f;
+        }
+      };
+    };
+    batch::BenchmarkThroughput("shogun rf", data.features.data(), rows, cols,
+                               make_predictor);
+    std::cout << "peak RSS = " << bench::GetPeakRSSMb() << " Mb" << std::endl;
+  } catch (const std::exception& err) {
+    std::cout << "Program crashed : " << err.what() << std::endl;
+  }
+  shogun::exit_shogun();
+  return 0;
+}
@@ -0,0 +1,737 @@
+#include "cocoindex.h"
+
+#include <rapidjson/error/en.h>
+#include <rapidjson/filereadstream.h>
+#include <rapidjson/reader.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace coco {
+
+namespace {
+const char cache_magic[8] = {'C', 'O', 'C', 'O', 'I', 'D', 'X', '\0'};
+const uint32_t cache_version = 2;
+const uint32_t invalid_slot = std::numeric_limits<uint32_t>::max();
+
+enum class JsonKey {
+  Other,
+  Images,
+  Annotations,
+  Categories,
+  Id,
+  ImageId,
+  CategoryId,
+  Width,
+  Height,
+  FileName,
+  Name,
+  BBox,
+  Segmentation,
+  IsCrowd,
+  Counts,
+  Size
+};
+
+JsonKey ToKey(const char* str, rapidjson::SizeType length) {
+  static const std::pair<std::string, JsonKey> keys[] = {
+      {"images", JsonKey::Images},
+      {"annotations", JsonKey::Annotations},
+      {"categories", JsonKey::Categories},
+      {"id", JsonKey::Id},
+      {"image_id", JsonKey::ImageId},
+      {"category_id", JsonKey::CategoryId},
+      {"width", JsonKey::Width},
+      {"height", JsonKey::Height},
+      {"file_name", JsonKey::FileName},
+      {"name", JsonKey::Name},
+      {"bbox", JsonKey::BBox},
+      {"segmentation", JsonKey::Segmentation},
+      {"iscrowd", JsonKey::IsCrowd},
+      {"counts", JsonKey::Counts},
+      {"size", JsonKey::Size}};
+  for (const auto& k : keys) {
+    if (k.first.size() == length &&
+        std::memcmp(k.first.data(), str, length) == 0)
+      return k.second;
+  }
+  return JsonKey::Other;
+}
+
+/*
+ * Decodes compressed RLE string, see `rleFrString` from the COCO API
+ * https://github.com/cocodataset/cocoapi/blob/master/common/maskApi.c
+ */
+void DecodeRLEString(const char* str,
+                     rapidjson::SizeType length,
+                     std::vector<uint32_t>& counts) {
+  size_t p = 0;
+  while (p < length) {
+    int64_t x = 0;
+    int64_t k = 0;
+    bool more = true;
+    while (more && p < length) {
+      int64_t c = static_cast<int64_t>(str[p]) - 48;
+      x |= (c & 0x1f) << 5 * k;
+      more = (c & 0x20) != 0;
+      ++p;
+      ++k;
+      if (!more && (c & 0x10))
+        x |= static_cast<int64_t>(~0ull << 5 * k);
+    }
+    auto m = counts.size();
+    if (m > 2)
+      x += counts[m - 2];
+    counts.push_back(static_cast<uint32_t>(x));
+  }
+}
+
+class IndexHandler
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, IndexHandler> {
+ public:
+  explicit IndexHandler(Index* index) : index_(index) {}
+
+  bool Int(int i) { return Number(i); }
+  bool Uint(unsigned u) { return Number(u); }
+  bool Int64(int64_t i) { return Number(i); }
+  bool Uint64(uint64_t u) { return Number(u); }
+  bool Double(double d) { return Number(d); }
+
+  bool String(const char* str, rapidjson::SizeType length, bool /*copy*/) {
+    if (object_depth_ == 2) {
+      if (section_ == JsonKey::Images && key_ == JsonKey::FileName) {
+        name_.assign(str, length);
+      } else if (section_ == JsonKey::Categories && key_ == JsonKey::Name) {
+        name_.assign(str, length);
+      }
+    } else if (rle_object_ && key_ == JsonKey::Counts) {
+      DecodeRLEString(str, length, rle_counts_);
+    }
+    return true;
+  }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool /*copy*/) {
+    key_ = ToKey(str, length);
+    return true;
+  }
+
+  bool StartObject() {
+    ++object_depth_;
+    if (object_depth_ == 3 && section_ == JsonKey::Annotations &&
+        key_ == JsonKey::Segmentation) {
+      rle_object_ = true;
+    }
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType /*memberCount*/) {
+    if (object_depth_ == 3 && rle_object_) {
+      rle_object_ = false;
+      annotation_.segmentation_type = SegmentationType::RLE;
+    } else if (object_depth_ == 2) {
+      switch (section_) {
+        case JsonKey::Images:
+          index_->AddImage(image_, name_);
+          image_ = Image();
+          break;
+        case JsonKey::Categories:
+          index_->AddCategory(category_id_, name_);
+          category_id_ = 0;
+          break;
+        case JsonKey::Annotations:
+          if (!polygon_sizes_.empty())
+            annotation_.segmentation_type = SegmentationType::Polygon;
+          index_->AddAnnotation(annotation_, coords_, polygon_sizes_,
+                                rle_counts_);
+          annotation_ = Annotation();
+          coords_.clear();
+          polygon_sizes_.clear();
+          rle_counts_.clear();
+          break;
+        default:
+          break;
+      }
+      name_.clear();
+    }
+    --object_depth_;
+    return true;
+  }
+
+  bool StartArray() {
+    if (object_depth_ == 1 && array_ == Array::None) {
+      if (key_ == JsonKey::Images || key_ == JsonKey::Annotations ||
+          key_ == JsonKey::Categories) {
+        section_ = key_;
+        array_ = Array::Section;
+      }
+    } else if (object_depth_ == 2 && section_ == JsonKey::Annotations) {
+      if (array_ == Array::Section && key_ == JsonKey::BBox) {
+        array_ = Array::BBox;
+        bbox_index_ = 0;
+      } else if (array_ == Array::Section && key_ == JsonKey::Segmentation) {
+        array_ = Array::Polygons;
+      } else if (array_ == Array::Polygons) {
+        array_ = Array::Polygon;
+        polygon_sizes_.push_back(0);
+      }
+    } else if (rle_object_) {
+      if (key_ == JsonKey::Counts) {
+        array_ = Array::Counts;
+      } else if (key_ == JsonKey::Size) {
+        array_ = Array::Size;
+        size_index_ = 0;
+      }
+    }
+    return true;
+  }
+
+  bool EndArray(rapidjson::SizeType /*elementCount*/) {
+    switch (array_) {
+      case Array::Section:
+        if (object_depth_ == 1) {
+          if (section_ == JsonKey::Images)
+            index_->SetImagesDone();
+          else if (section_ == JsonKey::Categories)
+            index_->SetCategoriesDone();
+          section_ = JsonKey::Other;
+          array_ = Array::None;
+        }
+        break;
+      case Array::Polygon:
+        array_ = Array::Polygons;
+        break;
+      case Array::Polygons:
+      case Array::BBox:
+      case Array::Counts:
+      case Array::Size:
+        array_ = Array::Section;
+        break;
+      default:
+        break;
+    }
+    return true;
+  }
+
+ private:
+  enum class Array {
+    None,
+    Section,
+    BBox,
+    Polygons,
+    Polygon,
+    Counts,
+    Size
+  };
+
+  template <typename T>
+  bool Number(T v) {
+    switch (array_) {
+      case Array::BBox:
+        PushBBox(static_cast<float>(v));
+        return true;
+      case Array::Polygons:
+        // flat polygon without nesting
+        if (polygon_sizes_.empty())
+          polygon_sizes_.push_back(0);
+        coords_.push_back(static_cast<float>(v));
+        ++polygon_sizes_.back();
+        return true;
+      case Array::Polygon:
+        coords_.push_back(static_cast<float>(v));
+        ++polygon_sizes_.back();
+        return true;
+      case Array::Counts:
+        rle_counts_.push_back(static_cast<uint32_t>(v));
+        return true;
+      case Array::Size:
+        if (size_index_ == 0)
+          annotation_.rle_height = static_cast<uint32_t>(v);
+        else if (size_index_ == 1)
+          annotation_.rle_width = static_cast<uint32_t>(v);
+        ++size_index_;
+        return true;
+      default:
+        break;
+    }
+    if (object_depth_ != 2)
+      return true;
+
+    if (section_ == JsonKey::Images) {
+      if (key_ == JsonKey::Id) {
+        image_.id = static_cast<uint32_t>(v);
+      } else if (key_ == JsonKey::Width) {
+        image_.width = static_cast<uint32_t>(v);
+      } else if (key_ == JsonKey::Height) {
+        image_.height = static_cast<uint32_t>(v);
+      }
+    } else if (section_ == JsonKey::Categories) {
+      if (key_ == JsonKey::Id) {
+        category_id_ = static_cast<uint32_t>(v);
+      }
+    } else if (section_ == JsonKey::Annotations) {
+      if (key_ == JsonKey::Id) {
+        annotation_.id = static_cast<uint64_t>(v);
+      } else if (key_ == JsonKey::ImageId) {
+        annotation_.image_id = static_cast<uint32_t>(v);
+      } else if (key_ == JsonKey::CategoryId) {
+        annotation_.category_id = static_cast<uint32_t>(v);
+      } else if (key_ == JsonKey::IsCrowd) {
+        annotation_.iscrowd = v == 1 ? 1 : 0;
+      }
+    }
+    return true;
+  }
+
+  void PushBBox(float v) {
+    switch (bbox_index_) {
+      case 0:
+        annotation_.bbox.x = v;
+        break;
+      case 1:
+        annotation_.bbox.y = v;
+        break;
+      case 2:
+        annotation_.bbox.width = v;
+        break;
+      case 3:
+        annotation_.bbox.height = v;
+        break;
+    }
+    ++bbox_index_;
+  }
+
+  Index* index_{nullptr};
+
+  JsonKey key_{JsonKey::Other};
+  JsonKey section_{JsonKey::Other};
+  Array array_{Array::None};
+  int object_depth_{0};
+  bool rle_object_{false};
+
+  Image image_;
+  std::string name_;
+  uint32_t category_id_{0};
+
+  Annotation annotation_;
+  uint32_t bbox_index_{0};
+  uint32_t size_index_{0};
+  std::vector<float> coords_;
+  std::vector<uint32_t> polygon_sizes_;
+  std::vector<uint32_t> rle_counts_;
+};
+
+uint64_t Fnv1a(const void* data, size_t size, uint64_t hash) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/*
+ * Identifies the annotation file version and the filtering options, so the
+ * cache is rebuilt when any of them change.
+ */
+uint64_t MakeStamp(const std::string& ann_file, const LoadOptions& options) {
+  struct stat st;
+  if (stat(ann_file.c_str(), &st) != 0)
+    throw std::runtime_error(ann_file + " file missed");
+  uint64_t hash = 14695981039346656037ull;
+  int64_t size = st.st_size;
+  int64_t mtime = st.st_mtime;
+  hash = Fnv1a(&cache_version, sizeof(cache_version), hash);
+  hash = Fnv1a(&size, sizeof(size), hash);
+  hash = Fnv1a(&mtime, sizeof(mtime), hash);
+  for (const auto& name : options.classes) {
+    hash = Fnv1a(name.data(), name.size() + 1, hash);  // including '\0'
+  }
+  hash = Fnv1a(options.keep_classes.data(),
+               options.keep_classes.size() * sizeof(uint32_t), hash);
+  hash = Fnv1a(&options.keep_aspect, sizeof(options.keep_aspect), hash);
+  hash = Fnv1a(&options.skip_crowd, sizeof(options.skip_crowd), hash);
+  return hash;
+}
+
+template <typename T>
+void WriteArray(std::ofstream& file, const std::vector<T>& v) {
+  uint64_t size = v.size();
+  file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  file.write(reinterpret_cast<const char*>(v.data()),
+             static_cast<std::streamsize>(v.size() * sizeof(T)));
+}
+
+template <typename T>
+bool ReadArray(std::ifstream& file, std::vector<T>& v) {
+  uint64_t size = 0;
+  if (!file.read(reinterpret_cast<char*>(&size), sizeof(size)))
+    return false;
+  v.resize(size);
+  return static_cast<bool>(
+      file.read(reinterpret_cast<char*>(v.data()),
+                static_cast<std::streamsize>(size * sizeof(T))));
+}
+
+uint32_t AddName(std::vector<char>& names, const char* name, size_t length) {
+  auto offset = static_cast<uint32_t>(names.size());
+  names.insert(names.end(), name, name + length);
+  return offset;
+}
+}  // namespace
+
+Index Index::Load(const std::string& ann_file,
+                  const LoadOptions& options,
+                  const std::string& cache_file) {
+  Index index;
+  uint64_t stamp = 0;
+  if (!cache_file.empty()) {
+    stamp = MakeStamp(ann_file, options);
+    if (index.LoadCache(cache_file, stamp))
+      return index;
+  }
+  index.Parse(ann_file, options);
+  if (!cache_file.empty()) {
+    try {
+      index.SaveCache(cache_file, stamp);
+    } catch (const std::exception& err) {
+      std::cerr << "Failed to save annotations cache : " << err.what()
+                << std::endl;
+    }
+  }
+  return index;
+}
+
+void Index::Parse(const std::string& ann_file, const LoadOptions& options) {
+  *this = Index();
+  options_ = options;
+  auto* file = std::fopen(ann_file.c_str(), "r");
+  if (file) {
+    const uint32_t n_reserve = 100000;
+    images_.reserve(n_reserve);
+    image_slots_.reserve(n_reserve);
+    annotations_.reserve(n_reserve);
+    {  // force memory cleaning
+      std::vector<char> read_buffer(1 << 20);
+      rapidjson::FileReadStream is(file, read_buffer.data(),
+                                   read_buffer.size());
+      rapidjson::Reader reader;
+      IndexHandler handler(this);
+      auto res = reader.Parse(is, handler);
+      std::fclose(file);
+      if (!res) {
+        throw std::runtime_error(rapidjson::GetParseError_En(res.Code()));
+      }
+    }
+    Finalize();
+  } else {
+    throw std::runtime_error(ann_file + " file can't be opened");
+  }
+}
+
+bool Index::LoadCache(const std::string& cache_file, uint64_t stamp) {
+  std::ifstream file(cache_file, std::ios::binary);
+  if (!file)
+    return false;
+  char magic[sizeof(cache_magic)];
+  uint32_t version = 0;
+  uint64_t file_stamp = 0;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  file.read(reinterpret_cast<char*>(&file_stamp), sizeof(file_stamp));
+  if (!file || std::memcmp(magic, cache_magic, sizeof(magic)) != 0 ||
+      version != cache_version || file_stamp != stamp)
+    return false;
+
+  Index index;
+  if (ReadArray(file, index.categories_) && ReadArray(file, index.images_) &&
+      ReadArray(file, index.annotations_) &&
+      ReadArray(file, index.polygons_) && ReadArray(file, index.coords_) &&
+      ReadArray(file, index.rle_counts_) && ReadArray(file, index.names_)) {
+    *this = std::move(index);
+    return true;
+  }
+  return false;
+}
+
+void Index::SaveCache(const std::string& cache_file, uint64_t stamp) const {
+  // write to the temporary file first, so readers never see partial cache
+  auto tmp_file = cache_file + ".tmp";
+  {
+    std::ofstream file(tmp_file, std::ios::binary | std::ios::trunc);
+    if (!file)
+      throw std::runtime_error(tmp_file + " file can't be opened");
+    file.write(cache_magic, sizeof(cache_magic));
+    file.write(reinterpret_cast<const char*>(&cache_version),
+               sizeof(cache_version));
+    file.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+    WriteArray(file, categories_);
+    WriteArray(file, images_);
+    WriteArray(file, annotations_);
+    WriteArray(file, polygons_);
+    WriteArray(file, coords_);
+    WriteArray(file, rle_counts_);
+    WriteArray(file, names_);
+    if (!file)
+      throw std::runtime_error(tmp_file + " file can't be written");
+  }
+  if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0)
+    throw std::runtime_error(cache_file + " file can't be written");
+}
+
+size_t Index::GetImagesCount() const {
+  return images_.size();
+}
+
+const Image& Index::GetImage(size_t index) const {
+  if (index < images_.size()) {
+    return images_[index];
+  } else {
+    throw std::out_of_range("Image index is out of bounds");
+  }
+}
+
+std::string Index::GetImageName(const Image& image) const {
+  return std::string(names_.data() + image.name_offset, image.name_length);
+}
+
+size_t Index::FindImage(uint32_t id) const {
+  auto i = std::lower_bound(
+      images_.begin(), images_.end(), id,
+      [](const Image& image, uint32_t id) { return image.id < id; });
+  if (i != images_.end() && i->id == id)
+    return static_cast<size_t>(std::distance(images_.begin(), i));
+  return images_.size();
+}
+
+const std::vector<Category>& Index::GetCategories() const {
+  return categories_;
+}
+
+std::string Index::GetCategoryName(const Category& category) const {
+  return std::string(names_.data() + category.name_offset,
+                     category.name_length);
+}
+
+const Category* Index::FindCategory(uint32_t id) const {
+  auto i = std::lower_bound(
+      categories_.begin(), categories_.end(), id,
+      [](const Category& category, uint32_t id) { return category.id < id; });
+  if (i != categories_.end() && i->id == id)
+    return &(*i);
+  return nullptr;
+}
+
+Range<Annotation> Index::GetAnnotations(const Image& image) const {
+  auto first = annotations_.data() + image.first_annotation;
+  return {first, first + image.annotations_count};
+}
+
+Range<Span> Index::GetPolygons(const Annotation& annotation) const {
+  if (annotation.segmentation_type != SegmentationType::Polygon)
+    return {};
+  auto first = polygons_.data() + annotation.segmentation.offset;
+  return {first, first + annotation.segmentation.size};
+}
+
+Range<float> Index::GetPolygonCoords(const Span& polygon) const {
+  auto first = coords_.data() + polygon.offset;
+  return {first, first + polygon.size};
+}
+
+Range<uint32_t> Index::GetRLECounts(const Annotation& annotation) const {
+  if (annotation.segmentation_type != SegmentationType::RLE)
+    return {};
+  auto first = rle_counts_.data() + annotation.segmentation.offset;
+  return {first, first + annotation.segmentation.size};
+}
+
+void Index::AddCategory(uint32_t id, const std::string& name) {
+  Category category;
+  category.id = id;
+  category.class_index = ClassIndex(id, name);
+  category.name_offset = AddName(names_, name.data(), name.size());
+  category.name_length = static_cast<uint32_t>(name.size());
+  categories_.push_back(category);
+}
+
+void Index::AddImage(const Image& image, const std::string& name) {
+  // images without size can't be scaled, their annotations are dropped too
+  if (image.width == 0 || image.height == 0)
+    return;
+  // filter - leave images with required aspect ration only
+  if (options_.keep_aspect > 0) {
+    auto aspect =
+        static_cast<float>(image.width) / static_cast<float>(image.height);
+    if (std::abs(aspect - options_.keep_aspect) > 0.001f)
+      return;
+  }
+  image_slots_.emplace(image.id, static_cast<uint32_t>(images_.size()));
+  images_.push_back(image);
+  images_.back().name_offset = AddName(names_, name.data(), name.size());
+  images_.back().name_length = static_cast<uint32_t>(name.size());
+}
+
+void Index::AddAnnotation(Annotation annotation,
+                          const std::vector<float>& coords,
+                          const std::vector<uint32_t>& polygon_sizes,
+                          const std::vector<uint32_t>& rle_counts) {
+  if (annotation.bbox.height <= 0 || annotation.bbox.width <= 0 ||
+      annotation.bbox.x < 0 || annotation.bbox.y < 0)
+    return;
+  if (options_.skip_crowd && annotation.iscrowd)
+    return;
+  // filter as early as possible, else wait for Finalize
+  if (images_done_ &&
+      image_slots_.find(annotation.image_id) == image_slots_.end())
+    return;
+  if (categories_done_) {
+    auto* category = FindCategory(annotation.category_id);
+    if (!category || !KeepClass(category->class_index))
+      return;
+    annotation.class_index = category->class_index;
+  }
+
+  if (annotation.segmentation_type == SegmentationType::Polygon) {
+    annotation.segmentation.offset = static_cast<uint32_t>(polygons_.size());
+    annotation.segmentation.size = static_cast<uint32_t>(polygon_sizes.size());
+    auto offset = static_cast<uint32_t>(coords_.size());
+    for (auto size : polygon_sizes) {
+      polygons_.push_back({offset, size});
+      offset += size;
+    }
+    coords_.insert(coords_.end(), coords.begin(), coords.end());
+  } else if (annotation.segmentation_type == SegmentationType::RLE) {
+    annotation.segmentation.offset = static_cast<uint32_t>(rle_counts_.size());
+    annotation.segmentation.size = static_cast<uint32_t>(rle_counts.size());
+    rle_counts_.insert(rle_counts_.end(), rle_counts.begin(), rle_counts.end());
+  }
+  annotations_.push_back(annotation);
+}
+
+void Index::SetImagesDone() {
+  images_done_ = true;
+}
+
+void Index::SetCategoriesDone() {
+  std::sort(categories_.begin(), categories_.end(),
+            [](const Category& a, const Category& b) { return a.id < b.id; });
+  categories_done_ = true;
+}
+
+bool Index::KeepClass(uint32_t class_index) const {
+  return options_.keep_classes.empty() ||
+         std::find(options_.keep_classes.begin(), options_.keep_classes.end(),
+                   class_index) != options_.keep_classes.end();
+}
+
+uint32_t Index::ClassIndex(uint32_t category_id,
+                           const std::string& name) const {
+  if (options_.classes.empty())
+    return category_id;
+  auto i = std::find(options_.classes.begin(), options_.classes.end(), name);
+  return static_cast<uint32_t>(std::distance(options_.classes.begin(), i));
+}
+
+/*
+ * Applies filters which could not be applied during parsing (if sections come
+ * in unusual order), removes images without annotations and groups
+ * annotations by images, so every image refers to a contiguous range.
+ */
+void Index::Finalize() {
+  SetCategoriesDone();
+
+  std::vector<uint32_t> slots(annotations_.size(), invalid_slot);
+  std::vector<uint32_t> counts(images_.size(), 0);
+  for (size_t i = 0; i < annotations_.size(); ++i) {
+    auto& annotation = annotations_[i];
+    auto* category = FindCategory(annotation.category_id);
+    if (!category || !KeepClass(category->class_index))
+      continue;
+    annotation.class_index = category->class_index;
+    auto slot = image_slots_.find(annotation.image_id);
+    if (slot == image_slots_.end())
+      continue;
+    slots[i] = slot->second;
+    ++counts[slot->second];
+  }
+
+  // remove images without annotations, keep images sorted by id for lookup
+  std::vector<uint32_t> order;
+  order.reserve(images_.size());
+  for (uint32_t slot = 0; slot < images_.size(); ++slot) {
+    if (counts[slot] > 0)
+      order.push_back(slot);
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return images_[a].id < images_[b].id;
+  });
+
+  std::vector<char> names;
+  for (auto& category : categories_) {
+    category.name_offset =
+        AddName(names, names_.data() + category.name_offset,
+                category.name_length);
+  }
+
+  std::vector<Image> images;
+  images.reserve(order.size());
+  std::vector<uint32_t> positions(images_.size(), 0);
+  uint32_t total = 0;
+  for (auto slot : order) {
+    Image image = images_[slot];
+    image.first_annotation = total;
+    image.annotations_count = counts[slot];
+    image.name_offset =
+        AddName(names, names_.data() + image.name_offset, image.name_length);
+    positions[slot] = total;
+    total += counts[slot];
+    images.push_back(image);
+  }
+
+  std::vector<Annotation> annotations(total);
+  for (size_t i = 0; i < annotations_.size(); ++i) {
+    if (slots[i] != invalid_slot)
+      annotations[positions[slots[i]]++] = annotations_[i];
+  }
+
+  // compact segmentation data in the final annotations order
+  std::vector<Span> polygons;
+  std::vector<float> coords;
+  std::vector<uint32_t> rle_counts;
+  for (auto& annotation : annotations) {
+    if (annotation.segmentation_type == SegmentationType::Polygon) {
+      auto first = polygons_.begin() + annotation.segmentation.offset;
+      annotation.segmentation.offset = static_cast<uint32_t>(polygons.size());
+      for (auto p = first; p != first + annotation.segmentation.size; ++p) {
+        polygons.push_back({static_cast<uint32_t>(coords.size()), p->size});
+        coords.insert(coords.end(), coords_.begin() + p->offset,
+                      coords_.begin() + p->offset + p->size);
+      }
+    } else if (annotation.segmentation_type == SegmentationType::RLE) {
+      auto first = rle_counts_.begin() + annotation.segmentation.offset;
+      annotation.segmentation.offset =
+          static_cast<uint32_t>(rle_counts.size());
+      rle_counts.insert(rle_counts.end(), first,
+                        first + annotation.segmentation.size);
+    }
+  }
+
+  images_ = std::move(images);
+  annotations_ = std::move(annotations);
+  polygons_ = std::move(polygons);
+  coords_ = std::move(coords);
+  rle_counts_ = std::move(rle_counts);
+  names_ = std::move(names);
+  image_slots_.clear();
+}
+
+}  // namespace coco
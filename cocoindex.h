@@ -0,0 +1,149 @@
+#ifndef COCOINDEX_H
+#define COCOINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace coco {
+
+/*
+ * Compact in-memory index of a COCO annotation file shared by the detection
+ * samples. All records are POD and stored in flat arrays, so the whole index
+ * can be dumped to (and restored from) a binary cache file with a few reads.
+ */
+
+struct Category {
+  uint32_t id{0};
+  uint32_t class_index{0};  // position of the name in LoadOptions::classes
+  uint32_t name_offset{0};  // into the names pool
+  uint32_t name_length{0};
+};
+
+struct Image {
+  uint32_t id{0};
+  uint32_t width{0};
+  uint32_t height{0};
+  uint32_t name_offset{0};  // into the names pool
+  uint32_t name_length{0};
+  uint32_t first_annotation{0};
+  uint32_t annotations_count{0};
+};
+
+struct BBox {
+  float x{0};
+  float y{0};
+  float width{0};
+  float height{0};
+};
+
+enum class SegmentationType : uint32_t { None = 0, Polygon = 1, RLE = 2 };
+
+struct Span {
+  uint32_t offset{0};
+  uint32_t size{0};
+};
+
+struct Annotation {
+  uint64_t id{0};
+  uint32_t image_id{0};
+  uint32_t category_id{0};
+  uint32_t class_index{0};
+  BBox bbox;  // x,y,w,h
+  // Polygon - range of polygons, RLE - range of run lengths
+  Span segmentation;
+  SegmentationType segmentation_type{SegmentationType::None};
+  uint32_t rle_height{0};
+  uint32_t rle_width{0};
+  uint32_t iscrowd{0};
+};
+
+template <typename T>
+struct Range {
+  const T* first{nullptr};
+  const T* last{nullptr};
+  const T* begin() const { return first; }
+  const T* end() const { return last; }
+  size_t size() const { return static_cast<size_t>(last - first); }
+  bool empty() const { return first == last; }
+  const T& operator[](size_t i) const { return first[i]; }
+};
+
+struct LoadOptions {
+  // Category names, index of a name in this list becomes the class index.
+  // If empty the COCO category id is used as the class index.
+  std::vector<std::string> classes;
+  // Leave only annotations of these classes (and images which have them)
+  std::vector<uint32_t> keep_classes;
+  // Leave only images with such width / height ratio
+  float keep_aspect{-1};
+  // Skip annotations marked with `iscrowd`
+  bool skip_crowd{false};
+};
+
+class Index {
+ public:
+  /*
+   * Loads the index for `ann_file` with a single streaming parse, filters are
+   * applied during parsing. If `cache_file` is not empty, the binary form is
+   * used when it matches the annotation file and options, otherwise it is
+   * rewritten after parsing.
+   */
+  static Index Load(const std::string& ann_file,
+                    const LoadOptions& options,
+                    const std::string& cache_file = "");
+
+  void Parse(const std::string& ann_file, const LoadOptions& options);
+  bool LoadCache(const std::string& cache_file, uint64_t stamp);
+  void SaveCache(const std::string& cache_file, uint64_t stamp) const;
+
+  size_t GetImagesCount() const;
+  const Image& GetImage(size_t index) const;
+  std::string GetImageName(const Image& image) const;
+  // returns images_.size() if there is no image with such id
+  size_t FindImage(uint32_t id) const;
+
+  const std::vector<Category>& GetCategories() const;
+  std::string GetCategoryName(const Category& category) const;
+  // returns nullptr if there is no category with such id
+  const Category* FindCategory(uint32_t id) const;
+
+  Range<Annotation> GetAnnotations(const Image& image) const;
+  Range<Span> GetPolygons(const Annotation& annotation) const;
+  Range<float> GetPolygonCoords(const Span& polygon) const;
+  Range<uint32_t> GetRLECounts(const Annotation& annotation) const;
+
+  // Parser interface
+  void AddCategory(uint32_t id, const std::string& name);
+  void AddImage(const Image& image, const std::string& name);
+  void AddAnnotation(Annotation annotation,
+                     const std::vector<float>& coords,
+                     const std::vector<uint32_t>& polygon_sizes,
+                     const std::vector<uint32_t>& rle_counts);
+  void SetImagesDone();
+  void SetCategoriesDone();
+
+ private:
+  bool KeepClass(uint32_t class_index) const;
+  uint32_t ClassIndex(uint32_t category_id, const std::string& name) const;
+  void Finalize();
+
+ private:
+  LoadOptions options_;
+  bool images_done_{false};
+  bool categories_done_{false};
+  std::unordered_map<uint32_t, uint32_t> image_slots_;  // used while parsing
+
+  std::vector<Category> categories_;
+  std::vector<Image> images_;
+  std::vector<Annotation> annotations_;
+  std::vector<Span> polygons_;
+  std::vector<float> coords_;
+  std::vector<uint32_t> rle_counts_;
+  std::vector<char> names_;
+};
+
+}  // namespace coco
+
+#endif  // COCOINDEX_H
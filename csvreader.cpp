@@ -0,0 +1,379 @@
+#include "csvreader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace csv {
+
+namespace {
+
+size_t GetThreadsCount() {
+#ifdef _OPENMP
+  return static_cast<size_t>(omp_get_max_threads());
+#else
+  return 1;
+#endif
+}
+
+// Returns end of the line started at `pos` (position of '\n' or `end`)
+const char* LineEnd(const char* pos, const char* end) {
+  auto eol = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+  return eol != nullptr ? eol : end;
+}
+
+// Line without trailing '\r', returns false for empty lines
+bool TrimLine(const char* line, const char*& line_end) {
+  while (line_end != line && (line_end[-1] == '\r' || line_end[-1] == ' '))
+    --line_end;
+  return line_end != line;
+}
+
+void TrimField(const char*& first, const char*& last) {
+  while (first != last && (*first == ' ' || *first == '\t'))
+    ++first;
+  while (last != first && (last[-1] == ' ' || last[-1] == '\t'))
+    --last;
+}
+
+size_t CountLines(const char* first, const char* last) {
+  size_t count = 0;
+  while (first < last) {
+    const char* eol = LineEnd(first, last);
+    const char* line_end = eol;
+    if (TrimLine(first, line_end))
+      ++count;
+    first = eol + 1;
+  }
+  return count;
+}
+
+// Moves `pos` to the beginning of the next line
+size_t AlignToLine(const char* data, size_t pos, size_t size) {
+  if (pos == 0 || pos >= size)
+    return std::min(pos, size);
+  if (data[pos - 1] == '\n')
+    return pos;
+  return static_cast<size_t>(LineEnd(data + pos, data + size) - data) + 1;
+}
+
+// Splits [begin, end) to `parts` line aligned ranges, returns their bounds
+std::vector<size_t> SplitRange(const char* data,
+                               size_t begin,
+                               size_t end,
+                               size_t parts) {
+  std::vector<size_t> bounds(parts + 1, end);
+  bounds[0] = begin;
+  size_t step = (end - begin) / parts;
+  for (size_t i = 1; i < parts; ++i) {
+    bounds[i] = std::max(bounds[i - 1],
+                         std::min(AlignToLine(data, begin + i * step, end), end));
+  }
+  return bounds;
+}
+
+template <typename T>
+T ParseNumber(const char* first, const char* last, size_t offset) {
+  // strtod requires zero terminated strings and mapped data has no
+  // terminator at the end of the file, so a field is copied to stack buffer
+  char buf[64];
+  TrimField(first, last);
+  size_t length = static_cast<size_t>(last - first);
+  if (length == 0 || length >= sizeof(buf))
+    throw std::runtime_error("Wrong numeric field at byte offset " +
+                             std::to_string(offset));
+  std::memcpy(buf, first, length);
+  buf[length] = 0;
+  char* parsed_end = nullptr;
+  double value = std::strtod(buf, &parsed_end);
+  if (parsed_end != buf + length)
+    throw std::runtime_error("Wrong numeric field at byte offset " +
+                             std::to_string(offset));
+  return static_cast<T>(value);
+}
+
+}  // namespace
+
+uint32_t LabelDictionary::GetId(const char* name, size_t length) {
+  std::string key(name, length);
+  auto i = ids_.find(key);
+  if (i != ids_.end())
+    return i->second;
+  auto id = static_cast<uint32_t>(names_.size());
+  ids_.emplace(key, id);
+  names_.push_back(std::move(key));
+  return id;
+}
+
+const std::string& LabelDictionary::GetName(uint32_t id) const {
+  return names_.at(id);
+}
+
+size_t LabelDictionary::size() const {
+  return names_.size();
+}
+
+Reader::Reader(const std::string& file_name, const ReadOptions& options)
+    : options_(options) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Can't open file " + file_name);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Can't get size of file " + file_name);
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Can't map file " + file_name);
+    }
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(data);
+  }
+  close(fd);
+
+  // ----------- Columns are defined by the first line
+  const char* end = data_ + size_;
+  const char* line = data_;
+  const char* eol = line;
+  const char* line_end = line;
+  while (line < end) {
+    eol = LineEnd(line, end);
+    line_end = eol;
+    if (TrimLine(line, line_end))
+      break;
+    line = eol + 1;
+  }
+  if (line >= end) {
+    data_begin_ = size_;
+    return;
+  }
+  columns_count_ =
+      static_cast<size_t>(std::count(line, line_end, options_.delimiter)) + 1;
+  if (options_.has_labels && columns_count_ < 2)
+    throw std::runtime_error("CSV file " + file_name +
+                             " should have at least two columns");
+  if (options_.has_header) {
+    const char* field = line;
+    while (field <= line_end) {
+      auto field_end = static_cast<const char*>(
+          std::memchr(field, options_.delimiter, line_end - field));
+      if (field_end == nullptr)
+        field_end = line_end;
+      const char* first = field;
+      const char* last = field_end;
+      TrimField(first, last);
+      if (last - first >= 2 && *first == '"' && last[-1] == '"') {
+        ++first;
+        --last;
+      }
+      header_.emplace_back(first, last);
+      field = field_end + 1;
+    }
+    data_begin_ = std::min(static_cast<size_t>(eol - data_) + 1, size_);
+  } else {
+    data_begin_ = static_cast<size_t>(line - data_);
+  }
+
+  if (!options_.has_labels) {
+    label_column_ = columns_count_;  // no column is matched as label
+    return;
+  }
+  auto columns = static_cast<int>(columns_count_);
+  int label_column = options_.label_column < 0
+                         ? columns + options_.label_column
+                         : options_.label_column;
+  if (label_column < 0 || label_column >= columns)
+    throw std::runtime_error("Wrong label column index for file " +
+                             file_name);
+  label_column_ = static_cast<size_t>(label_column);
+}
+
+Reader::~Reader() {
+  if (data_ != nullptr)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+size_t Reader::GetRowsCount() {
+  if (!rows_counted_) {
+    auto threads = GetThreadsCount();
+    auto bounds = SplitRange(data_, data_begin_, size_, threads);
+    size_t count = 0;
+#pragma omp parallel for reduction(+ : count)
+    for (size_t t = 0; t < threads; ++t) {
+      count += CountLines(data_ + bounds[t], data_ + bounds[t + 1]);
+    }
+    rows_count_ = count;
+    rows_counted_ = true;
+  }
+  return rows_count_;
+}
+
+size_t Reader::GetFeaturesCount() const {
+  if (!options_.has_labels)
+    return columns_count_;
+  return columns_count_ > 0 ? columns_count_ - 1 : 0;
+}
+
+const std::vector<std::string>& Reader::GetHeader() const {
+  return header_;
+}
+
+const LabelDictionary& Reader::GetLabels() const {
+  return labels_;
+}
+
+size_t Reader::NextChunkEnd(size_t begin) const {
+  size_t end = AlignToLine(data_, begin + options_.chunk_size, size_);
+  return std::max(end, std::min(begin + 1, size_));
+}
+
+void Reader::ReleaseChunk(size_t begin, size_t end) const {
+  // Drop parsed pages from the process, they are only kept in page cache
+  auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t first = (begin + page - 1) / page * page;
+  size_t last = end / page * page;
+  if (last > first)
+    madvise(const_cast<char*>(data_) + first, last - first, MADV_DONTNEED);
+}
+
+template <typename T>
+size_t Reader::ParseChunk(size_t begin,
+                          size_t end,
+                          T* features,
+                          size_t row_stride,
+                          uint32_t* labels) {
+  auto threads = GetThreadsCount();
+  auto bounds = SplitRange(data_, begin, end, threads);
+
+  // ----------- Find where the rows of every part are placed
+  std::vector<size_t> offsets(threads + 1, 0);
+#pragma omp parallel for
+  for (size_t t = 0; t < threads; ++t) {
+    offsets[t + 1] = CountLines(data_ + bounds[t], data_ + bounds[t + 1]);
+  }
+  for (size_t t = 0; t < threads; ++t)
+    offsets[t + 1] += offsets[t];
+
+  // ----------- Parse parts in parallel, labels get per part ids
+  std::vector<std::vector<std::pair<const char*, size_t>>> local_labels(
+      threads);
+  std::vector<std::exception_ptr> errors(threads);
+#pragma omp parallel for
+  for (size_t t = 0; t < threads; ++t) {
+    try {
+      auto& names = local_labels[t];
+      const char* line = data_ + bounds[t];
+      const char* part_end = data_ + bounds[t + 1];
+      size_t row = offsets[t];
+      while (line < part_end) {
+        const char* eol = LineEnd(line, part_end);
+        const char* line_end = eol;
+        if (TrimLine(line, line_end)) {
+          T* row_features = features + row * row_stride;
+          const char* field = line;
+          size_t column = 0;
+          for (; field <= line_end && column < columns_count_; ++column) {
+            auto field_end = static_cast<const char*>(
+                std::memchr(field, options_.delimiter, line_end - field));
+            if (field_end == nullptr)
+              field_end = line_end;
+            if (column == label_column_) {
+              const char* first = field;
+              const char* last = field_end;
+              TrimField(first, last);
+              auto length = static_cast<size_t>(last - first);
+              uint32_t id = 0;
+              // labels set is small, linear search is faster than hashing
+              while (id < names.size() &&
+                     (names[id].second != length ||
+                      std::memcmp(names[id].first, first, length) != 0))
+                ++id;
+              if (id == names.size())
+                names.emplace_back(first, length);
+              labels[row] = id;
+            } else {
+              *row_features++ = ParseNumber<T>(
+                  field, field_end, static_cast<size_t>(field - data_));
+            }
+            field = field_end + 1;
+          }
+          if (column != columns_count_ || field <= line_end)
+            throw std::runtime_error(
+                "Wrong number of columns at byte offset " +
+                std::to_string(static_cast<size_t>(line - data_)));
+          ++row;
+        }
+        line = eol + 1;
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  }
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // ----------- Map per part ids to the global ones, parts are in file order
+  // so ids are assigned in order of first appearance
+  if (!options_.has_labels)
+    return offsets[threads];
+  std::vector<uint32_t> ids;
+  for (size_t t = 0; t < threads; ++t) {
+    ids.clear();
+    for (auto& name : local_labels[t])
+      ids.push_back(labels_.GetId(name.first, name.second));
+    for (size_t row = offsets[t]; row < offsets[t + 1]; ++row)
+      labels[row] = ids[labels[row]];
+  }
+  return offsets[threads];
+}
+
+template <typename T>
+size_t Reader::Read(T* features, size_t row_stride, uint32_t* labels) {
+  if (row_stride < GetFeaturesCount())
+    throw std::runtime_error("CSV row stride is less than features count");
+  auto rows_count = GetRowsCount();
+  size_t rows = 0;
+  size_t begin = data_begin_;
+  while (begin < size_) {
+    size_t end = NextChunkEnd(begin);
+    rows += ParseChunk(begin, end, features + rows * row_stride, row_stride,
+                       options_.has_labels ? labels + rows : nullptr);
+    ReleaseChunk(begin, end);
+    begin = end;
+  }
+  if (rows != rows_count)
+    throw std::runtime_error("CSV file was changed during reading");
+  return rows;
+}
+
+template size_t Reader::ParseChunk<float>(size_t,
+                                          size_t,
+                                          float*,
+                                          size_t,
+                                          uint32_t*);
+template size_t Reader::ParseChunk<double>(size_t,
+                                           size_t,
+                                           double*,
+                                           size_t,
+                                           uint32_t*);
+template size_t Reader::Read<float>(float*, size_t, uint32_t*);
+template size_t Reader::Read<double>(double*, size_t, uint32_t*);
+
+}  // namespace csv
@@ -0,0 +1,150 @@
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace csv {
+
+struct ReadOptions {
+  char delimiter{','};
+  bool has_header{true};
+  // Column with categorical labels, negative values are counted from the end
+  int label_column{-1};
+  // Files without labels have only feature columns, `labels` buffers passed
+  // to the reader are not used and can be null
+  bool has_labels{true};
+  // Size of the file window parsed at once, it is aligned to lines
+  size_t chunk_size{64 << 20};
+};
+
+/*
+ * Maps label strings to consecutive ids in order of first appearance.
+ */
+class LabelDictionary {
+ public:
+  uint32_t GetId(const char* name, size_t length);
+  const std::string& GetName(uint32_t id) const;
+  size_t size() const;
+
+ private:
+  std::unordered_map<std::string, uint32_t> ids_;
+  std::vector<std::string> names_;
+};
+
+/*
+ * Memory mapped CSV reader with numeric feature columns and one categorical
+ * label column. The file is processed in line aligned chunks, lines of every
+ * chunk are split between OpenMP threads and parsed straight into the caller
+ * buffers, so there are no per line or per field strings. Quoted fields are
+ * not supported.
+ */
+class Reader {
+ public:
+  explicit Reader(const std::string& file_name,
+                  const ReadOptions& options = ReadOptions());
+  ~Reader();
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  // Number of non empty data lines, header excluded
+  size_t GetRowsCount();
+  // Number of feature columns (all columns except the label one)
+  size_t GetFeaturesCount() const;
+  const std::vector<std::string>& GetHeader() const;
+  const LabelDictionary& GetLabels() const;
+
+  /*
+   * Parses the whole file, `features` should have GetRowsCount() rows with
+   * `row_stride` elements each (row major), `labels` GetRowsCount() elements.
+   * Returns number of parsed rows.
+   */
+  template <typename T>
+  size_t Read(T* features, size_t row_stride, uint32_t* labels);
+
+  /*
+   * Parses the file chunk by chunk and calls
+   * sink(const T* features, const uint32_t* labels, size_t rows) for every
+   * chunk in the file order, buffers are reused between calls.
+   */
+  template <typename T, typename Sink>
+  void ForEachChunk(Sink&& sink);
+
+  /*
+   * Parses the next chunk after `*offset` (zero is the file beginning) to the
+   * buffers, which grow when needed, and moves `*offset` past it. Returns
+   * number of parsed rows, zero means the end of the file. Chunks can be read
+   * from different threads, but not concurrently.
+   */
+  template <typename T>
+  size_t ReadChunk(size_t* offset,
+                   std::vector<T>* features,
+                   std::vector<uint32_t>* labels);
+
+ private:
+  template <typename T>
+  size_t ParseChunk(size_t begin,
+                    size_t end,
+                    T* features,
+                    size_t row_stride,
+                    uint32_t* labels);
+  size_t NextChunkEnd(size_t begin) const;
+  void ReleaseChunk(size_t begin, size_t end) const;
+
+ private:
+  ReadOptions options_;
+  const char* data_{nullptr};
+  size_t size_{0};
+  size_t data_begin_{0};  // first byte after the header
+  size_t columns_count_{0};
+  size_t label_column_{0};
+  size_t rows_count_{0};
+  bool rows_counted_{false};
+  std::vector<std::string> header_;
+  LabelDictionary labels_;
+};
+
+template <typename T, typename Sink>
+void Reader::ForEachChunk(Sink&& sink) {
+  std::vector<T> features;
+  std::vector<uint32_t> labels;
+  size_t offset = 0;
+  while (size_t rows = ReadChunk(&offset, &features, &labels)) {
+    sink(static_cast<const T*>(features.data()),
+         static_cast<const uint32_t*>(labels.data()), rows);
+  }
+}
+
+template <typename T>
+size_t Reader::ReadChunk(size_t* offset,
+                         std::vector<T>* features,
+                         std::vector<uint32_t>* labels) {
+  const size_t row_stride = GetFeaturesCount();
+  size_t begin = std::max(*offset, data_begin_);
+  size_t rows = 0;
+  // chunks of empty lines are skipped
+  while (rows == 0 && begin < size_) {
+    size_t end = NextChunkEnd(begin);
+    // the chunk has no more lines than bytes / 2
+    size_t max_rows = (end - begin) / 2 + 1;
+    if (features->size() < max_rows * row_stride)
+      features->resize(max_rows * row_stride);
+    // sized separately, callers may pass buffers of different lengths
+    if (options_.has_labels && labels->size() < max_rows)
+      labels->resize(max_rows);
+    rows = ParseChunk(begin, end, features->data(), row_stride,
+                      options_.has_labels ? labels->data() : nullptr);
+    ReleaseChunk(begin, end);
+    begin = end;
+  }
+  *offset = begin;
+  return rows;
+}
+
+}  // namespace csv
+
+#endif  // CSVREADER_H
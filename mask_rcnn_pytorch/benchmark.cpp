@@ -0,0 +1,273 @@
+#include "config.h"
+#include "imageutils.h"
+#include "inferenceserver.h"
+#include "maskrcnn.h"
+#include "nnutils.h"
+#include "stateloader.h"
+
+#include <torch/torch.h>
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+
+class BenchmarkConfig : public Config {
+ public:
+  BenchmarkConfig(bool use_gpu, int32_t image_size) {
+    gpu_count = use_gpu ? 1 : 0;
+    images_per_gpu = 1;
+    num_classes = 81;
+    image_min_dim = image_size;
+    image_max_dim = image_size;
+    // random weights give low scores, keep detections to run the mask head
+    detection_min_confidence = 0;
+
+    UpdateSettings();
+  }
+};
+
+const cv::String keys =
+    "{help h usage ? |      | print this message   }"
+    "{params         |      | path to trained parameters, random if empty }"
+    "{gpu            |      | run on GPU }"
+    "{size           |512   | input image size, multiple of 64 }"
+    "{padding        |      | benchmark SamePad2d on FPN sized maps instead }"
+    "{server         |      | benchmark InferenceServer with concurrent clients }"
+    "{clients        |4     | number of server client threads }"
+    "{batch          |4     | server max batch size }"
+    "{delay          |5     | server max batch delay in milliseconds }"
+    "{iterations     |20    | number of timed runs, per client for server }";
+
+namespace {
+struct Latency {
+  double mean{0};
+  double p50{0};
+  double min{0};
+};
+
+template <typename Func>
+Latency Measure(Func&& func, uint32_t iterations) {
+  func();  // warm up
+  std::vector<double> times;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    // Detect copies results to the host, so GPU work is finished here, the
+    // padding benchmark runs on the CPU
+    func();
+    auto stop = std::chrono::steady_clock::now();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  Latency latency;
+  for (auto t : times)
+    latency.mean += t / times.size();
+  latency.p50 = times[times.size() / 2];
+  latency.min = times.front();
+  return latency;
+}
+
+void PrintLatency(const std::string& name, const Latency& latency) {
+  std::cout << name << ": mean " << latency.mean << " ms, p50 " << latency.p50
+            << " ms, min " << latency.min << " ms\n";
+}
+
+float MaxDifference(at::Tensor a, at::Tensor b) {
+  if (a.sizes() != b.sizes())
+    return std::numeric_limits<float>::infinity();
+  if (is_empty(a))
+    return 0;
+  return (a - b).abs().max().item<float>();
+}
+
+// SamePad2d implementation with zero tensors concatenation, kept to compare
+at::Tensor ConcatPadding(at::Tensor input) {
+  auto options = input.options();
+  auto top = at::zeros({input.size(0), input.size(1), input.size(2), 1},
+                       options);
+  auto bottom = at::zeros({input.size(0), input.size(1), input.size(2), 1},
+                          options);
+  input = at::cat({top, input, bottom}, 3);
+  auto left = at::zeros({input.size(0), input.size(1), 1, input.size(3)},
+                        options);
+  auto right = at::zeros({input.size(0), input.size(1), 1, input.size(3)},
+                         options);
+  return at::cat({left, input, right}, 2);
+}
+
+double Megabytes(at::IntList sizes) {
+  double elements = 1;
+  for (auto size : sizes)
+    elements *= size;
+  return elements * sizeof(float) / (1024. * 1024.);
+}
+
+/* Compares 3x3 stride 1 padding ways on [1, 256, 256, 256] map, the size of
+ * P2 for 1024 input. Written bytes are the sizes of the tensors the padding
+ * creates, every byte of them is also read by the convolution.
+ */
+void BenchmarkPadding(uint32_t iterations) {
+  auto x = torch::rand({1, 256, 256, 256});
+  SamePad2d padding(/*kernel_size*/ 3, /*stride*/ 1);
+  torch::nn::Conv2d conv(torch::nn::Conv2dOptions(256, 256, 3).stride(1));
+  torch::nn::Conv2d padded_conv(
+      torch::nn::Conv2dOptions(256, 256, 3).stride(1).padding(1));
+  padded_conv->weight.set_data(conv->weight.clone());
+  padded_conv->bias.set_data(conv->bias.clone());
+
+  auto n = x.size(0);
+  auto c = x.size(1);
+  auto h = x.size(2);
+  auto w = x.size(3);
+  auto concat_mb = Megabytes({n, c, h, w + 2}) +
+                   Megabytes({n, c, h + 2, w + 2}) +
+                   2 * Megabytes({n, c, h, 1}) +
+                   2 * Megabytes({n, c, 1, w + 2});
+  auto pad_mb = Megabytes({n, c, h + 2, w + 2});
+  std::cout << "padding writes: concat " << concat_mb << " MB, pad "
+            << pad_mb << " MB, conv padding 0 MB\n";
+
+  at::Tensor y;
+  PrintLatency("concat padding",
+               Measure([&]() { y = ConcatPadding(x); }, iterations));
+  PrintLatency("pad           ",
+               Measure([&]() { y = padding->forward(x); }, iterations));
+
+  at::Tensor expected, result;
+  PrintLatency("concat padding + conv",
+               Measure([&]() { expected = conv->forward(ConcatPadding(x)); },
+                       iterations));
+  PrintLatency("pad + conv           ",
+               Measure([&]() { result = conv->forward(padding->forward(x)); },
+                       iterations));
+  std::cout << "max pad difference " << MaxDifference(expected, result)
+            << "\n";
+  PrintLatency("conv padding         ",
+               Measure([&]() { result = padded_conv->forward(x); },
+                       iterations));
+  std::cout << "max conv padding difference "
+            << MaxDifference(expected, result) << "\n";
+}
+
+void PrintPercentiles(const std::string& name,
+                      const bench::Percentiles& percentiles) {
+  std::cout << name << ": p50 " << percentiles.p50 << " ms, p90 "
+            << percentiles.p90 << " ms, p99 " << percentiles.p99
+            << " ms, max " << percentiles.max << " ms\n";
+}
+
+/* Every client submits requests one after another, so the number of
+ * clients bounds the number of requests the server can batch.
+ */
+void BenchmarkServer(MaskRCNN model,
+                     std::shared_ptr<const Config> config,
+                     const cv::Mat& image,
+                     const InferenceServerOptions& options,
+                     uint32_t clients,
+                     uint32_t iterations) {
+  InferenceServer server(model, config, options);
+  server.Submit(image).get();  // warm up
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < clients; ++i) {
+    threads.emplace_back([&]() {
+      for (uint32_t j = 0; j < iterations; ++j)
+        server.Submit(image).get();
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  server.Stop();
+
+  auto stats = server.GetStats();
+  std::cout << "requests " << stats.requests << ", batches " << stats.batches
+            << ", mean batch size " << stats.mean_batch_size
+            << ", throughput " << stats.throughput << " images/s\n";
+  PrintPercentiles("latency   ", stats.latency);
+  PrintPercentiles("batch time", stats.batch_time);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("MaskRCNN inference benchmark");
+    if (parser.has("help")) {
+      parser.printMessage();
+      return 0;
+    }
+    auto params_path = parser.get<cv::String>("params");
+    bool use_gpu = parser.has("gpu");
+    auto image_size = parser.get<int32_t>("size");
+    auto iterations = parser.get<uint32_t>("iterations");
+    auto clients = parser.get<uint32_t>("clients");
+    InferenceServerOptions server_options;
+    server_options.max_batch_size = parser.get<uint32_t>("batch");
+    server_options.max_batch_delay =
+        std::chrono::milliseconds(parser.get<uint32_t>("delay"));
+    if (!parser.check()) {
+      parser.printErrors();
+      parser.printMessage();
+      return 1;
+    }
+    if (use_gpu && !torch::cuda::is_available())
+      throw std::runtime_error("Cuda is not available");
+
+    torch::NoGradGuard no_grad;
+    if (parser.has("padding")) {
+      BenchmarkPadding(iterations);
+      return 0;
+    }
+
+    auto config = std::make_shared<BenchmarkConfig>(use_gpu, image_size);
+
+    torch::manual_seed(0);
+    MaskRCNN model("", config);
+    if (!params_path.empty())
+      LoadStateDict(*model, params_path, "");
+    if (use_gpu)
+      model->to(torch::DeviceType::CUDA);
+
+    cv::Mat image(image_size, image_size, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    if (parser.has("server")) {
+      model->PrepareInference();
+      BenchmarkServer(model, config, image, server_options, clients,
+                      iterations);
+      return 0;
+    }
+
+    std::vector<cv::Mat> images{image};
+    auto [molded_images, image_metas, windows] = MoldInputs(images, *config);
+
+    at::Tensor detections, mrcnn_mask;
+    auto detect = [&]() {
+      std::tie(detections, mrcnn_mask) =
+          model->Detect(molded_images, image_metas);
+    };
+
+    auto original = Measure(detect, iterations);
+    auto original_detections = detections;
+    auto original_mask = mrcnn_mask;
+
+    model->PrepareInference();
+    auto fused = Measure(detect, iterations);
+
+    PrintLatency("original", original);
+    PrintLatency("fused   ", fused);
+    std::cout << "speedup " << original.mean / fused.mean << "\n";
+    std::cout << "max detections difference "
+              << MaxDifference(original_detections, detections) << "\n";
+    std::cout << "max masks difference "
+              << MaxDifference(original_mask, mrcnn_mask) << "\n";
+  } catch (const std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
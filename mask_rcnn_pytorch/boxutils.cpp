@@ -26,6 +26,20 @@ static at::Tensor ComputeIou(at::Tensor box,
   return iou;
 }
 
+torch::Tensor BBoxOverlaps(torch::Tensor boxes1, torch::Tensor boxes2) {
+  // [N, 1] columns of boxes1 broadcast with [1, M] rows of boxes2
+  auto b1 = boxes1.chunk(4, /*dim*/ 1);
+  auto b2 = boxes2.t().chunk(4, /*dim*/ 0);
+  auto y1 = torch::max(b1[0], b2[0]);
+  auto x1 = torch::max(b1[1], b2[1]);
+  auto y2 = torch::min(b1[2], b2[2]);
+  auto x2 = torch::min(b1[3], b2[3]);
+  auto intersection = (y2 - y1).clamp_min(0) * (x2 - x1).clamp_min(0);
+  auto area1 = (b1[2] - b1[0]) * (b1[3] - b1[1]);
+  auto area2 = (b2[2] - b2[0]) * (b2[3] - b2[1]);
+  return intersection / (area1 + area2 - intersection);
+}
+
 torch::Tensor BBoxOverlapsLoops(torch::Tensor boxes1, torch::Tensor boxes2) {
   // Areas of anchors and GT boxes
   auto area1 = (boxes1.narrow(1, 2, 1) - boxes1.narrow(1, 0, 1)) *
@@ -1,5 +1,6 @@
 #include "classifier.h"
 #include "debug.h"
+#include "nnutils.h"
 #include "roialign.h"
 
 ClassifierImpl::ClassifierImpl() {}
@@ -31,12 +32,17 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor> ClassifierImpl::forward(
     at::Tensor rois) {
   feature_maps.insert(feature_maps.begin(), rois);
   auto x = PyramidRoiAlign(feature_maps, pool_size_, image_shape_);
-  x = conv1_->forward(x);
-  x = bn1_->forward(x);
-  x = relu_->forward(x);
-  x = conv2_->forward(x);
-  x = bn2_->forward(x);
-  x = relu_->forward(x);
+  if (fused_) {
+    x = conv1_->forward(x).relu_();
+    x = conv2_->forward(x).relu_();
+  } else {
+    x = conv1_->forward(x);
+    x = bn1_->forward(x);
+    x = relu_->forward(x);
+    x = conv2_->forward(x);
+    x = bn2_->forward(x);
+    x = relu_->forward(x);
+  }
 
   x = x.view({-1, 1024});
   auto mrcnn_class_logits = linear_class_->forward(x);
@@ -47,3 +53,11 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor> ClassifierImpl::forward(
 
   return {mrcnn_class_logits, mrcnn_probs, mrcnn_bbox};
 }
+
+void ClassifierImpl::Fuse() {
+  if (fused_)
+    return;
+  FoldBatchNorm(*conv1_, *bn1_);
+  FoldBatchNorm(*conv2_, *bn2_);
+  fused_ = true;
+}
@@ -17,6 +17,9 @@ class ClassifierImpl : public torch::nn::Module {
       std::vector<torch::Tensor> feature_maps,
       torch::Tensor rois);
 
+  // Folds batch norms into convolutions, used for inference only
+  void Fuse();
+
  private:
   torch::nn::Conv2d conv1_{nullptr};
   torch::nn::BatchNorm bn1_{nullptr};
@@ -28,6 +31,7 @@ class ClassifierImpl : public torch::nn::Module {
 
   uint32_t pool_size_{0};
   std::vector<int32_t> image_shape_;
+  bool fused_{false};
 };
 
 TORCH_MODULE(Classifier);
@@ -131,8 +131,6 @@ Sample CocoDataset::get(size_t index) {
       ResizeImage(img_desc.image, config_->image_min_dim,
                   config_->image_max_dim, config_->image_padding);
 
-  auto masks = ResizeMasks(img_desc.masks, scale, padding);
-
   // Resize and format boxes -> [y1,x1,y2,x2]
   std::vector<float> boxes;
   boxes.reserve(img_desc.boxes.size() * 4);
@@ -167,10 +165,15 @@ Sample CocoDataset::get(size_t index) {
   //    exit(0);
   //  }
 
-  // Resize masks to smaller size to reduce memory usage
+  // Polygon masks are rendered at the final scale, mini masks reduce
+  // memory usage
+  std::vector<cv::Mat> masks;
   if (config_->use_mini_mask) {
-    masks = MinimizeMasks(boxes, masks, config_->mini_mask_shape[0],
-                          config_->mini_mask_shape[1]);
+    masks = RenderMiniMasks(img_desc.polygons, scale, padding, image.size(),
+                            boxes, config_->mini_mask_shape[0],
+                            config_->mini_mask_shape[1]);
+  } else {
+    masks = RenderMasks(img_desc.polygons, scale, padding, image.size());
   }
 
   // Make training sample
@@ -94,6 +94,7 @@ int main(int argc, char** argv) {
 
     if (config->gpu_count > 0)
       model->to(torch::DeviceType::CUDA);
+    model->PrepareInference();
 
     auto start = std::chrono::steady_clock::now();
     auto [detections, mrcnn_mask] = model->Detect(molded_images, image_metas);
@@ -1,8 +1,34 @@
 #include "detectiontargetlayer.h"
 #include "boxutils.h"
 #include "nnutils.h"
-#include "roialign/crop_and_resize.h"
-#include "roialign/crop_and_resize_gpu.h"
+#include "roialign/mask_targets.h"
+#include "roialign/mask_targets_gpu.h"
+
+namespace {
+/* Picks up to `count` random indices of the `candidates` mask without host
+ * synchronization. Candidates get uniform random keys and the rest get keys
+ * above 1, so the smallest keys are a random subset of the candidates.
+ * Returns: indices [count] and validity mask [count], indices are zero where
+ * there are not enough candidates.
+ */
+std::tuple<at::Tensor, at::Tensor> SampleIndices(at::Tensor candidates,
+                                                 int64_t count) {
+  auto keys = torch::rand({candidates.size(0)},
+                          candidates.options().dtype(at::kFloat));
+  keys.masked_fill_(candidates == 0, 2.f);
+  auto k = std::min(count, keys.size(0));
+  auto [sorted_keys, indices] =
+      torch::topk(keys, k, /*dim*/ 0, /*largest*/ false, /*sorted*/ true);
+  auto valid = sorted_keys < 1.5f;
+  if (k < count) {
+    indices = torch::cat(
+        {indices, torch::zeros({count - k}, indices.options())}, /*dim*/ 0);
+    valid =
+        torch::cat({valid, torch::zeros({count - k}, valid.options())}, 0);
+  }
+  return {indices, valid};
+}
+}  // namespace
 
 std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor> DetectionTargetLayer(
     const Config& config,
@@ -16,204 +42,87 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor, at::Tensor> DetectionTargetLayer(
   gt_boxes = gt_boxes.squeeze(0);
   gt_masks = gt_masks.squeeze(0);
 
+  // All the tensors are created on the proposals device and have fixed
+  // sizes, so the layer doesn't wait for the device
+  auto options = proposals.options().requires_grad(false);
+  auto positive_slots = static_cast<int64_t>(config.train_rois_per_image *
+                                             config.roi_positive_ratio);
+  auto negative_slots =
+      static_cast<int64_t>(config.train_rois_per_image) - positive_slots;
+
   //  Handle COCO crowds
   //  A crowd box in COCO is a bounding box around several instances. Exclude
   //  them from training. A crowd box is given a negative class ID.
   //  Now they are excluded in coco loader
 
   // Compute overlaps matrix [proposals, gt_boxes]
-  auto overlaps = BBoxOverlapsLoops(proposals, gt_boxes);
+  auto overlaps = BBoxOverlaps(proposals, gt_boxes);
 
   // Determine postive and negative ROIs
-  auto roi_iou_max = std::get<0>(torch::max(overlaps, /*dim*/ 1));
-
-  // 1. Positive ROIs are those with >= 0.5 IoU with a GT box
-  auto positive_roi_bool = roi_iou_max >= 0.5f;
-
-  at::Tensor roi_gt_class_ids;
-  at::Tensor deltas;
-  at::Tensor masks;
+  auto [roi_iou_max, roi_iou_argmax] = torch::max(overlaps, /*dim*/ 1);
 
   // Subsample ROIs. Aim for 33% positive
-  // Positive ROIs
-  int64_t positive_count = 0;
-  torch::Tensor positive_rois;
-  auto positive_indices = torch::nonzero(positive_roi_bool);
-  if (!is_empty(positive_indices)) {
-    positive_indices = positive_indices.narrow(1, 0, 1);
-
-    positive_count =
-        int(config.train_rois_per_image * config.roi_positive_ratio);
-
-    auto rand_idx =
-        torch::randperm(positive_indices.size(0), at::dtype(at::kLong));
-    rand_idx = rand_idx.narrow(
-        0, 0, std::min(positive_indices.size(0), positive_count));
-    if (config.gpu_count > 0) {
-      rand_idx = rand_idx.cuda();
-    }
-    positive_indices = positive_indices.take(rand_idx);
-    positive_count = positive_indices.size(0);
-    positive_rois = proposals.index_select(0, positive_indices);
-
-    // Debug block
-    //    std::cerr << "positive rois \n" << positive_rois << "\n";
-    //    auto d = torch::tensor({512, 512, 512, 512}, at::dtype(at::kFloat));
-    //    VisualizeBoxes("proposals", 512, 512, positive_rois.squeeze().cpu() *
-    //    d,
-    //                   gt_boxes.squeeze().cpu() * d);
-    //    exit(0);
-
-    //   Assign positive ROIs to GT boxes.
-    auto positive_overlaps = overlaps.index_select(0, positive_indices);
-    auto roi_gt_box_assignment =
-        std::get<1>(torch::max(positive_overlaps, /*dim*/ 1));
-    auto roi_gt_boxes = gt_boxes.index_select(0, roi_gt_box_assignment);
-    roi_gt_class_ids = gt_class_ids.take(roi_gt_box_assignment);
-
-    //   Compute bbox refinement for positive ROIs
-    {
-      auto deltas_data = BoxRefinement(positive_rois, roi_gt_boxes);
-      deltas =
-          torch::from_blob(deltas_data.cpu().data<float>(), deltas_data.sizes(),
-                           at::dtype(at::kFloat).requires_grad(false))
-              .clone();
-    }
-    if (config.gpu_count > 0)
-      deltas = deltas.cuda();
-
-    auto std_dev = torch::tensor(config.rpn_bbox_std_dev,
-                                 at::dtype(at::kFloat).requires_grad(false));
-    if (config.gpu_count > 0)
-      std_dev = std_dev.cuda();
-    deltas /= std_dev;
-
-    //   Assign positive ROIs to GT masks
-    auto roi_masks = gt_masks.index_select(0, roi_gt_box_assignment);
-
-    //   Compute mask targets
-    auto boxes = positive_rois;
-    if (config.use_mini_mask) {
-      // Transform ROI corrdinates from normalized image space
-      // to normalized mini-mask space.
-      auto yxyx = positive_rois.chunk(4, /*dim*/ 1);
-      auto y1 = yxyx[0];
-      auto x1 = yxyx[1];
-      auto y2 = yxyx[2];
-      auto x2 = yxyx[3];
-      auto gyxyx = roi_gt_boxes.chunk(4, /*dim*/ 1);
-      auto gt_y1 = gyxyx[0];
-      auto gt_x1 = gyxyx[1];
-      auto gt_y2 = gyxyx[2];
-      auto gt_x2 = gyxyx[3];
-      auto gt_h = gt_y2 - gt_y1;
-      auto gt_w = gt_x2 - gt_x1;
-      y1 = (y1 - gt_y1) / gt_h;
-      x1 = (x1 - gt_x1) / gt_w;
-      y2 = (y2 - gt_y1) / gt_h;
-      x2 = (x2 - gt_x1) / gt_w;
-      boxes = torch::cat({y1, x1, y2, x2}, /*dim*/ 1);
-    }
-    auto box_ids = torch::arange(roi_masks.size(0),
-                                 at::requires_grad(false).dtype(at::kInt));
-    if (config.gpu_count > 0)
-      box_ids = box_ids.cuda();
-    masks = torch::zeros({}, at::dtype(at::kFloat).requires_grad(false));
-    if (config.gpu_count > 0)
-      masks = masks.cuda();
-
-    if (config.gpu_count > 0) {
-      crop_and_resize_gpu_forward(roi_masks.unsqueeze(1), boxes, box_ids, 0,
-                                  config.mask_shape[0], config.mask_shape[1],
-                                  masks);
-    } else {
-      crop_and_resize_forward(roi_masks.unsqueeze(1), boxes, box_ids, 0,
-                              config.mask_shape[0], config.mask_shape[1],
-                              masks);
-    }
-    masks = masks.squeeze(1);
-
-    //  Threshold mask pixels at 0.5 to have GT masks be 0 or 1 to use with
-    //   binary cross entropy loss.
-    masks = torch::round(masks);
+  // 1. Positive ROIs are those with >= 0.5 IoU with a GT box
+  auto [positive_indices, positive_valid] =
+      SampleIndices(roi_iou_max >= 0.5f, positive_slots);
+  auto positive_weight = positive_valid.to(at::kFloat);
+  auto positive_rois = proposals.index_select(0, positive_indices) *
+                       positive_weight.unsqueeze(1);
+
+  //   Assign positive ROIs to GT boxes.
+  auto roi_gt_box_assignment = roi_iou_argmax.index_select(0, positive_indices);
+  auto roi_gt_boxes = gt_boxes.index_select(0, roi_gt_box_assignment);
+  auto roi_gt_class_ids = gt_class_ids.take(roi_gt_box_assignment)
+                              .masked_fill(positive_valid == 0, -1);
+
+  //   Compute bbox refinement for positive ROIs, standard deviations are
+  //   applied as scalars to avoid host to device copies
+  auto deltas = BoxRefinement(positive_rois, roi_gt_boxes);
+  for (int64_t i = 0; i < 4; ++i)
+    deltas.select(1, i).div_(config.rpn_bbox_std_dev[static_cast<size_t>(i)]);
+  deltas.masked_fill_((positive_valid == 0).unsqueeze(1), 0.f);
+
+  //   Compute mask targets, GT masks are sampled in place by ROI assignment
+  //   instead of being gathered per ROI. Invalid ROIs get zero masks.
+  auto roi_gt_index = roi_gt_box_assignment.to(at::kInt).masked_fill_(
+      positive_valid == 0, -1);
+  auto masks = torch::zeros({}, options);
+  if (config.gpu_count > 0) {
+    mask_targets_gpu_forward(gt_masks, positive_rois, gt_boxes, roi_gt_index,
+                             config.use_mini_mask, config.mask_shape[0],
+                             config.mask_shape[1], masks);
   } else {
-    positive_count = 0;
+    mask_targets_forward(gt_masks, positive_rois, gt_boxes, roi_gt_index,
+                         config.use_mini_mask, config.mask_shape[0],
+                         config.mask_shape[1], masks);
   }
 
   //  2. Negative ROIs are those with < 0.5 with every GT box. Skip crowds.
-  auto negative_roi_bool = roi_iou_max < 0.5f;
-  // negative_roi_bool = negative_roi_bool & no_crowd_bool
-  // Negative ROIs. Add enough to maintain positive:negative ratio.
-  int64_t negative_count = 0;
-  torch::Tensor negative_rois;
-  if (!is_empty(torch::nonzero(negative_roi_bool)) && positive_count > 0) {
-    auto negative_indices = torch::nonzero(negative_roi_bool).narrow(1, 0, 1);
-    auto r = 1.0f / config.roi_positive_ratio;
-    negative_count = static_cast<int64_t>(r * positive_count - positive_count);
-    auto rand_idx =
-        torch::randperm(negative_indices.size(0), at::dtype(at::kLong));
-    rand_idx = rand_idx.narrow(
-        0, 0, std::min(negative_indices.size(0), negative_count));
-    if (config.gpu_count > 0)
-      rand_idx = rand_idx.cuda();
-    negative_indices = negative_indices.take(rand_idx);
-    negative_count = negative_indices.size(0);
-    negative_rois = proposals.index_select(0, negative_indices);
-  } else {
-    negative_count = 0;
-  }
-
-  // Append negative ROIs and pad bbox deltas and masks that
-  // are not used for negative ROIs with zeros.
-  at::Tensor rois;
-  if (positive_count > 0 && negative_count > 0) {
-    rois = torch::cat({positive_rois, negative_rois}, /*dim*/ 0);
-    auto zeros = torch::zeros({negative_count},
-                              at::requires_grad(false).dtype(at::kInt));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    roi_gt_class_ids = torch::cat({roi_gt_class_ids, zeros}, /*dim*/ 0);
-    zeros = torch::zeros({negative_count, 4}, at::requires_grad(false));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    deltas = torch::cat({deltas, zeros}, /*dim*/ 0);
-    zeros = torch::zeros(
-        {negative_count, config.mask_shape[0], config.mask_shape[1]},
-        at::requires_grad(false));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    masks = torch::cat({masks, zeros}, /*dim*/ 0);
-  } else if (positive_count > 0) {
-    rois = positive_rois;
-  } else if (negative_count > 0) {
-    rois = negative_rois;
-    auto zeros = torch::zeros({negative_count}, at::requires_grad(false));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    roi_gt_class_ids = zeros;
-    zeros = torch::zeros({negative_count, 4},
-                         at::requires_grad(false).dtype(at::kInt));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    deltas = zeros;
-    zeros = torch::zeros(
-        {negative_count, config.mask_shape[0], config.mask_shape[1]},
-        at::requires_grad(false));
-    if (config.gpu_count > 0)
-      zeros = zeros.cuda();
-    masks = zeros;
-  } else {
-    rois = torch::empty({}, at::dtype(at::kFloat).requires_grad(false));
-    roi_gt_class_ids =
-        torch::empty({}, at::dtype(at::kFloat).requires_grad(false));
-    deltas = torch::empty({}, at::dtype(at::kFloat).requires_grad(false));
-    masks = torch::empty({}, at::dtype(at::kFloat).requires_grad(false));
-    if (config.gpu_count) {
-      rois = rois.cuda();
-      roi_gt_class_ids = roi_gt_class_ids.cuda();
-      deltas = deltas.cuda();
-      masks = masks.cuda();
-    }
-  }
+  //  Add enough to maintain positive:negative ratio, there are no negatives
+  //  without positives.
+  auto [negative_indices, negative_valid] =
+      SampleIndices(roi_iou_max < 0.5f, negative_slots);
+  auto positive_count = positive_weight.sum();
+  auto r = 1.0f / config.roi_positive_ratio;
+  auto negative_count = (positive_count * r - positive_count).floor();
+  negative_valid = negative_valid &
+                   (torch::arange(negative_slots, options) < negative_count);
+  auto negative_rois = proposals.index_select(0, negative_indices) *
+                       negative_valid.to(at::kFloat).unsqueeze(1);
+
+  // Append negative ROIs and pad bbox deltas and masks that are not used for
+  // negative ROIs with zeros. Slots without ROIs have zero boxes and -1
+  // class ids, the losses skip them.
+  auto rois = torch::cat({positive_rois, negative_rois}, /*dim*/ 0);
+  auto negative_class_ids =
+      torch::zeros({negative_slots}, roi_gt_class_ids.options())
+          .masked_fill_(negative_valid == 0, -1);
+  roi_gt_class_ids = torch::cat({roi_gt_class_ids, negative_class_ids}, 0);
+  deltas = torch::cat({deltas, torch::zeros({negative_slots, 4}, options)}, 0);
+  masks = torch::cat(
+      {masks, torch::zeros({negative_slots, config.mask_shape[0],
+                            config.mask_shape[1]},
+                           options)},
+      0);
   return {rois, roi_gt_class_ids, deltas, masks};
 }
@@ -17,14 +17,16 @@
  *  gt_masks: [batch, height, width, MAX_GT_INSTANCES] of boolean type
  *
  *  Returns: Target ROIs and corresponding class IDs, bounding box shifts,
- *  and masks.
- *  rois: [batch, TRAIN_ROIS_PER_IMAGE, (y1, x1, y2, x2)] in normalized
+ *  and masks. Sizes don't depend on the data, positive ROIs take the first
+ *  TRAIN_ROIS_PER_IMAGE * ROI_POSITIVE_RATIO rows and negative ROIs the
+ *  rest. Unused rows have zero boxes, deltas and masks and -1 class IDs.
+ *  Sampling is done on the proposals device without synchronization.
+ *  rois: [TRAIN_ROIS_PER_IMAGE, (y1, x1, y2, x2)] in normalized
  *        coordinates
- *  target_class_ids: [batch, TRAIN_ROIS_PER_IMAGE]. Integer class IDs.
- *  target_deltas: [batch, TRAIN_ROIS_PER_IMAGE, NUM_CLASSES,
- *                  (dy, dx, log(dh), log(dw), class_id)]
- *                 Class-specific bbox refinments.
- *  target_mask: [batch, TRAIN_ROIS_PER_IMAGE, height, width)
+ *  target_class_ids: [TRAIN_ROIS_PER_IMAGE]. Integer class IDs.
+ *  target_deltas: [TRAIN_ROIS_PER_IMAGE, (dy, dx, log(dh), log(dw))]
+ *                 Bbox refinments of the assigned GT boxes.
+ *  target_mask: [TRAIN_ROIS_PER_IMAGE, height, width)
  *               Masks cropped to bbox boundaries and resized to neural
  *               network output size.
  */
@@ -1,6 +1,7 @@
 #include "fpn.h"
 #include "debug.h"
 #include "nnutils.h"
+#include "resnet.h"
 
 FPNImpl::FPNImpl() {}
 
@@ -55,6 +56,13 @@ FPNImpl::FPNImpl(torch::nn::Sequential c1,
   register_module("P3_conv2", p3_conv2_);
   register_module("P2_conv1", p2_conv1_);
   register_module("P2_conv2", p2_conv2_);
+
+  // Convolutions pad the input themselves, SamePad2d modules are kept to
+  // keep parameter names of the layers
+  for (auto conv2 : {p5_conv2_, p4_conv2_, p3_conv2_, p2_conv2_}) {
+    FoldSamePadding(conv2->at<torch::nn::Conv2dImpl>(1),
+                    conv2->at<SamePad2dImpl>(0));
+  }
 }
 
 std::tuple<torch::Tensor,
@@ -63,7 +71,7 @@ std::tuple<torch::Tensor,
            torch::Tensor,
            torch::Tensor>
 FPNImpl::forward(at::Tensor x) {
-  x = c1_->forward(x);
+  x = ForwardC1(x);
   x = c2_->forward(x);
   auto c2_out = x;
   x = c3_->forward(x);
@@ -79,10 +87,10 @@ FPNImpl::forward(at::Tensor x) {
   auto p2_out =
       p2_conv1_->forward(c2_out) + upsample(p3_out, /*scale_factor*/ 2);
 
-  p5_out = p5_conv2_->forward(p5_out);
-  p4_out = p4_conv2_->forward(p4_out);
-  p3_out = p3_conv2_->forward(p3_out);
-  p2_out = p2_conv2_->forward(p2_out);
+  p5_out = ForwardConv2(p5_conv2_, p5_out);
+  p4_out = ForwardConv2(p4_conv2_, p4_out);
+  p3_out = ForwardConv2(p3_conv2_, p3_out);
+  p2_out = ForwardConv2(p2_conv2_, p2_out);
 
   // P6 is used for the 5th anchor scale in RPN. Generated by subsampling from
   // P5 with stride of 2.
@@ -90,3 +98,29 @@ FPNImpl::forward(at::Tensor x) {
 
   return {p2_out, p3_out, p4_out, p5_out, p6_out};
 }
+
+// C1 is [conv, batch norm, relu, padding, max pool]
+at::Tensor FPNImpl::ForwardC1(at::Tensor x) {
+  if (!fused_)
+    return c1_->forward(x);
+  x = c1_->at<torch::nn::Conv2dImpl>(0).forward(x).relu_();
+  x = c1_->at<SamePad2dImpl>(3).forward(x);
+  return c1_->at<torch::nn::FunctionalImpl>(4).forward(x);
+}
+
+// P conv2 layers are [padding, conv], the padding is folded into the conv
+at::Tensor FPNImpl::ForwardConv2(torch::nn::Sequential& conv2, at::Tensor x) {
+  return conv2->at<torch::nn::Conv2dImpl>(1).forward(x);
+}
+
+void FPNImpl::Fuse() {
+  if (fused_)
+    return;
+  FoldBatchNorm(c1_->at<torch::nn::Conv2dImpl>(0),
+                c1_->at<torch::nn::BatchNormImpl>(1));
+  for (auto stage : {c2_, c3_, c4_, c5_}) {
+    for (size_t i = 0; i < stage->size(); ++i)
+      stage->at<BottleneckImpl>(i).Fuse();
+  }
+  fused_ = true;
+}
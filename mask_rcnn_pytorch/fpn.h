@@ -20,6 +20,14 @@ class FPNImpl : public torch::nn::Module {
              torch::Tensor>
   forward(torch::Tensor x);
 
+  // Folds batch norms of the backbone into convolutions, used for inference
+  // only
+  void Fuse();
+
+ private:
+  torch::Tensor ForwardC1(torch::Tensor x);
+  torch::Tensor ForwardConv2(torch::nn::Sequential& conv2, torch::Tensor x);
+
  private:
   torch::nn::Sequential c1_{nullptr};
   torch::nn::Sequential c2_{nullptr};
@@ -36,6 +44,7 @@ class FPNImpl : public torch::nn::Module {
   torch::nn::Sequential p3_conv2_{nullptr};
   torch::nn::Conv2d p2_conv1_{nullptr};
   torch::nn::Sequential p2_conv2_{nullptr};
+  bool fused_{false};
 };
 
 TORCH_MODULE(FPN);
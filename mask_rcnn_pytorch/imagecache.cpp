@@ -0,0 +1,401 @@
+#include "imagecache.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+const std::uint32_t cache_magic = 0x494d4332; // "IMC2"
+const std::int32_t none = -1;
+const std::size_t alignment = 64;
+
+std::size_t Align(std::size_t size)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+std::uint64_t Hash(std::uint64_t key)
+{
+    // splitmix64 finalizer, image ids are sequential
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+std::runtime_error SystemError(const std::string &what, const std::string &name)
+{
+    return std::runtime_error("ImageCache: " + what + " " + name + ": " + std::strerror(errno));
+}
+} // namespace
+
+struct ImageCache::Header
+{
+    std::atomic<std::uint32_t> magic;
+    std::uint64_t size;
+    std::uint64_t slot_bytes;
+    std::int32_t slots_count;
+    std::int32_t buckets_count;
+    pthread_mutex_t mutex;
+    /// process which removes the segment
+    pid_t owner_pid;
+    ImageCacheStamp stamp;
+    /// LRU list, head is the most recently used entry
+    std::int32_t head;
+    std::int32_t tail;
+    std::int32_t free_list;
+    std::uint32_t entries;
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    std::uint64_t insertions;
+};
+
+struct ImageCache::Entry
+{
+    std::uint64_t key;
+    std::int32_t prev;
+    /// next in the LRU list or in the free list
+    std::int32_t next;
+    /// next entry in the hash bucket
+    std::int32_t chain;
+    std::int32_t rows;
+    std::int32_t cols;
+    std::int32_t type;
+    std::int32_t original_width;
+    std::int32_t original_height;
+    Window window;
+    float scale;
+    Padding padding;
+};
+
+/// \brief Locks the segment mutex, the cache is cleared if its previous owner
+///        died in the middle of an update
+class ImageCache::Lock
+{
+  public:
+    explicit Lock(ImageCache &cache) : mutex_(&cache.header_->mutex)
+    {
+        int result = pthread_mutex_lock(mutex_);
+        if (result == EOWNERDEAD)
+        {
+            cache.Reset();
+            pthread_mutex_consistent(mutex_);
+        }
+        else if (result != 0)
+        {
+            throw std::runtime_error("ImageCache: can't lock the mutex");
+        }
+    }
+    ~Lock() { pthread_mutex_unlock(mutex_); }
+
+  private:
+    pthread_mutex_t *mutex_;
+};
+
+ImageCache::ImageCache(const std::string &name, std::size_t capacity_bytes, std::size_t max_image_bytes,
+                       const ImageCacheStamp &stamp)
+    : name_(name)
+{
+    std::size_t slot_bytes = Align(max_image_bytes);
+    if (slot_bytes == 0 || capacity_bytes < slot_bytes)
+        throw std::runtime_error("ImageCache: capacity is less than one image");
+    auto slots_count = static_cast<std::int32_t>(capacity_bytes / slot_bytes);
+    auto buckets_count = slots_count * 2;
+    std::size_t entries_offset = Align(sizeof(Header));
+    std::size_t buckets_offset = entries_offset + Align(sizeof(Entry) * slots_count);
+    std::size_t slots_offset = buckets_offset + Align(sizeof(std::int32_t) * buckets_count);
+    size_ = slots_offset + slot_bytes * slots_count;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0)
+    {
+        owner_ = true;
+        if (ftruncate(fd, static_cast<off_t>(size_)) != 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw SystemError("can't allocate", name);
+        }
+    }
+    else if (errno == EEXIST)
+    {
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0)
+            throw SystemError("can't open", name);
+        // the creator may not have sized the segment yet
+        struct stat st;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) != size_)
+        {
+            if (st.st_size != 0 || std::chrono::steady_clock::now() > deadline)
+            {
+                close(fd);
+                throw std::runtime_error("ImageCache: " + name + " has other size, remove it from /dev/shm");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    else
+    {
+        throw SystemError("can't create", name);
+    }
+
+    memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory_ == MAP_FAILED)
+    {
+        memory_ = nullptr;
+        if (owner_)
+            shm_unlink(name.c_str());
+        throw SystemError("can't map", name);
+    }
+    header_ = static_cast<Header *>(memory_);
+
+    if (owner_)
+    {
+        header_->size = size_;
+        header_->slot_bytes = slot_bytes;
+        header_->slots_count = slots_count;
+        header_->buckets_count = buckets_count;
+
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header_->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        header_->owner_pid = getpid();
+        header_->stamp = stamp;
+        Reset();
+        header_->magic.store(cache_magic, std::memory_order_release);
+    }
+    else
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        std::uint32_t magic = 0;
+        while ((magic = header_->magic.load(std::memory_order_acquire)) != cache_magic)
+        {
+            if (magic != 0)
+            {
+                munmap(memory_, size_);
+                throw std::runtime_error("ImageCache: " + name + " has other version, remove it from /dev/shm");
+            }
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                munmap(memory_, size_);
+                throw std::runtime_error("ImageCache: " + name + " isn't initialized");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (header_->slot_bytes != slot_bytes || header_->slots_count != slots_count)
+        {
+            munmap(memory_, size_);
+            throw std::runtime_error("ImageCache: " + name + " has other layout");
+        }
+
+        Lock lock(*this);
+        // images are keyed by the dataset index, so they are stale if the
+        // dataset or resize settings have changed
+        if (!(header_->stamp == stamp))
+        {
+            Reset();
+            header_->stamp = stamp;
+        }
+        // the creator was killed before removing the segment, this process
+        // removes it instead, so the memory isn't held forever
+        if (kill(header_->owner_pid, 0) != 0 && errno == ESRCH)
+        {
+            header_->owner_pid = getpid();
+            owner_ = true;
+        }
+    }
+}
+
+ImageCache::~ImageCache()
+{
+    if (memory_ != nullptr)
+        munmap(memory_, size_);
+    // processes which mapped the segment keep using it
+    if (owner_)
+        shm_unlink(name_.c_str());
+}
+
+ImageCache::Entry *ImageCache::GetEntries() const
+{
+    return reinterpret_cast<Entry *>(static_cast<unsigned char *>(memory_) + Align(sizeof(Header)));
+}
+
+std::int32_t *ImageCache::GetBuckets() const
+{
+    return reinterpret_cast<std::int32_t *>(reinterpret_cast<unsigned char *>(GetEntries()) +
+                                            Align(sizeof(Entry) * header_->slots_count));
+}
+
+unsigned char *ImageCache::GetSlot(std::int32_t index) const
+{
+    auto slots = reinterpret_cast<unsigned char *>(GetBuckets()) +
+                 Align(sizeof(std::int32_t) * header_->buckets_count);
+    return slots + header_->slot_bytes * static_cast<std::size_t>(index);
+}
+
+void ImageCache::Reset()
+{
+    auto entries = GetEntries();
+    for (std::int32_t i = 0; i < header_->slots_count; ++i)
+        entries[i].next = i + 1 < header_->slots_count ? i + 1 : none;
+    auto buckets = GetBuckets();
+    std::fill(buckets, buckets + header_->buckets_count, none);
+    header_->head = none;
+    header_->tail = none;
+    header_->free_list = 0;
+    header_->entries = 0;
+    header_->hits = 0;
+    header_->misses = 0;
+    header_->evictions = 0;
+    header_->insertions = 0;
+}
+
+std::int32_t ImageCache::Find(std::uint64_t key) const
+{
+    auto entries = GetEntries();
+    auto index = GetBuckets()[Hash(key) % header_->buckets_count];
+    while (index != none && entries[index].key != key)
+        index = entries[index].chain;
+    return index;
+}
+
+void ImageCache::Unlink(std::int32_t index)
+{
+    auto entries = GetEntries();
+    auto &entry = entries[index];
+    if (entry.prev != none)
+        entries[entry.prev].next = entry.next;
+    else
+        header_->head = entry.next;
+    if (entry.next != none)
+        entries[entry.next].prev = entry.prev;
+    else
+        header_->tail = entry.prev;
+}
+
+void ImageCache::PushFront(std::int32_t index)
+{
+    auto entries = GetEntries();
+    auto &entry = entries[index];
+    entry.prev = none;
+    entry.next = header_->head;
+    if (header_->head != none)
+        entries[header_->head].prev = index;
+    header_->head = index;
+    if (header_->tail == none)
+        header_->tail = index;
+}
+
+bool ImageCache::Get(std::uint64_t key, CachedImage &image)
+{
+    Lock lock(*this);
+    auto index = Find(key);
+    if (index == none)
+    {
+        ++header_->misses;
+        return false;
+    }
+    ++header_->hits;
+    Unlink(index);
+    PushFront(index);
+
+    const auto &entry = GetEntries()[index];
+    image.image.create(entry.rows, entry.cols, entry.type);
+    std::memcpy(image.image.data, GetSlot(index), image.image.total() * image.image.elemSize());
+    image.original_size = cv::Size(entry.original_width, entry.original_height);
+    image.window = entry.window;
+    image.scale = entry.scale;
+    image.padding = entry.padding;
+    return true;
+}
+
+bool ImageCache::Put(std::uint64_t key, const CachedImage &image)
+{
+    if (image.image.depth() != CV_8U)
+        throw std::runtime_error("ImageCache: only 8-bit images are cached");
+    std::size_t bytes = image.image.total() * image.image.elemSize();
+    if (bytes > header_->slot_bytes)
+        return false;
+    cv::Mat pixels = image.image.isContinuous() ? image.image : image.image.clone();
+
+    Lock lock(*this);
+    auto entries = GetEntries();
+    auto buckets = GetBuckets();
+    auto index = Find(key);
+    if (index != none)
+    {
+        // other worker has already cached it
+        Unlink(index);
+        PushFront(index);
+        return true;
+    }
+
+    if (header_->free_list != none)
+    {
+        index = header_->free_list;
+        header_->free_list = entries[index].next;
+        ++header_->entries;
+    }
+    else
+    {
+        index = header_->tail;
+        Unlink(index);
+        auto *link = &buckets[Hash(entries[index].key) % header_->buckets_count];
+        while (*link != index)
+            link = &entries[*link].chain;
+        *link = entries[index].chain;
+        ++header_->evictions;
+    }
+
+    auto &entry = entries[index];
+    entry.key = key;
+    entry.rows = pixels.rows;
+    entry.cols = pixels.cols;
+    entry.type = pixels.type();
+    entry.original_width = image.original_size.width;
+    entry.original_height = image.original_size.height;
+    entry.window = image.window;
+    entry.scale = image.scale;
+    entry.padding = image.padding;
+    std::memcpy(GetSlot(index), pixels.data, bytes);
+
+    auto &bucket = buckets[Hash(key) % header_->buckets_count];
+    entry.chain = bucket;
+    bucket = index;
+    PushFront(index);
+    ++header_->insertions;
+    return true;
+}
+
+ImageCacheStats ImageCache::GetStats() const
+{
+    Lock lock(const_cast<ImageCache &>(*this));
+    ImageCacheStats stats;
+    stats.hits = header_->hits;
+    stats.misses = header_->misses;
+    stats.evictions = header_->evictions;
+    stats.insertions = header_->insertions;
+    stats.entries = header_->entries;
+    stats.capacity = static_cast<std::uint32_t>(header_->slots_count);
+    return stats;
+}
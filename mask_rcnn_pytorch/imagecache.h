@@ -0,0 +1,99 @@
+#pragma once
+
+#include "imageutils.h"
+
+#include <cstdint>
+#include <string>
+
+/// \brief Resized image with the parameters ResizeImage returned for it
+struct CachedImage
+{
+    cv::Mat image;
+    cv::Size original_size;
+    Window window;
+    float scale{1.f};
+    Padding padding;
+};
+
+/// \brief Identifies the data the cached images are made of, images of a
+///        segment with other stamp are dropped when it's attached
+struct ImageCacheStamp
+{
+    /// annotations file size and modification time, images are keyed by the
+    /// dataset index
+    std::uint64_t dataset_size{0};
+    std::int64_t dataset_mtime{0};
+    std::int32_t min_dim{0};
+    std::int32_t max_dim{0};
+    bool padding{false};
+
+    bool operator==(const ImageCacheStamp &other) const
+    {
+        return dataset_size == other.dataset_size && dataset_mtime == other.dataset_mtime &&
+               min_dim == other.min_dim && max_dim == other.max_dim && padding == other.padding;
+    }
+};
+
+struct ImageCacheStats
+{
+    std::uint64_t hits{0};
+    std::uint64_t misses{0};
+    std::uint64_t evictions{0};
+    std::uint64_t insertions{0};
+    std::uint32_t entries{0};
+    std::uint32_t capacity{0};
+};
+
+/// \brief LRU cache of decoded and resized 8-bit images in a POSIX shared
+///        memory segment. All the threads and processes which open the
+///        segment with the same name share the images, access is guarded by
+///        a process shared robust mutex. Images are kept in fixed size slots,
+///        so the segment never fragments. The creator removes the segment,
+///        if it was killed the first process attaching to the segment takes
+///        this over.
+class ImageCache
+{
+  public:
+    /// \param name[in]            : shared memory segment name, like "/train_images",
+    ///                              it should be unique for the dataset and resize settings
+    /// \param capacity_bytes[in]  : size of all the image slots
+    /// \param max_image_bytes[in] : slot size, bigger images aren't cached
+    /// \param stamp[in]           : the cache is cleared if the segment has other stamp
+    ImageCache(const std::string &name, std::size_t capacity_bytes, std::size_t max_image_bytes,
+               const ImageCacheStamp &stamp);
+    ~ImageCache();
+
+    ImageCache(const ImageCache &) = delete;
+    ImageCache &operator=(const ImageCache &) = delete;
+
+    /// \brief Copies the cached image out of the segment
+    /// \ret false if there is no image with the key
+    bool Get(std::uint64_t key, CachedImage &image);
+
+    /// \brief Copies the image to the segment evicting the least recently used
+    ///        image if there are no free slots
+    /// \ret false if the image is bigger than the slot
+    bool Put(std::uint64_t key, const CachedImage &image);
+
+    ImageCacheStats GetStats() const;
+
+  private:
+    struct Header;
+    struct Entry;
+    class Lock;
+
+    Entry *GetEntries() const;
+    std::int32_t *GetBuckets() const;
+    unsigned char *GetSlot(std::int32_t index) const;
+    std::int32_t Find(std::uint64_t key) const;
+    void Unlink(std::int32_t index);
+    void PushFront(std::int32_t index);
+    void Reset();
+
+  private:
+    std::string name_;
+    std::size_t size_{0};
+    void *memory_{nullptr};
+    Header *header_{nullptr};
+    bool owner_{false};
+};
@@ -0,0 +1,279 @@
+#include "imageprobe.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+const char *const cache_signature = "image_sizes_v1";
+
+std::uint32_t ReadBigEndian(const unsigned char *data, size_t bytes)
+{
+    std::uint32_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+std::uint32_t ReadTiff(const unsigned char *data, size_t bytes, bool little_endian)
+{
+    std::uint32_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= static_cast<std::uint32_t>(little_endian ? data[i] : data[bytes - 1 - i]) << (8 * i);
+    return value;
+}
+
+/// \brief Finds orientation tag in the IFD0 of the EXIF segment payload
+int GetExifOrientation(const std::vector<unsigned char> &exif)
+{
+    // "Exif\0\0" and 8 bytes of the TIFF header
+    if (exif.size() < 14 || std::string(exif.begin(), exif.begin() + 4) != "Exif")
+        return 1;
+    const unsigned char *tiff = exif.data() + 6;
+    size_t size = exif.size() - 6;
+    bool little_endian = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!little_endian && !(tiff[0] == 'M' && tiff[1] == 'M'))
+        return 1;
+    size_t ifd = ReadTiff(tiff + 4, 4, little_endian);
+    if (ifd + 2 > size)
+        return 1;
+    size_t entries = ReadTiff(tiff + ifd, 2, little_endian);
+    for (size_t i = 0; i < entries; ++i)
+    {
+        size_t entry = ifd + 2 + i * 12;
+        if (entry + 12 > size)
+            break;
+        if (ReadTiff(tiff + entry, 2, little_endian) == 0x0112)
+            return static_cast<int>(ReadTiff(tiff + entry + 8, 2, little_endian));
+    }
+    return 1;
+}
+
+bool ProbePng(std::ifstream &file, ImageSize &size)
+{
+    // signature, IHDR chunk length and type, width and height
+    std::array<unsigned char, 24> header;
+    if (!file.read(reinterpret_cast<char *>(header.data()), header.size()))
+        return false;
+    const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (!std::equal(std::begin(signature), std::end(signature), header.begin()) ||
+        std::string(header.begin() + 12, header.begin() + 16) != "IHDR")
+        return false;
+    size.width = ReadBigEndian(header.data() + 16, 4);
+    size.height = ReadBigEndian(header.data() + 20, 4);
+    return true;
+}
+
+bool ProbeJpeg(std::ifstream &file, ImageSize &size)
+{
+    int orientation = 1;
+    unsigned char marker[2];
+    if (!file.read(reinterpret_cast<char *>(marker), 2) || marker[0] != 0xff || marker[1] != 0xd8)
+        return false;
+    while (file)
+    {
+        // markers can be preceded by any number of fill bytes
+        int byte = file.get();
+        if (byte != 0xff)
+            return false;
+        while (byte == 0xff)
+            byte = file.get();
+        if (byte == EOF)
+            return false;
+        // standalone markers have no length
+        if (byte == 0x01 || (byte >= 0xd0 && byte <= 0xd8))
+            continue;
+        // image data started or ended before the frame header
+        if (byte == 0xd9 || byte == 0xda)
+            return false;
+
+        unsigned char length_bytes[2];
+        if (!file.read(reinterpret_cast<char *>(length_bytes), 2))
+            return false;
+        size_t length = ReadBigEndian(length_bytes, 2);
+        if (length < 2)
+            return false;
+        length -= 2;
+
+        // SOF markers, except DHT (c4), JPG (c8) and DAC (cc)
+        if (byte >= 0xc0 && byte <= 0xcf && byte != 0xc4 && byte != 0xc8 && byte != 0xcc)
+        {
+            // precision, height, width
+            unsigned char frame[5];
+            if (length < 5 || !file.read(reinterpret_cast<char *>(frame), 5))
+                return false;
+            size.height = ReadBigEndian(frame + 1, 2);
+            size.width = ReadBigEndian(frame + 3, 2);
+            // orientations 5-8 rotate image by 90 degrees
+            if (orientation >= 5 && orientation <= 8)
+                std::swap(size.width, size.height);
+            return true;
+        }
+        if (byte == 0xe1 && orientation == 1)
+        {
+            std::vector<unsigned char> exif(length);
+            if (!file.read(reinterpret_cast<char *>(exif.data()), length))
+                return false;
+            orientation = GetExifOrientation(exif);
+        }
+        else
+        {
+            file.seekg(length, std::ios::cur);
+        }
+    }
+    return false;
+}
+
+struct CacheEntry
+{
+    std::int64_t mtime{0};
+    std::int64_t file_size{0};
+    ImageSize size;
+};
+
+/// \brief File modification time in nanoseconds and file size
+bool GetFileStamp(const std::string &path, std::int64_t &mtime, std::int64_t &file_size)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    file_size = static_cast<std::int64_t>(st.st_size);
+    return true;
+}
+
+std::unordered_map<std::string, CacheEntry> ReadCache(const std::string &cache_file)
+{
+    std::unordered_map<std::string, CacheEntry> cache;
+    std::ifstream file(cache_file);
+    std::string line;
+    if (!std::getline(file, line) || line != cache_signature)
+        return cache;
+    // mtime file_size width height path
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        CacheEntry entry;
+        std::string path;
+        if (fields >> entry.mtime >> entry.file_size >> entry.size.width >> entry.size.height &&
+            fields.get() == ' ' && std::getline(fields, path))
+            cache[path] = entry;
+    }
+    return cache;
+}
+
+void WriteCache(const std::string &cache_file, const std::unordered_map<std::string, CacheEntry> &cache)
+{
+    // the cache is replaced at once, so readers never see a partial file,
+    // the temporary name is unique for processes and threads writing it
+    static std::atomic<unsigned> writes{0};
+    std::string temp_file =
+        cache_file + ".tmp." + std::to_string(getpid()) + "." + std::to_string(writes++);
+    {
+        std::ofstream file(temp_file);
+        file << cache_signature << '\n';
+        for (const auto &item : cache)
+        {
+            const auto &entry = item.second;
+            file << entry.mtime << ' ' << entry.file_size << ' ' << entry.size.width << ' ' << entry.size.height
+                 << ' ' << item.first << '\n';
+        }
+        if (!file)
+        {
+            std::cout << "Can't write image sizes cache " << temp_file << "\n";
+            std::remove(temp_file.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp_file.c_str(), cache_file.c_str()) != 0)
+    {
+        std::cout << "Can't write image sizes cache " << cache_file << "\n";
+        std::remove(temp_file.c_str());
+    }
+}
+} // namespace
+
+bool ProbeImageSize(const std::string &path, ImageSize &size)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    int first = file.peek();
+    if (first == 0xff)
+        return ProbeJpeg(file, size);
+    if (first == 0x89)
+        return ProbePng(file, size);
+    return false;
+}
+
+std::vector<ImageSize> GetImageSizes(const std::vector<std::string> &paths, const std::string &cache_file)
+{
+    auto cache = ReadCache(cache_file);
+    std::vector<ImageSize> sizes(paths.size());
+    std::vector<CacheEntry> entries(paths.size());
+    std::vector<char> updated(paths.size(), 0);
+
+    // the cache is only read in the parallel section
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        auto &entry = entries[i];
+        if (!GetFileStamp(paths[i], entry.mtime, entry.file_size))
+            continue; // missing file has empty size
+        auto cached = cache.find(paths[i]);
+        if (cached != cache.end() && cached->second.mtime == entry.mtime &&
+            cached->second.file_size == entry.file_size)
+        {
+            sizes[i] = cached->second.size;
+            continue;
+        }
+        if (!ProbeImageSize(paths[i], sizes[i]))
+        {
+            // unknown format, decode it
+            cv::Mat image = cv::imread(paths[i], cv::IMREAD_COLOR);
+            sizes[i].width = static_cast<std::uint32_t>(image.cols);
+            sizes[i].height = static_cast<std::uint32_t>(image.rows);
+        }
+        if (!sizes[i].IsEmpty())
+        {
+            entry.size = sizes[i];
+            updated[i] = 1;
+        }
+    }
+
+    // only the entries of the current files are written back, so images
+    // removed from the list don't stay in the cache
+    std::unordered_map<std::string, CacheEntry> current;
+    bool changed = false;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (sizes[i].IsEmpty())
+            continue;
+        if (updated[i])
+        {
+            current[paths[i]] = entries[i];
+            changed = true;
+        }
+        else
+        {
+            current[paths[i]] = cache[paths[i]];
+        }
+    }
+    if (changed || current.size() != cache.size())
+        WriteCache(cache_file, current);
+    return sizes;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// \brief Image dimensions as cv::imread returns them
+struct ImageSize
+{
+    std::uint32_t width{0};
+    std::uint32_t height{0};
+
+    bool IsEmpty() const { return width == 0 || height == 0; }
+};
+
+/// \brief Reads image dimensions from JPEG or PNG headers without decoding
+///        pixels, EXIF orientation of JPEG files is taken into account
+/// \param path[in]  : image file path
+/// \param size[out] : image dimensions
+/// \ret false if the file can't be read or has other format
+bool ProbeImageSize(const std::string &path, ImageSize &size);
+
+/// \brief Gets dimensions of all the images in parallel. Results are cached
+///        in the sidecar file, an entry is reused while the image has the
+///        same modification time and file size, entries of files not in
+///        paths are dropped. Files of unknown formats are decoded with OpenCV.
+/// \param paths[in]      : image file paths
+/// \param cache_file[in] : sidecar cache file, it's created if missing
+/// \ret Sizes in the order of paths, missing or broken images have empty size
+std::vector<ImageSize> GetImageSizes(const std::vector<std::string> &paths,
+                                     const std::string &cache_file);
@@ -2,6 +2,121 @@
 #include "debug.h"
 #include "nnutils.h"
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+// Polygon edge going down, x is the crossing at y_top
+struct Edge
+{
+  float y_top{0};
+  float y_bottom{0};
+  float x{0};
+  float dx{0};
+};
+
+template <typename T>
+void FillEdges(std::vector<Edge> &edges, T value, cv::Mat &mask)
+{
+  std::sort(edges.begin(), edges.end(),
+            [](const Edge &a, const Edge &b) { return a.y_top < b.y_top; });
+  std::vector<Edge> active;
+  std::vector<float> crossings;
+  size_t next = 0;
+  int row = std::max(0, static_cast<int>(std::ceil(edges.front().y_top)));
+  for (; row < mask.rows; ++row)
+  {
+    auto y = static_cast<float>(row);
+    // edges cover [y_top, y_bottom), so shared vertices are counted once
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [y](const Edge &e) { return e.y_bottom <= y; }),
+                 active.end());
+    for (; next < edges.size() && edges[next].y_top <= y; ++next)
+    {
+      if (edges[next].y_bottom > y)
+        active.push_back(edges[next]);
+    }
+    if (active.empty())
+    {
+      if (next == edges.size())
+        break;
+      continue;
+    }
+
+    crossings.clear();
+    for (const auto &e : active)
+      crossings.push_back(e.x + (y - e.y_top) * e.dx);
+    std::sort(crossings.begin(), crossings.end());
+
+    // pixel centers are sampled in [x1, x2), boundary pixels are added by
+    // the outline
+    T *pixels = mask.ptr<T>(row);
+    for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+    {
+      auto x1 = std::max(0, static_cast<int>(std::ceil(crossings[i])));
+      auto x2 =
+          std::min(mask.cols, static_cast<int>(std::ceil(crossings[i + 1])));
+      if (x1 < x2)
+        std::fill(pixels + x1, pixels + x2, value);
+    }
+  }
+}
+
+// Sets the pixels the segment passes through, the same as cv::line with
+// 8-connectivity for integer end points
+template <typename T>
+void DrawSegment(const cv::Point2f &p1, const cv::Point2f &p2, T value,
+                 cv::Mat &mask)
+{
+  auto steps = static_cast<int>(
+      std::ceil(std::max(std::abs(p2.x - p1.x), std::abs(p2.y - p1.y))));
+  for (int i = 0; i <= steps; ++i)
+  {
+    auto t = steps > 0 ? static_cast<float>(i) / steps : 0.f;
+    auto x = static_cast<int>(std::lround(p1.x + (p2.x - p1.x) * t));
+    auto y = static_cast<int>(std::lround(p1.y + (p2.y - p1.y) * t));
+    if (x >= 0 && x < mask.cols && y >= 0 && y < mask.rows)
+      mask.ptr<T>(y)[x] = value;
+  }
+}
+
+template <typename T>
+void Fill(std::vector<Edge> &edges,
+          const std::vector<std::pair<cv::Point2f, cv::Point2f>> &outline,
+          T value,
+          cv::Mat &mask)
+{
+  if (!edges.empty())
+    FillEdges<T>(edges, value, mask);
+  // the outline covers polygons thinner than a pixel too
+  for (const auto &segment : outline)
+    DrawSegment<T>(segment.first, segment.second, value, mask);
+}
+
+cv::Rect GetMiniMaskRect(const std::vector<float> &boxes,
+                         size_t index,
+                         const cv::Size &size)
+{
+  auto b_ind = index * 4;
+  auto y1 = static_cast<int32_t>(boxes[b_ind]);
+  auto x1 = static_cast<int32_t>(boxes[b_ind + 1]);
+  auto y2 = static_cast<int32_t>(boxes[b_ind + 2]);
+  auto x2 = static_cast<int32_t>(boxes[b_ind + 3]);
+  auto m_rect = cv::Rect(cv::Point(0, 0), size);
+  auto crop_rect = cv::Rect(x1, y1, x2 - x1, y2 - y1);
+  auto rect = m_rect & crop_rect;
+  if (rect.empty())
+  {
+    std::cerr << "Dataset: Invalid bounding box with area of zero "
+              << crop_rect << " \n";
+    rect = m_rect;
+  }
+  return rect;
+}
+} // namespace
+
 cv::Mat LoadImage(const std::string path)
 {
   cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
@@ -99,18 +214,16 @@ std::tuple<cv::Mat, Window, float, Padding> ResizeImage(cv::Mat image,
 cv::Mat ConvertPolygonToMask(const std::vector<int32_t> &polygon,
                              const cv::Size &size)
 {
-  cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
-  std::size_t c_idx = 0;
-  std::vector<std::vector<cv::Point>> contours(1);
-  auto len = polygon.size() / 2;
-  for (size_t i = 0; i < len; ++i)
-  {
-    auto p_idx = i * 2;
-    contours[0].push_back(cv::Point(polygon[p_idx], polygon[p_idx + 1]));
-  }
-
-  cv::drawContours(mask, contours, -1, cv::Scalar(255), cv::FILLED);
+  return ConvertPolygonToMask(polygon.data(), polygon.size(), size);
+}
 
+cv::Mat ConvertPolygonToMask(const int32_t *polygon, size_t count,
+                             const cv::Size &size)
+{
+  PolygonRasterizer rasterizer;
+  rasterizer.AddPolygon(polygon, count);
+  cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+  rasterizer.Render(MaskTransform(), mask);
   return mask;
 }
 
@@ -300,24 +413,122 @@ std::vector<cv::Mat> MinimizeMasks(const std::vector<float> &boxes,
   size_t i = 0;
   for (auto &m : masks)
   {
-    auto b_ind = i * 4;
-    auto y1 = static_cast<int32_t>(boxes[b_ind]);
-    auto x1 = static_cast<int32_t>(boxes[b_ind + 1]);
-    auto y2 = static_cast<int32_t>(boxes[b_ind + 2]);
-    auto x2 = static_cast<int32_t>(boxes[b_ind + 3]);
-    auto m_rect = cv::Rect(cv::Point(0, 0), m.size());
-    auto crop_rect = cv::Rect(x1, y1, x2 - x1, y2 - y1);
-    auto m_crop = m(m_rect & crop_rect);
-    if (m_crop.empty())
-    {
-      std::cerr << "Dataset: Invalid bounding box with area of zero "
-                << crop_rect << " \n";
-      m_crop = m;
-    }
+    cv::Mat m_crop = m(GetMiniMaskRect(boxes, i, m.size()));
     m_crop.convertTo(m_crop, CV_32FC1);
     cv::resize(m_crop, m_crop, mini_shape, cv::INTER_LINEAR);
     cv::threshold(m_crop, m_crop, 127, 1, cv::THRESH_BINARY);
     mini_masks.push_back(m_crop);
+    ++i;
+  }
+  return mini_masks;
+}
+
+MaskTransform MaskTransform::Resize(float scale, const Padding &padding)
+{
+  // cv::resize maps pixel centers as (x + 0.5) * scale - 0.5
+  MaskTransform transform;
+  transform.scale_x = scale;
+  transform.shift_x = 0.5f * scale - 0.5f + padding.left_pad;
+  transform.scale_y = scale;
+  transform.shift_y = 0.5f * scale - 0.5f + padding.top_pad;
+  return transform;
+}
+
+MaskTransform MaskTransform::Crop(const cv::Rect &rect,
+                                  const cv::Size &size) const
+{
+  auto kx = static_cast<float>(size.width) / rect.width;
+  auto ky = static_cast<float>(size.height) / rect.height;
+  MaskTransform transform;
+  transform.scale_x = scale_x * kx;
+  transform.shift_x = (shift_x - rect.x + 0.5f) * kx - 0.5f;
+  transform.scale_y = scale_y * ky;
+  transform.shift_y = (shift_y - rect.y + 0.5f) * ky - 0.5f;
+  return transform;
+}
+
+void PolygonRasterizer::Render(const MaskTransform &transform,
+                               cv::Mat &mask) const
+{
+  std::vector<Edge> edges;
+  edges.reserve(points_.size());
+  std::vector<std::pair<cv::Point2f, cv::Point2f>> outline;
+  outline.reserve(points_.size());
+  size_t first = 0;
+  for (auto last : polygons_)
+  {
+    for (size_t i = first; i < last; ++i)
+    {
+      // the polygon is closed by the edge from the last point to the first
+      const auto &a = points_[i];
+      const auto &b = points_[i + 1 < last ? i + 1 : first];
+      cv::Point2f p1(a.x * transform.scale_x + transform.shift_x,
+                     a.y * transform.scale_y + transform.shift_y);
+      cv::Point2f p2(b.x * transform.scale_x + transform.shift_x,
+                     b.y * transform.scale_y + transform.shift_y);
+      outline.emplace_back(p1, p2);
+      if (p1.y == p2.y)
+        continue;
+      if (p1.y > p2.y)
+        std::swap(p1, p2);
+      Edge edge;
+      edge.y_top = p1.y;
+      edge.y_bottom = p2.y;
+      edge.x = p1.x;
+      edge.dx = (p2.x - p1.x) / (p2.y - p1.y);
+      edges.push_back(edge);
+    }
+    first = last;
+  }
+  if (outline.empty())
+    return;
+
+  if (mask.type() == CV_8UC1)
+    Fill<uchar>(edges, outline, 255, mask);
+  else if (mask.type() == CV_32FC1)
+    Fill<float>(edges, outline, 1.f, mask);
+  else
+    throw std::invalid_argument("PolygonRasterizer: Unsupported mask format");
+}
+
+std::vector<cv::Mat> RenderMasks(
+    const std::vector<PolygonRasterizer> &instances,
+    float scale,
+    const Padding &padding,
+    const cv::Size &size)
+{
+  auto transform = MaskTransform::Resize(scale, padding);
+  std::vector<cv::Mat> masks(instances.size());
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    masks[i] = cv::Mat::zeros(size, CV_8UC1);
+    instances[i].Render(transform, masks[i]);
+  }
+  return masks;
+}
+
+std::vector<cv::Mat> RenderMiniMasks(
+    const std::vector<PolygonRasterizer> &instances,
+    float scale,
+    const Padding &padding,
+    const cv::Size &size,
+    const std::vector<float> &boxes,
+    int32_t width,
+    int32_t height)
+{
+  auto transform = MaskTransform::Resize(scale, padding);
+  cv::Size mini_shape(width, height);
+  std::vector<cv::Rect> rects(instances.size());
+  for (size_t i = 0; i < instances.size(); ++i)
+    rects[i] = GetMiniMaskRect(boxes, i, size);
+
+  std::vector<cv::Mat> mini_masks(instances.size());
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    mini_masks[i] = cv::Mat::zeros(mini_shape, CV_32FC1);
+    instances[i].Render(transform.Crop(rects[i], mini_shape), mini_masks[i]);
   }
   return mini_masks;
 }
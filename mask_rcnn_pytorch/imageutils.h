@@ -13,6 +13,10 @@ at::Tensor CvImageToTensor(const cv::Mat& image);
 cv::Mat ConvertPolygonToMask(const std::vector<int32_t> &polygon,
                                   const cv::Size &size);
 
+// `polygon` has `count` values of x, y pairs
+cv::Mat ConvertPolygonToMask(const int32_t *polygon, size_t count,
+                             const cv::Size &size);
+
 struct Window {
   int32_t y1{0};
   int32_t x1{0};
@@ -87,6 +91,76 @@ std::vector<cv::Mat> MinimizeMasks(const std::vector<float>& boxes,
                                    int32_t width,
                                    int32_t height);
 
+/*
+ * Maps polygon coordinates to mask pixels: u = x * scale_x + shift_x,
+ * v = y * scale_y + shift_y. A pixel is filled if its center is inside the
+ * transformed polygon or the polygon outline passes through it, as
+ * cv::drawContours with cv::FILLED does.
+ */
+struct MaskTransform {
+  float scale_x{1.f};
+  float shift_x{0.f};
+  float scale_y{1.f};
+  float shift_y{0.f};
+
+  // Samples pixels as ResizeMasks does with the same scale and padding
+  static MaskTransform Resize(float scale, const Padding& padding);
+  // Appends the crop of `rect` (in the transformed pixels) resized to `size`
+  MaskTransform Crop(const cv::Rect& rect, const cv::Size& size) const;
+};
+
+/*
+ * Scanline rasterizer of an instance, which can consist of several polygons.
+ * Polygons are filled with the even-odd rule directly at the final scale, so
+ * there is no need in the full resolution mask.
+ */
+class PolygonRasterizer {
+ public:
+  // `coords` has `count` values of x, y pairs
+  template <typename T>
+  void AddPolygon(const T* coords, size_t count) {
+    for (size_t i = 0; i + 1 < count; i += 2)
+      points_.emplace_back(static_cast<float>(coords[i]),
+                           static_cast<float>(coords[i + 1]));
+    polygons_.push_back(points_.size());
+  }
+
+  bool IsEmpty() const { return points_.empty(); }
+
+  // Fills the instance into CV_8UC1 mask with 255 or CV_32FC1 mask with 1
+  void Render(const MaskTransform& transform, cv::Mat& mask) const;
+
+ private:
+  std::vector<cv::Point2f> points_;
+  // end of every polygon in points_
+  std::vector<size_t> polygons_;
+};
+
+/*
+ * The same as ResizeMasks for the masks of the instances, but every mask is
+ * rendered at the final size. Instances are rendered in parallel.
+ * size: resized image size including the padding
+ */
+std::vector<cv::Mat> RenderMasks(
+    const std::vector<PolygonRasterizer>& instances,
+    float scale,
+    const Padding& padding,
+    const cv::Size& size);
+
+/*
+ * The same as MinimizeMasks applied to RenderMasks results, but every
+ * instance is rendered right into the width x height mini mask of its box.
+ * Instances are rendered in parallel.
+ */
+std::vector<cv::Mat> RenderMiniMasks(
+    const std::vector<PolygonRasterizer>& instances,
+    float scale,
+    const Padding& padding,
+    const cv::Size& size,
+    const std::vector<float>& boxes,
+    int32_t width,
+    int32_t height);
+
 /*
  * Takes RGB images with 0-255 values and subtraces
  * the mean pixel and converts it to float. Expects image
@@ -0,0 +1,240 @@
+#include "inferenceserver.h"
+#include "nnutils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+struct InferenceServer::Request {
+  cv::Mat image;
+  std::promise<InferenceResult> promise;
+  std::chrono::steady_clock::time_point submit_time;
+  at::Tensor molded_image;
+  ImageMeta image_meta;
+  Window window;
+};
+
+namespace {
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void PushWindowed(std::deque<double>& values, double value, size_t window) {
+  values.push_back(value);
+  while (values.size() > window)
+    values.pop_front();
+}
+}  // namespace
+
+InferenceServer::InferenceServer(MaskRCNN model,
+                                 std::shared_ptr<const Config> config,
+                                 const InferenceServerOptions& options)
+    : model_(model),
+      config_(config),
+      options_(options),
+      start_time_(std::chrono::steady_clock::now()) {
+  if (options_.max_batch_size == 0)
+    throw std::invalid_argument("Max batch size should be positive");
+  auto workers_num = std::max(options_.worker_threads, 1u);
+  for (uint32_t i = 0; i < workers_num; ++i)
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  model_thread_ = std::thread([this]() { ModelLoop(); });
+}
+
+InferenceServer::~InferenceServer() {
+  Stop();
+}
+
+std::future<InferenceResult> InferenceServer::Submit(const cv::Mat& image) {
+  if (image.empty() || image.type() != CV_8UC3)
+    throw std::invalid_argument("Image should be 8-bit with 3 channels");
+  auto request = std::make_shared<Request>();
+  request->image = image;
+  request->submit_time = std::chrono::steady_clock::now();
+  auto result = request->promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    if (stop_model_)
+      throw std::logic_error("Inference server is stopped");
+    if (!config_->image_padding) {
+      if (image_size_.empty())
+        image_size_ = image.size();
+      else if (image.size() != image_size_)
+        throw std::invalid_argument(
+            "Images of different sizes can't be batched without padding");
+    }
+    ++molding_;
+  }
+  Post([this, request]() { Mold(request); });
+  return result;
+}
+
+void InferenceServer::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    if (stopped_)
+      return;
+    stopped_ = true;
+    stop_model_ = true;
+  }
+  batch_cv_.notify_all();
+  // The model thread exits when all the requests are molded and run, then
+  // workers finish unmolding
+  model_thread_.join();
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    stop_workers_ = true;
+  }
+  tasks_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void InferenceServer::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  tasks_cv_.notify_one();
+}
+
+void InferenceServer::WorkerLoop() {
+  torch::NoGradGuard no_grad;
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(tasks_mutex_);
+      tasks_cv_.wait(lock, [this] { return stop_workers_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void InferenceServer::Mold(std::shared_ptr<Request> request) {
+  try {
+    auto [images, image_metas, windows] =
+        MoldInputs({request->image}, *config_);
+    request->molded_image = images;
+    request->image_meta = image_metas.front();
+    request->window = windows.front();
+  } catch (...) {
+    Fail(request, std::current_exception());
+    {
+      std::lock_guard<std::mutex> lock(batch_mutex_);
+      --molding_;
+    }
+    batch_cv_.notify_all();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    molded_.push_back(request);
+    --molding_;
+  }
+  batch_cv_.notify_all();
+}
+
+void InferenceServer::ModelLoop() {
+  torch::NoGradGuard no_grad;
+  while (true) {
+    std::vector<std::shared_ptr<Request>> batch;
+    {
+      std::unique_lock<std::mutex> lock(batch_mutex_);
+      auto drained = [this] { return stop_model_ && molding_ == 0; };
+      batch_cv_.wait(lock, [&] { return !molded_.empty() || drained(); });
+      if (molded_.empty())
+        return;
+      // Wait for other requests up to the latency budget of the first one,
+      // there is nothing to wait for if the server is stopping
+      auto deadline = molded_.front()->submit_time + options_.max_batch_delay;
+      batch_cv_.wait_until(lock, deadline, [&] {
+        return molded_.size() >= options_.max_batch_size || drained();
+      });
+      auto count = std::min<size_t>(molded_.size(), options_.max_batch_size);
+      batch.assign(molded_.begin(), molded_.begin() + count);
+      molded_.erase(molded_.begin(), molded_.begin() + count);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    // requests with posted Unmold tasks are completed by the workers
+    size_t posted = 0;
+    try {
+      std::vector<at::Tensor> images;
+      std::vector<ImageMeta> image_metas;
+      for (auto& request : batch) {
+        images.push_back(request->molded_image);
+        image_metas.push_back(request->image_meta);
+      }
+      auto results = model_->DetectBatch(torch::cat(images, 0), image_metas);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        auto [detections, mrcnn_mask] = results[i];
+        auto request = batch[i];
+        Post([this, request, detections = detections,
+              mrcnn_mask = mrcnn_mask]() {
+          Unmold(request, detections, mrcnn_mask);
+        });
+        ++posted;
+      }
+    } catch (...) {
+      for (size_t i = posted; i < batch.size(); ++i)
+        Fail(batch[i], std::current_exception());
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++batches_;
+    batched_images_ += batch.size();
+    PushWindowed(batch_times_, ElapsedMs(start), options_.latency_window);
+  }
+}
+
+void InferenceServer::Unmold(std::shared_ptr<Request> request,
+                             at::Tensor detections,
+                             at::Tensor mrcnn_mask) {
+  InferenceResult result;
+  try {
+    if (!is_empty(detections)) {
+      std::tie(result.boxes, result.class_ids, result.scores, result.masks) =
+          UnmoldDetections(detections[0], mrcnn_mask[0], request->image.size(),
+                           request->window, options_.mask_threshold);
+    }
+  } catch (...) {
+    Fail(request, std::current_exception());
+    return;
+  }
+  request->promise.set_value(std::move(result));
+  Complete(*request);
+}
+
+void InferenceServer::Fail(std::shared_ptr<Request> request,
+                           std::exception_ptr error) {
+  request->promise.set_exception(error);
+  Complete(*request);
+}
+
+void InferenceServer::Complete(const Request& request) {
+  auto latency = ElapsedMs(request.submit_time);
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  ++requests_;
+  PushWindowed(latencies_, latency, options_.latency_window);
+}
+
+InferenceStats InferenceServer::GetStats() const {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  InferenceStats stats;
+  stats.requests = requests_;
+  stats.batches = batches_;
+  if (batches_ > 0)
+    stats.mean_batch_size = static_cast<double>(batched_images_) / batches_;
+  auto elapsed = ElapsedMs(start_time_) / 1000.;
+  if (elapsed > 0)
+    stats.throughput = requests_ / elapsed;
+  stats.latency = bench::GetPercentiles({latencies_.begin(), latencies_.end()});
+  stats.batch_time =
+      bench::GetPercentiles({batch_times_.begin(), batch_times_.end()});
+  return stats;
+}
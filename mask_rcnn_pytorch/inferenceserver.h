@@ -0,0 +1,129 @@
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include "../benchutils.h"
+#include "config.h"
+#include "imageutils.h"
+#include "maskrcnn.h"
+
+#include <torch/torch.h>
+#include <opencv2/opencv.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct InferenceServerOptions {
+  // Largest number of images run through the network at once
+  uint32_t max_batch_size{4};
+  // How long the first request of a batch waits for others to join it
+  std::chrono::microseconds max_batch_delay{std::chrono::milliseconds(5)};
+  // Threads molding images and unmolding detections
+  uint32_t worker_threads{2};
+  double mask_threshold{0.5};
+  // Number of the last requests used for the latency percentiles
+  size_t latency_window{10000};
+};
+
+// Detections of one image in the original image coordinates
+struct InferenceResult {
+  at::Tensor boxes;
+  at::Tensor class_ids;
+  at::Tensor scores;
+  std::vector<cv::Mat> masks;
+};
+
+struct InferenceStats {
+  uint64_t requests{0};
+  uint64_t batches{0};
+  double mean_batch_size{0};
+  // Completed requests per second since the server start
+  double throughput{0};
+  // Milliseconds from Submit to the result
+  bench::Percentiles latency;
+  // Milliseconds of the network run per batch
+  bench::Percentiles batch_time;
+};
+
+/*
+ * In-process inference service sharing one model between concurrent
+ * callers. Requests go through a pipeline: workers mold images, the model
+ * thread collects molded images into batches and runs DetectBatch, workers
+ * unmold detections and fulfill the futures. So preparing the next batch
+ * and post-processing the previous one overlap with the network run.
+ * A batch is started when it's full or when its first request has waited
+ * max_batch_delay.
+ */
+class InferenceServer {
+ public:
+  // The model should be loaded, moved to the device and not used elsewhere
+  InferenceServer(MaskRCNN model,
+                  std::shared_ptr<const Config> config,
+                  const InferenceServerOptions& options = {});
+  InferenceServer(const InferenceServer&) = delete;
+  InferenceServer& operator=(const InferenceServer&) = delete;
+  ~InferenceServer();
+
+  // Thread safe, the image is copied by reference and shouldn't be changed.
+  // Throws std::invalid_argument for an empty or not 8-bit 3 channel image.
+  // Without image_padding molded images keep the aspect ratio, so only
+  // images of the first image size are accepted, they are batched together.
+  std::future<InferenceResult> Submit(const cv::Mat& image);
+
+  InferenceStats GetStats() const;
+
+  // Finishes submitted requests and stops the threads
+  void Stop();
+
+ private:
+  struct Request;
+
+  void Post(std::function<void()> task);
+  void WorkerLoop();
+  void ModelLoop();
+  void Mold(std::shared_ptr<Request> request);
+  void Unmold(std::shared_ptr<Request> request,
+              at::Tensor detections,
+              at::Tensor mrcnn_mask);
+  void Fail(std::shared_ptr<Request> request, std::exception_ptr error);
+  void Complete(const Request& request);
+
+ private:
+  MaskRCNN model_;
+  std::shared_ptr<const Config> config_;
+  InferenceServerOptions options_;
+  std::chrono::steady_clock::time_point start_time_;
+
+  std::vector<std::thread> workers_;
+  std::thread model_thread_;
+
+  std::mutex tasks_mutex_;
+  std::condition_variable tasks_cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stop_workers_{false};
+
+  std::mutex batch_mutex_;
+  std::condition_variable batch_cv_;
+  std::deque<std::shared_ptr<Request>> molded_;
+  // requests submitted and not molded yet, the model thread waits for them
+  size_t molding_{0};
+  // size of all the images if they aren't padded to the same size
+  cv::Size image_size_;
+  bool stop_model_{false};
+  bool stopped_{false};
+
+  mutable std::mutex stats_mutex_;
+  uint64_t requests_{0};
+  uint64_t batches_{0};
+  uint64_t batched_images_{0};
+  std::deque<double> latencies_;
+  std::deque<double> batch_times_;
+};
+
+#endif  // INFERENCESERVER_H
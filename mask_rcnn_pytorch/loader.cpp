@@ -1,10 +1,10 @@
+#include <algorithm>
 #include <set>
 #include "loader.h"
 
 Loader::Loader()
 {
     this->image_ids_ = std::vector<std::uint64_t>();
-    this->image_infos_ = std::vector<ImageInfo>();
     this->class_infos_ = std::vector<ClassInfo>();
     this->has_mask_ = true;
     this->source_class_ids_ = std::unordered_map<std::string, std::vector<std::size_t>>();
@@ -22,7 +22,7 @@ void Loader::Prepare()
         this->class_ids_.push_back(i);
     }
 
-    this->num_images_ = this->image_infos_.size();
+    this->num_images_ = this->GetImagesCount();
     for (std::uint32_t i = 0; i < this->num_images_; ++i)
     {
         this->image_ids_.push_back(i);
@@ -34,9 +34,10 @@ void Loader::Prepare()
         this->class_from_source_map_[key] = this->class_ids_[i];
     }
 
-    for (int i = 0; i < this->image_infos_.size(); ++i)
+    for (std::size_t i = 0; i < this->num_images_; ++i)
     {
-        std::string key = this->image_infos_[i].source + this->image_infos_[i].id;
+        std::string key(this->GetImageSource(i));
+        key += this->strings_pool_.c_str() + this->image_id_offsets_[i];
         this->image_from_source_map_[key] = this->image_ids_[i];
     }
 
@@ -75,19 +76,84 @@ void Loader::AddClass(const std::string &source, const std::uint16_t &class_id,
     this->class_infos_.push_back(ClassInfo(source, class_id, class_name));
 }
 
-std::string Loader::ImageReference(const std::uint64_t &image_id)
+std::string_view Loader::ImageReference(const std::uint64_t &image_id)
 {
     return {};
 }
 
-void Loader::AddImage(ImageInfo &image_info)
+void Loader::AddImage(const ImageInfo &image_info)
 {
-    this->image_infos_.push_back(image_info);
+    this->image_id_offsets_.push_back(this->strings_pool_.size());
+    this->strings_pool_.append(image_info.id).push_back('\0');
+    this->image_path_offsets_.push_back(this->strings_pool_.size());
+    this->strings_pool_.append(image_info.path).push_back('\0');
+
+    auto source = std::find(this->image_sources_.begin(), this->image_sources_.end(), image_info.source);
+    if (source == this->image_sources_.end())
+        source = this->image_sources_.insert(source, image_info.source);
+    this->image_source_.push_back(static_cast<std::uint16_t>(source - this->image_sources_.begin()));
+
+    this->image_widths_.push_back(image_info.width);
+    this->image_heights_.push_back(image_info.height);
+    this->image_has_mask_.push_back(image_info.has_mask);
+
+    for (std::size_t c = 0; c < image_info.GetContoursCount(); ++c)
+        this->contour_offsets_.push_back(this->coordinates_.size() + image_info.contour_offsets[c + 1]);
+    // coordinates after the last contour end (an unclosed contour of a
+    // malformed field) would be taken by the first contour of the next image
+    auto coordinates_end = std::min<std::size_t>(image_info.contour_offsets.back(), image_info.coordinates.size());
+    this->coordinates_.insert(this->coordinates_.end(), image_info.coordinates.begin(),
+                              image_info.coordinates.begin() + static_cast<std::ptrdiff_t>(coordinates_end));
+    this->image_contours_.push_back(this->contour_offsets_.size() - 1);
+
+    this->instance_class_ids_.insert(this->instance_class_ids_.end(), image_info.class_ids.begin(),
+                                     image_info.class_ids.end());
+    this->image_class_ids_.push_back(this->instance_class_ids_.size());
 }
 
 std::size_t Loader::GetImagesCount() const
 {
-    return this->image_infos_.size();
+    return this->image_widths_.size();
+}
+
+std::string_view Loader::GetImagePath(const std::uint64_t &image_id) const
+{
+    return this->strings_pool_.c_str() + this->image_path_offsets_[image_id];
+}
+
+std::string_view Loader::GetImageSource(const std::uint64_t &image_id) const
+{
+    return this->image_sources_[this->image_source_[image_id]];
+}
+
+std::uint16_t Loader::GetImageWidth(const std::uint64_t &image_id) const
+{
+    return this->image_widths_[image_id];
+}
+
+std::uint16_t Loader::GetImageHeight(const std::uint64_t &image_id) const
+{
+    return this->image_heights_[image_id];
+}
+
+bool Loader::ImageHasMask(const std::uint64_t &image_id) const
+{
+    return this->image_has_mask_[image_id] != 0;
+}
+
+std::size_t Loader::GetContoursCount(const std::uint64_t &image_id) const
+{
+    return this->image_contours_[image_id + 1] - this->image_contours_[image_id];
+}
+
+Span<std::int32_t> Loader::GetContour(const std::uint64_t &image_id, std::size_t contour) const
+{
+    return GetSpan(this->coordinates_, this->contour_offsets_, this->image_contours_[image_id] + contour);
+}
+
+Span<std::int32_t> Loader::GetInstanceClassIds(const std::uint64_t &image_id) const
+{
+    return GetSpan(this->instance_class_ids_, this->image_class_ids_, image_id);
 }
 
 std::size_t Loader::MapSourceClassId(const std::string &source_class_id)
@@ -102,7 +168,7 @@ std::uint16_t Loader::SourceClassId(const std::uint16_t &class_id, const std::st
     return info->id;
 }
 
-std::vector<std::uint64_t> Loader::GetImageIds() const
+const std::vector<std::uint64_t> &Loader::GetImageIds() const
 {
     return this->image_ids_;
 }
@@ -117,14 +183,14 @@ void Loader::SetHasMask(bool &value)
     this->has_mask_ = value;
 }
 
-std::string Loader::SourceImageLink(const std::uint64_t &image_id)
+std::string_view Loader::SourceImageLink(const std::uint64_t &image_id) const
 {
-    return this->image_infos_[image_id].path;
+    return this->GetImagePath(image_id);
 }
 
 cv::Mat Loader::LoadImage(const std::uint64_t &image_id)
 {
-    cv::Mat image = cv::imread(image_infos_[image_id].path, cv::IMREAD_COLOR);
+    cv::Mat image = cv::imread(this->strings_pool_.c_str() + this->image_path_offsets_[image_id], cv::IMREAD_COLOR);
     cv::Mat temp = image;
 
     if (image.channels() == 2)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
@@ -18,22 +19,39 @@ struct ClassInfo
     ClassInfo(std::string s, std::uint16_t i, std::string c) : source(s), id(i), class_name(c) {}
 };
 
-/// \brief Image information read from the
+/// \brief Read only view of the contiguous array
+template <typename T>
+struct Span
+{
+    const T *first{nullptr};
+    const T *last{nullptr};
+
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    const T *data() const { return first; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    bool empty() const { return first == last; }
+    const T &operator[](std::size_t i) const { return first[i]; }
+};
+
+/// \brief Image information read from the annotations, the loader copies it
+///        to the flat storage
 struct ImageInfo
 {
-    std::vector<std::vector<std::int32_t>> contours;
+    /// x, y pairs of all the contours
+    std::vector<std::int32_t> coordinates{};
+    /// contour i takes coordinates [contour_offsets[i], contour_offsets[i + 1])
+    std::vector<std::uint32_t> contour_offsets{0};
+    /// class of every contour
+    std::vector<std::int32_t> class_ids{};
     std::string id{};
     std::string source{};
     std::string path{};
-    std::string class_ids{};
     std::uint16_t width{0};
     std::uint16_t height{0};
     bool has_mask{false};
 
-    void AddContourCoordinates(float v)
-    {
-        contours.back().push_back(static_cast<std::int32_t>(v));
-    }
+    std::size_t GetContoursCount() const { return contour_offsets.size() - 1; }
 };
 
 class Loader
@@ -41,19 +59,30 @@ class Loader
   public:
     Loader();
     void AddClass(const std::string &source, const std::uint16_t &class_id, const std::string &class_name);
-    void AddImage(ImageInfo &image_info);
+    void AddImage(const ImageInfo &image_info);
 
     void Prepare();
     std::size_t MapSourceClassId(const std::string &source_class_id);
     std::uint16_t SourceClassId(const std::uint16_t &class_id, const std::string &source);
-    std::vector<std::uint64_t> GetImageIds() const;
+    const std::vector<std::uint64_t> &GetImageIds() const;
     bool HasMask() const;
     void SetHasMask(bool &value);
     std::size_t GetImagesCount() const;
-    std::string SourceImageLink(const std::uint64_t &image_id);
+    std::string_view SourceImageLink(const std::uint64_t &image_id) const;
     cv::Mat LoadImage(const std::uint64_t &image_id);
 
-    virtual std::string ImageReference(const std::uint64_t &image_id);
+    /// \brief Image annotations accessors, they don't copy or allocate
+    std::string_view GetImagePath(const std::uint64_t &image_id) const;
+    std::string_view GetImageSource(const std::uint64_t &image_id) const;
+    std::uint16_t GetImageWidth(const std::uint64_t &image_id) const;
+    std::uint16_t GetImageHeight(const std::uint64_t &image_id) const;
+    bool ImageHasMask(const std::uint64_t &image_id) const;
+    std::size_t GetContoursCount(const std::uint64_t &image_id) const;
+    /// \brief x, y pairs of the contour
+    Span<std::int32_t> GetContour(const std::uint64_t &image_id, std::size_t contour) const;
+    Span<std::int32_t> GetInstanceClassIds(const std::uint64_t &image_id) const;
+
+    virtual std::string_view ImageReference(const std::uint64_t &image_id);
     virtual void LoadData() = 0;
     virtual std::pair<std::vector<cv::Mat>, std::vector<std::int32_t>> LoadMask(const std::uint64_t &image_id) = 0;
     virtual std::pair<std::uint32_t, std::vector<float>> LoadBBox(const std::uint64_t &image_id) = 0;
@@ -62,7 +91,6 @@ class Loader
   protected:
     std::vector<std::uint64_t> image_ids_;
     std::vector<std::uint16_t> class_ids_;
-    std::vector<ImageInfo> image_infos_;
     std::vector<ClassInfo> class_infos_;
     std::unordered_map<std::string, std::uint16_t> class_id_from_class_name_map_;
     std::unordered_map<std::string, std::vector<std::size_t>> source_class_ids_;
@@ -73,4 +101,34 @@ class Loader
     bool has_mask_;
     size_t num_classes_;
     size_t num_images_;
+
+  private:
+    /// \brief Span of the image in the `offsets` indexed array
+    template <typename T, typename Offset>
+    static Span<T> GetSpan(const std::vector<T> &values,
+                           const std::vector<Offset> &offsets,
+                           std::size_t index)
+    {
+        return {values.data() + offsets[index], values.data() + offsets[index + 1]};
+    }
+
+    // ----------- Images annotations, structure of arrays indexed by image id
+    /// zero terminated ids and paths, offsets point to their beginnings
+    std::string strings_pool_;
+    std::vector<std::size_t> image_id_offsets_;
+    std::vector<std::size_t> image_path_offsets_;
+    /// index in image_sources_
+    std::vector<std::uint16_t> image_source_;
+    std::vector<std::string> image_sources_;
+    std::vector<std::uint16_t> image_widths_;
+    std::vector<std::uint16_t> image_heights_;
+    std::vector<char> image_has_mask_;
+    /// contours of image i are [image_contours_[i], image_contours_[i + 1])
+    std::vector<std::size_t> image_contours_{0};
+    /// coordinates of contour c are [contour_offsets_[c], contour_offsets_[c + 1])
+    std::vector<std::size_t> contour_offsets_{0};
+    std::vector<std::int32_t> coordinates_;
+    /// class ids of image i are [image_class_ids_[i], image_class_ids_[i + 1])
+    std::vector<std::size_t> image_class_ids_{0};
+    std::vector<std::int32_t> instance_class_ids_;
 };
\ No newline at end of file
@@ -57,8 +57,13 @@ at::Tensor ComputeMrcnnClassLoss(at::Tensor target_class_ids,
                                  at::Tensor pred_class_logits) {
   at::Tensor loss;
   if (!is_empty(target_class_ids)) {
+    // Padding ROIs have -1 class ids, the sum is divided on the device to
+    // avoid reading the number of ROIs back
+    auto valid_count = (target_class_ids >= 0).sum().to(at::kFloat);
     loss = torch::nll_loss(pred_class_logits.log_softmax(1),
-                           target_class_ids.to(at::dtype(at::kLong)));
+                           target_class_ids.to(at::dtype(at::kLong)), {},
+                           at::Reduction::Sum, /*ignore_index*/ -1) /
+           valid_count.clamp_min(1);
   } else {
     loss = torch::tensor(0.f, at::dtype(at::kFloat).requires_grad(false));
     if (target_class_ids.is_cuda())
@@ -74,23 +79,19 @@ at::Tensor ComputeMrcnnBBoxLoss(at::Tensor target_bbox,
   at::Tensor loss;
   if (!is_empty(target_class_ids)) {
     // Only positive ROIs contribute to the loss. And only
-    // the right class_id of each ROI. Get their indicies.
-    auto positive_ix = torch::nonzero(target_class_ids > 0).narrow(1, 0, 1);
-    auto positive_class_ids =
-        target_class_ids.take(positive_ix).to(at::dtype(at::kLong));
-    auto indices = torch::stack({positive_ix, positive_class_ids}, /*dim*/ 1);
-
-    // Gather the masks (predicted and true) that contribute to loss
-    auto y_ind = indices.narrow(1, 0, 1).squeeze();
-    auto x_ind = indices.narrow(1, 1, 1).squeeze();
-
-    // Gather the deltas (predicted and true) that contribute to loss
-    target_bbox = target_bbox.index(y_ind);
-    pred_bbox = pred_bbox.index({y_ind, x_ind});
-
-    // Smooth L1 loss
-    auto box_target = torch::broadcast_tensors({pred_bbox, target_bbox});
-    loss = torch::smooth_l1_loss(box_target[0], box_target[1]);
+    // the right class_id of each ROI. They are masked instead of selected,
+    // so the number of positive ROIs isn't read back from the device.
+    auto positive = (target_class_ids > 0).to(at::kFloat);
+    auto class_ids = target_class_ids.clamp_min(0).to(at::dtype(at::kLong));
+
+    // Gather the deltas predicted for the ROI classes
+    pred_bbox = pred_bbox.gather(
+        1, class_ids.view({-1, 1, 1}).expand({pred_bbox.size(0), 1, 4}));
+    pred_bbox = pred_bbox.squeeze(1);
+
+    // Smooth L1 loss, mean over the positive ROIs deltas
+    loss = torch::smooth_l1_loss(pred_bbox, target_bbox, at::Reduction::None);
+    loss = (loss.sum(1) * positive).sum() / (positive.sum().clamp_min(1) * 4);
   } else {
     loss = torch::tensor(0.f, at::dtype(at::kFloat).requires_grad(false));
     if (target_class_ids.is_cuda())
@@ -105,21 +106,25 @@ at::Tensor ComputeMrcnnMaskLoss(at::Tensor target_masks,
   at::Tensor loss;
   if (!is_empty(target_class_ids)) {
     // Only positive ROIs contribute to the loss. And only
-    // the class specific mask of each ROI.
-    auto positive_ix = torch::nonzero(target_class_ids > 0).narrow(1, 0, 1);
-    auto positive_class_ids =
-        target_class_ids.take(positive_ix).to(at::dtype(at::kLong));
-    auto indices = torch::stack({positive_ix, positive_class_ids}, /*dim*/ 1);
-
-    // Gather the masks (predicted and true) that contribute to loss
-    auto y_ind = indices.narrow(1, 0, 1).squeeze();
-    auto x_ind = indices.narrow(1, 1, 1).squeeze();
-
-    auto y_true = target_masks.index(y_ind);
-    auto y_pred = pred_masks.index({y_ind, x_ind});
-
-    // Binary cross entropy
-    loss = torch::binary_cross_entropy(y_pred, y_true);
+    // the class specific mask of each ROI. They are masked instead of
+    // selected, so the number of positive ROIs isn't read back.
+    auto positive = (target_class_ids > 0).to(at::kFloat);
+    auto class_ids = target_class_ids.clamp_min(0).to(at::dtype(at::kLong));
+
+    // Gather the masks predicted for the ROI classes
+    auto height = pred_masks.size(2);
+    auto width = pred_masks.size(3);
+    auto y_pred =
+        pred_masks
+            .gather(1, class_ids.view({-1, 1, 1, 1})
+                           .expand({pred_masks.size(0), 1, height, width}))
+            .squeeze(1);
+
+    // Binary cross entropy, mean over the positive ROIs pixels
+    loss = torch::binary_cross_entropy(y_pred, target_masks, {},
+                                       at::Reduction::None);
+    loss = (loss.sum({1, 2}) * positive).sum() /
+           (positive.sum().clamp_min(1) * static_cast<float>(height * width));
   } else {
     loss = torch::tensor(0.f, at::dtype(at::kFloat).requires_grad(false));
     if (target_class_ids.is_cuda())
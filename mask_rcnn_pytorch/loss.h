@@ -23,7 +23,7 @@ torch::Tensor ComputeRpnBBoxLoss(torch::Tensor target_bbox,
                                  torch::Tensor rpn_bbox);
 
 /* Loss for the classifier head of Mask RCNN.
- * target_class_ids: [batch, num_rois]. Integer class IDs. Uses zero
+ * target_class_ids: [batch, num_rois]. Integer class IDs. Uses -1
  *   padding to fill in the array.
  * pred_class_logits: [batch, num_rois, num_classes]
  */
@@ -8,20 +8,19 @@ MaskImpl::MaskImpl(uint32_t depth,
                    uint32_t pool_size,
                    const std::vector<int32_t>& image_shape,
                    uint32_t num_classes)
-    : padding_(/*kernel_size*/ 3, /*stride*/ 1),
-      conv1_(torch::nn::Conv2dOptions(depth, 256, 3).stride(1)),
+    // 3x3 convolutions pad by 1 to keep the size, same as SamePad2d(3, 1)
+    : conv1_(torch::nn::Conv2dOptions(depth, 256, 3).stride(1).padding(1)),
       bn1_(torch::nn::BatchNormOptions(256).eps(0.001)),
-      conv2_(torch::nn::Conv2dOptions(256, 256, 3).stride(1)),
+      conv2_(torch::nn::Conv2dOptions(256, 256, 3).stride(1).padding(1)),
       bn2_(torch::nn::BatchNormOptions(256).eps(0.001)),
-      conv3_(torch::nn::Conv2dOptions(256, 256, 3).stride(1)),
+      conv3_(torch::nn::Conv2dOptions(256, 256, 3).stride(1).padding(1)),
       bn3_(torch::nn::BatchNormOptions(256).eps(0.001)),
-      conv4_(torch::nn::Conv2dOptions(256, 256, 3).stride(1)),
+      conv4_(torch::nn::Conv2dOptions(256, 256, 3).stride(1).padding(1)),
       bn4_(torch::nn::BatchNormOptions(256).eps(0.001)),
       conv5_(torch::nn::Conv2dOptions(256, num_classes, 1).stride(1)),
       deconv_(Deconv()),
       pool_size_(pool_size),
       image_shape_(image_shape) {
-  register_module("padding", padding_);
   register_module("conv1", conv1_);
   register_module("bn1", bn1_);
   register_module("conv2", conv2_);
@@ -38,18 +37,25 @@ torch::Tensor MaskImpl::forward(std::vector<torch::Tensor> feature_maps,
                                 at::Tensor rois) {
   feature_maps.insert(feature_maps.begin(), rois);
   auto x = PyramidRoiAlign(feature_maps, pool_size_, image_shape_);
-  x = conv1_->forward(padding_->forward(x));
-  x = bn1_->forward(x);
-  x = torch::relu(x);
-  x = conv2_->forward(padding_->forward(x));
-  x = bn2_->forward(x);
-  x = torch::relu(x);
-  x = conv3_->forward(padding_->forward(x));
-  x = bn3_->forward(x);
-  x = torch::relu(x);
-  x = conv4_->forward(padding_->forward(x));
-  x = bn4_->forward(x);
-  x = torch::relu(x);
+  if (fused_) {
+    x = conv1_->forward(x).relu_();
+    x = conv2_->forward(x).relu_();
+    x = conv3_->forward(x).relu_();
+    x = conv4_->forward(x).relu_();
+  } else {
+    x = conv1_->forward(x);
+    x = bn1_->forward(x);
+    x = torch::relu(x);
+    x = conv2_->forward(x);
+    x = bn2_->forward(x);
+    x = torch::relu(x);
+    x = conv3_->forward(x);
+    x = bn3_->forward(x);
+    x = torch::relu(x);
+    x = conv4_->forward(x);
+    x = bn4_->forward(x);
+    x = torch::relu(x);
+  }
   x = deconv_->forward(x);
   x = torch::relu(x);
   x = conv5_->forward(x);
@@ -58,6 +64,16 @@ torch::Tensor MaskImpl::forward(std::vector<torch::Tensor> feature_maps,
   return x;
 }
 
+void MaskImpl::Fuse() {
+  if (fused_)
+    return;
+  FoldBatchNorm(*conv1_, *bn1_);
+  FoldBatchNorm(*conv2_, *bn2_);
+  FoldBatchNorm(*conv3_, *bn3_);
+  FoldBatchNorm(*conv4_, *bn4_);
+  fused_ = true;
+}
+
 DeconvImpl::DeconvImpl() {
   conv_trans_weights_ = torch::zeros({256, 256, 2, 2}, torch::requires_grad());
   conv_trans_weights_ = torch::nn::init::xavier_uniform_(conv_trans_weights_);
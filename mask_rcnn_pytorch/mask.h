@@ -31,8 +31,10 @@ class MaskImpl : public torch::nn::Module {
   torch::Tensor forward(std::vector<torch::Tensor> feature_maps,
                         torch::Tensor rois);
 
+  // Folds batch norms into convolutions, used for inference only
+  void Fuse();
+
  private:
-  SamePad2d padding_{nullptr};
   torch::nn::Conv2d conv1_{nullptr};
   torch::nn::BatchNorm bn1_{nullptr};
   torch::nn::Conv2d conv2_{nullptr};
@@ -46,6 +48,7 @@ class MaskImpl : public torch::nn::Module {
 
   uint32_t pool_size_{0};
   std::vector<int32_t> image_shape_;
+  bool fused_{false};
 };
 
 TORCH_MODULE(Mask);
@@ -42,11 +42,27 @@ std::tuple<at::Tensor, at::Tensor> MaskRCNNImpl::Detect(
   return {detections, mrcnn_mask};
 }
 
+void MaskRCNNImpl::PrepareInference() {
+  if (inference_only_)
+    return;
+  eval();
+  torch::NoGradGuard no_grad;
+  for (auto& p : parameters())
+    p.set_requires_grad(false);
+  fpn_->Fuse();
+  rpn_->Fuse();
+  classifier_->Fuse();
+  mask_->Fuse();
+  inference_only_ = true;
+}
+
 void MaskRCNNImpl::Train(VehicleDataset train_dataset,
                          VehicleDataset val_dataset,
                          double learning_rate,
                          uint32_t epochs,
                          std::string layers_regex) {
+  if (inference_only_)
+    throw std::logic_error("Model prepared for inference can't be trained");
   // Pre-defined layer regular expressions
   // clang-format off
   std::map<std::string, std::string> layers_regex_map = {
@@ -360,6 +376,20 @@ MaskRCNNImpl::ComputeLosses(torch::Tensor rpn_match,
 
 std::tuple<std::vector<at::Tensor>, at::Tensor, at::Tensor, at::Tensor>
 MaskRCNNImpl::PredictRPN(at::Tensor images, int64_t proposal_count) {
+  auto [mrcnn_feature_maps, scores, deltas, class_logits] =
+      PredictFeatures(images);
+
+  // Generate proposals
+  // Proposals are [batch, N, (y1, x1, y2, x2)] in normalized coordinates
+  // and zero padded.
+  auto rpn_rois = ProposalLayer({scores, deltas}, proposal_count,
+                                config_->rpn_nms_threshold, anchors_, *config_);
+
+  return {mrcnn_feature_maps, rpn_rois, class_logits, deltas};
+}
+
+std::tuple<std::vector<at::Tensor>, at::Tensor, at::Tensor, at::Tensor>
+MaskRCNNImpl::PredictFeatures(at::Tensor images) {
   // Feature extraction
   auto [p2_out, p3_out, p4_out, p5_out, p6_out] = fpn_->forward(images);
 
@@ -379,16 +409,10 @@ MaskRCNNImpl::PredictRPN(at::Tensor images, int64_t proposal_count) {
     rpn_bbox.push_back(bbox);
   }
 
-  // Generate proposals
-  // Proposals are [batch, N, (y1, x1, y2, x2)] in normalized coordinates
-  // and zero padded.
   auto scores = torch::cat(rpn_class, 1);
   auto deltas = torch::cat(rpn_bbox, 1);
-  auto rpn_rois = ProposalLayer({scores, deltas}, proposal_count,
-                                config_->rpn_nms_threshold, anchors_, *config_);
-
   auto class_logits = torch::cat(rpn_class_logits, 1);
-  return {mrcnn_feature_maps, rpn_rois, class_logits, deltas};
+  return {mrcnn_feature_maps, scores, deltas, class_logits};
 }
 
 std::tuple<at::Tensor,
@@ -434,7 +458,8 @@ MaskRCNNImpl::PredictTraining(at::Tensor images,
   // Generate detection targets
   // Subsamples proposals and generates target outputs for training
   // Note that proposal class IDs, gt_boxes, and gt_masks are zero
-  // padded. Equally, returned rois and targets are zero padded.
+  // padded. Returned rois and targets have fixed size and are zero padded,
+  // padding class IDs are -1.
   auto [rois, target_class_ids, target_deltas, target_mask] =
       DetectionTargetLayer(*config_, rpn_rois, gt_class_ids, gt_boxes,
                            gt_masks);
@@ -479,7 +504,44 @@ std::tuple<at::Tensor, at::Tensor> MaskRCNNImpl::PredictInference(
 
   auto [mrcnn_feature_maps, rpn_rois, rpn_class_logits, rpn_bbox] =
       PredictRPN(images, config_->post_nms_rois_inference);
+  return PredictDetections(mrcnn_feature_maps, rpn_rois, image_metas);
+}
 
+std::vector<std::tuple<at::Tensor, at::Tensor>> MaskRCNNImpl::DetectBatch(
+    at::Tensor images,
+    const std::vector<ImageMeta>& image_metas) {
+  if (images.size(0) != static_cast<int64_t>(image_metas.size()))
+    throw std::invalid_argument("Images and image metas counts differ");
+  eval();
+  // The backbone and the RPN run for the whole batch, proposal and
+  // detection layers support only one image, so heads run per image.
+  auto [mrcnn_feature_maps, scores, deltas, class_logits] =
+      PredictFeatures(images);
+
+  std::vector<std::tuple<at::Tensor, at::Tensor>> results;
+  for (int64_t i = 0; i < images.size(0); ++i) {
+    auto rpn_rois = ProposalLayer(
+        {scores.narrow(0, i, 1), deltas.narrow(0, i, 1)},
+        config_->post_nms_rois_inference, config_->rpn_nms_threshold,
+        anchors_, *config_);
+    std::vector<at::Tensor> feature_maps;
+    for (auto& map : mrcnn_feature_maps)
+      feature_maps.push_back(map.narrow(0, i, 1));
+
+    auto [detections, mrcnn_mask] = PredictDetections(
+        feature_maps, rpn_rois, {image_metas[static_cast<size_t>(i)]});
+    detections = detections.cpu();
+    if (!is_empty(mrcnn_mask))
+      mrcnn_mask = mrcnn_mask.permute({0, 1, 3, 4, 2}).cpu();
+    results.emplace_back(detections, mrcnn_mask);
+  }
+  return results;
+}
+
+std::tuple<at::Tensor, at::Tensor> MaskRCNNImpl::PredictDetections(
+    std::vector<at::Tensor> mrcnn_feature_maps,
+    at::Tensor rpn_rois,
+    const std::vector<ImageMeta>& image_metas) {
   // Network Heads
   // Proposal classifier and BBox regressor heads
   auto [mrcnn_class_logits, mrcnn_class, mrcnn_bbox] =
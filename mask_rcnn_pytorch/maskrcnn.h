@@ -30,6 +30,21 @@ class MaskRCNNImpl : public torch::nn::Module {
       at::Tensor images,
       const std::vector<ImageMeta>& image_metas);
 
+  /* Runs the detection pipeline for a batch of images of the same size.
+   * The backbone and the RPN process the whole batch at once.
+   * Returns Detect results for every image, in the order of images.
+   */
+  std::vector<std::tuple<at::Tensor, at::Tensor>> DetectBatch(
+      at::Tensor images,
+      const std::vector<ImageMeta>& image_metas);
+
+  /* Prepares the model for inference: folds batch norms into convolution
+   * weights and applies ReLU in place. Call it after the weights are loaded
+   * and the model is moved to the device, the model can't be trained or
+   * saved afterwards.
+   */
+  void PrepareInference();
+
   /*
    * Train the model.
    * train_dataset, val_dataset: Training and validation Dataset objects.
@@ -76,6 +91,16 @@ class MaskRCNNImpl : public torch::nn::Module {
   std::tuple<std::vector<at::Tensor>, at::Tensor, at::Tensor, at::Tensor>
   PredictRPN(at::Tensor images, int64_t proposal_count);
 
+  // Returns classifier feature maps, RPN scores, deltas and class logits
+  std::tuple<std::vector<at::Tensor>, at::Tensor, at::Tensor, at::Tensor>
+  PredictFeatures(at::Tensor images);
+
+  // Runs classifier and mask heads for one image
+  std::tuple<at::Tensor, at::Tensor> PredictDetections(
+      std::vector<at::Tensor> mrcnn_feature_maps,
+      at::Tensor rpn_rois,
+      const std::vector<ImageMeta>& image_metas);
+
   std::tuple<at::Tensor, at::Tensor> PredictInference(
       at::Tensor images,
       const std::vector<ImageMeta>& image_metas);
@@ -118,6 +143,7 @@ class MaskRCNNImpl : public torch::nn::Module {
   RPN rpn_{nullptr};
   Classifier classifier_{nullptr};
   Mask mask_{nullptr};
+  bool inference_only_{false};
 };
 
 TORCH_MODULE(MaskRCNN);
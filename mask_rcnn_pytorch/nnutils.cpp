@@ -29,24 +29,53 @@ at::Tensor SamePad2dImpl::forward(at::Tensor input) {
   auto pad_along_height =
       ((out_height - 1) * stride_ + kernel_size_ - in_height);
 
-  auto pad_left = static_cast<uint32_t>(std::floor(pad_along_width / 2));
-  auto pad_top = static_cast<uint32_t>(std::floor(pad_along_height / 2));
-  auto pad_right = static_cast<uint32_t>(pad_along_width - pad_left);
-  auto pad_bottom = static_cast<uint32_t>(pad_along_height - pad_top);
-
-  at::Tensor top = at::zeros(
-      {input.size(0), input.size(1), input.size(2), pad_top}, input.type());
-  at::Tensor bottom = at::zeros(
-      {input.size(0), input.size(1), input.size(2), pad_bottom}, input.type());
-  input = at::cat({top, input, bottom}, 3);
-
-  at::Tensor left = at::zeros(
-      {input.size(0), input.size(1), pad_left, input.size(3)}, input.type());
-  at::Tensor right = at::zeros(
-      {input.size(0), input.size(1), pad_right, input.size(3)}, input.type());
-  input = at::cat({left, input, right}, 2);
-
-  return input;
+  auto pad_left = static_cast<int64_t>(std::floor(pad_along_width / 2));
+  auto pad_top = static_cast<int64_t>(std::floor(pad_along_height / 2));
+  auto pad_right = static_cast<int64_t>(pad_along_width) - pad_left;
+  auto pad_bottom = static_cast<int64_t>(pad_along_height) - pad_top;
+
+  // Single allocation and copy, pads are given from the last dimension
+  return at::constant_pad_nd(input, {pad_top, pad_bottom, pad_left, pad_right},
+                             /*value*/ 0);
+}
+
+int64_t SamePad2dImpl::GetConvPadding() const {
+  // With stride 1 the padding is kernel_size - 1 for any input size, it's
+  // split equally for odd kernels only
+  if (stride_ != 1 || kernel_size_ % 2 == 0)
+    return -1;
+  return static_cast<int64_t>(kernel_size_ / 2);
+}
+
+bool FoldSamePadding(torch::nn::Conv2dImpl& conv,
+                     const SamePad2dImpl& padding) {
+  auto conv_padding = padding.GetConvPadding();
+  if (conv_padding < 0)
+    return false;
+  conv.options.padding(conv_padding);
+  return true;
+}
+
+void FoldBatchNorm(torch::nn::Conv2dImpl& conv,
+                   const torch::nn::BatchNormImpl& bn) {
+  if (!bn.running_mean.defined() || !bn.running_variance.defined())
+    throw std::runtime_error("Can't fold batch norm without running stats");
+  torch::NoGradGuard no_grad;
+  // bn(conv(x)) = (w * x + b - mean) * gamma / sqrt(var + eps) + beta
+  auto scale = (bn.running_variance + bn.options.eps()).rsqrt();
+  if (bn.weight.defined())
+    scale = scale * bn.weight;
+  auto bias = conv.bias.defined() ? conv.bias - bn.running_mean
+                                  : -bn.running_mean;
+  bias = bias * scale;
+  if (bn.bias.defined())
+    bias = bias + bn.bias;
+
+  conv.weight.mul_(scale.view({-1, 1, 1, 1}));
+  if (conv.bias.defined())
+    conv.bias.copy_(bias);
+  else
+    conv.bias = conv.register_parameter("bias", bias);
 }
 
 at::Tensor upsample(at::Tensor x, float scale_factor) {
@@ -18,6 +18,12 @@ bool is_empty(at::Tensor x);
  */
 void ClipGradNorm(std::vector<at::Tensor> parameters, float max_norm);
 
+/* Folds an inference mode batch norm applied to the convolution output into
+ * the convolution weights and bias, the batch norm is skipped afterwards.
+ */
+void FoldBatchNorm(torch::nn::Conv2dImpl& conv,
+                   const torch::nn::BatchNormImpl& bn);
+
 at::Tensor upsample(at::Tensor x, float scale_factor);
 at::Tensor unique1d(at::Tensor tensor);
 at::Tensor intersect1d(at::Tensor tensor1, at::Tensor tensor2);
@@ -29,6 +35,11 @@ class SamePad2dImpl : public torch::nn::Module {
 
   torch::Tensor forward(torch::Tensor input);
 
+  /* Returns the padding a convolution can apply instead of this module, or
+   * -1 if the padding is asymmetric or depends on the input size.
+   */
+  int64_t GetConvPadding() const;
+
  private:
   uint32_t kernel_size_{0};
   uint32_t stride_{0};
@@ -36,4 +47,9 @@ class SamePad2dImpl : public torch::nn::Module {
 
 TORCH_MODULE(SamePad2d);
 
+/* Moves the padding into the convolution options, returns false if the
+ * padding can't be done by the convolution and SamePad2d is still required.
+ */
+bool FoldSamePadding(torch::nn::Conv2dImpl& conv, const SamePad2dImpl& padding);
+
 #endif  // NNUTILS_H
@@ -86,8 +86,8 @@ BottleneckImpl::BottleneckImpl(uint32_t inplanes,
                                torch::nn::Sequential downsample)
     : conv1_{torch::nn::Conv2dOptions(inplanes, planes, 1).stride(stride)},
       bn1_{torch::nn::BatchNormOptions(planes).eps(0.001).momentum(0.01)},
-      padding2_(/*kernel_size*/ 3, /*stride*/ 1),
-      conv2_{torch::nn::Conv2dOptions(planes, planes, 3)},
+      // pads by 1 to keep the size, same as SamePad2d(3, 1)
+      conv2_{torch::nn::Conv2dOptions(planes, planes, 3).padding(1)},
       bn2_{torch::nn::BatchNormOptions(planes).eps(0.001).momentum(0.01)},
       conv3_{torch::nn::Conv2dOptions(planes, planes * 4, 1)},
       bn3_{torch::nn::BatchNormOptions(planes * 4).eps(0.001).momentum(0.01)},
@@ -95,7 +95,6 @@ BottleneckImpl::BottleneckImpl(uint32_t inplanes,
       downsample_{downsample} {
   register_module("conv1", conv1_);
   register_module("bn1", bn1_);
-  register_module("padding2", padding2_);
   register_module("conv2", conv2_);
   register_module("bn2", bn2_);
   register_module("conv3", conv3_);
@@ -106,13 +105,23 @@ BottleneckImpl::BottleneckImpl(uint32_t inplanes,
 }
 
 at::Tensor BottleneckImpl::forward(at::Tensor x) {
+  if (fused_) {
+    at::Tensor out = conv1_->forward(x).relu_();
+    out = conv2_->forward(out).relu_();
+    out = conv3_->forward(out);
+    if (downsample_)
+      out += downsample_->at<torch::nn::Conv2dImpl>(0).forward(x);
+    else
+      out += x;
+    return out.relu_();
+  }
+
   auto residual = x;
 
   at::Tensor out = conv1_->forward(x);
   out = bn1_->forward(out);
   out = relu_->forward(out);
 
-  out = padding2_->forward(out);
   out = conv2_->forward(out);
   out = bn2_->forward(out);
   out = relu_->forward(out);
@@ -128,3 +137,15 @@ at::Tensor BottleneckImpl::forward(at::Tensor x) {
 
   return out;
 }
+
+void BottleneckImpl::Fuse() {
+  if (fused_)
+    return;
+  FoldBatchNorm(*conv1_, *bn1_);
+  FoldBatchNorm(*conv2_, *bn2_);
+  FoldBatchNorm(*conv3_, *bn3_);
+  if (downsample_)
+    FoldBatchNorm(downsample_->at<torch::nn::Conv2dImpl>(0),
+                  downsample_->at<torch::nn::BatchNormImpl>(1));
+  fused_ = true;
+}
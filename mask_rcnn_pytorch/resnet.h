@@ -18,16 +18,19 @@ class BottleneckImpl : public torch::nn::Module {
 
   torch::Tensor forward(torch::Tensor x);
 
+  // Folds batch norms into convolutions, used for inference only
+  void Fuse();
+
  private:
   torch::nn::Conv2d conv1_{nullptr};
   torch::nn::BatchNorm bn1_{nullptr};
-  SamePad2d padding2_{nullptr};
   torch::nn::Conv2d conv2_{nullptr};
   torch::nn::BatchNorm bn2_{nullptr};
   torch::nn::Conv2d conv3_{nullptr};
   torch::nn::BatchNorm bn3_{nullptr};
   torch::nn::Functional relu_{nullptr};
   torch::nn::Sequential downsample_{nullptr};
+  bool fused_{false};
 };
 
 TORCH_MODULE(Bottleneck);
@@ -0,0 +1,126 @@
+#include <math.h>
+#include <stdio.h>
+#include "mask_targets_kernel.h"
+
+#define CUDA_1D_KERNEL_LOOP(i, n)                            \
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < n; \
+       i += blockDim.x * gridDim.x)
+
+__global__ void MaskTargetsKernel(const int nthreads,
+                                  const float* masks_ptr,
+                                  const float* rois_ptr,
+                                  const float* gt_boxes_ptr,
+                                  const int* roi_gt_index_ptr,
+                                  int num_gt,
+                                  int image_height,
+                                  int image_width,
+                                  bool use_mini_mask,
+                                  int mask_height,
+                                  int mask_width,
+                                  float* targets_ptr) {
+  CUDA_1D_KERNEL_LOOP(out_idx, nthreads) {
+    // out_idx = w + mask_width * (h + mask_height * b)
+    int idx = out_idx;
+    const int x = idx % mask_width;
+    idx /= mask_width;
+    const int y = idx % mask_height;
+    const int b = idx / mask_height;
+
+    targets_ptr[out_idx] = 0;
+    const int g = roi_gt_index_ptr[b];
+    if (g < 0 || g >= num_gt) {
+      continue;
+    }
+
+    float y1 = rois_ptr[b * 4];
+    float x1 = rois_ptr[b * 4 + 1];
+    float y2 = rois_ptr[b * 4 + 2];
+    float x2 = rois_ptr[b * 4 + 3];
+    if (use_mini_mask) {
+      // normalized image space to normalized mini-mask space
+      const float* gt_box = gt_boxes_ptr + g * 4;
+      const float gt_h = gt_box[2] - gt_box[0];
+      const float gt_w = gt_box[3] - gt_box[1];
+      y1 = (y1 - gt_box[0]) / gt_h;
+      x1 = (x1 - gt_box[1]) / gt_w;
+      y2 = (y2 - gt_box[0]) / gt_h;
+      x2 = (x2 - gt_box[1]) / gt_w;
+    }
+
+    const float height_scale =
+        (mask_height > 1) ? (y2 - y1) * (image_height - 1) / (mask_height - 1)
+                          : 0;
+    const float width_scale =
+        (mask_width > 1) ? (x2 - x1) * (image_width - 1) / (mask_width - 1)
+                         : 0;
+
+    const float in_y = (mask_height > 1)
+                           ? y1 * (image_height - 1) + y * height_scale
+                           : 0.5 * (y1 + y2) * (image_height - 1);
+    if (in_y < 0 || in_y > image_height - 1) {
+      continue;
+    }
+
+    const float in_x = (mask_width > 1)
+                           ? x1 * (image_width - 1) + x * width_scale
+                           : 0.5 * (x1 + x2) * (image_width - 1);
+    if (in_x < 0 || in_x > image_width - 1) {
+      continue;
+    }
+
+    const int top_y_index = floorf(in_y);
+    const int bottom_y_index = ceilf(in_y);
+    const float y_lerp = in_y - top_y_index;
+
+    const int left_x_index = floorf(in_x);
+    const int right_x_index = ceilf(in_x);
+    const float x_lerp = in_x - left_x_index;
+
+    const float* pimage = masks_ptr + g * image_height * image_width;
+    const float top_left = pimage[top_y_index * image_width + left_x_index];
+    const float top_right = pimage[top_y_index * image_width + right_x_index];
+    const float bottom_left =
+        pimage[bottom_y_index * image_width + left_x_index];
+    const float bottom_right =
+        pimage[bottom_y_index * image_width + right_x_index];
+
+    const float top = top_left + (top_right - top_left) * x_lerp;
+    const float bottom = bottom_left + (bottom_right - bottom_left) * x_lerp;
+    const float value = top + (bottom - top) * y_lerp;
+    // same as rounding the value, halves are rounded to even
+    targets_ptr[out_idx] = value > 0.5f ? 1.f : 0.f;
+  }
+}
+
+void MaskTargetsLauncher(const float* masks_ptr,
+                         const float* rois_ptr,
+                         const float* gt_boxes_ptr,
+                         const int* roi_gt_index_ptr,
+                         int num_rois,
+                         int num_gt,
+                         int image_height,
+                         int image_width,
+                         bool use_mini_mask,
+                         int mask_height,
+                         int mask_width,
+                         float* targets_ptr) {
+  const int total_count = num_rois * mask_height * mask_width;
+  const int thread_per_block = 512;
+  const int block_count =
+      (total_count + thread_per_block - 1) / thread_per_block;
+  cudaError_t err;
+
+  if (total_count > 0) {
+    MaskTargetsKernel<<<block_count, thread_per_block, 0>>>(
+        total_count, masks_ptr, rois_ptr, gt_boxes_ptr, roi_gt_index_ptr,
+        num_gt, image_height, image_width, use_mini_mask, mask_height,
+        mask_width, targets_ptr);
+
+    err = cudaGetLastError();
+    if (cudaSuccess != err) {
+      fprintf(stderr, "cudaCheckError() failed : %s\n",
+              cudaGetErrorString(err));
+      exit(-1);
+    }
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef _MaskTargets_Kernel
+#define _MaskTargets_Kernel
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void MaskTargetsLauncher(const float* masks_ptr,
+                         const float* rois_ptr,
+                         const float* gt_boxes_ptr,
+                         const int* roi_gt_index_ptr,
+                         int num_rois,
+                         int num_gt,
+                         int image_height,
+                         int image_width,
+                         bool use_mini_mask,
+                         int mask_height,
+                         int mask_width,
+                         float* targets_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
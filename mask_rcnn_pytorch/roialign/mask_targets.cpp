@@ -0,0 +1,137 @@
+#include "mask_targets.h"
+#include <math.h>
+#include <omp.h>
+#include <torch/torch.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void mask_targets_forward(at::Tensor masks,
+                          at::Tensor rois,
+                          at::Tensor gt_boxes,
+                          at::Tensor roi_gt_index,
+                          const bool use_mini_mask,
+                          const int mask_height,
+                          const int mask_width,
+                          at::Tensor targets) {
+  masks = masks.contiguous();
+  rois = rois.contiguous();
+  gt_boxes = gt_boxes.contiguous();
+  roi_gt_index = roi_gt_index.contiguous();
+
+  const int num_gt = masks.size(0);
+  const int image_height = masks.size(1);
+  const int image_width = masks.size(2);
+  const int num_rois = rois.size(0);
+  const int image_elements = image_height * image_width;
+  const int target_elements = mask_height * mask_width;
+
+  // init output space
+  targets.resize_({num_rois, mask_height, mask_width});
+  targets.zero_();
+
+  const float* masks_data = masks.data<float>();
+  const float* rois_data = rois.data<float>();
+  const float* gt_boxes_data = gt_boxes.data<float>();
+  const int* roi_gt_index_data = roi_gt_index.data<int>();
+  float* targets_data = targets.data<float>();
+
+  // indices are checked before the parallel loop, so an error can be thrown
+  for (int b = 0; b < num_rois; ++b) {
+    if (roi_gt_index_data[b] >= num_gt) {
+      throw std::out_of_range("mask_targets_forward: gt index " +
+                              std::to_string(roi_gt_index_data[b]) +
+                              " out of range [0, " + std::to_string(num_gt) +
+                              ")");
+    }
+  }
+
+#pragma omp parallel
+  {
+    // Columns are the same for all the rows of a ROI, out of range columns
+    // read the first pixel with zero weight, so the row loop has no branches.
+    // Buffers are allocated once per thread.
+    std::vector<int> left(mask_width);
+    std::vector<int> right(mask_width);
+    std::vector<float> x_lerp(mask_width);
+    std::vector<float> x_valid(mask_width);
+
+#pragma omp for schedule(dynamic)
+    for (int b = 0; b < num_rois; ++b) {
+      const int g = roi_gt_index_data[b];
+      if (g < 0) {
+        continue;
+      }
+
+      float y1 = rois_data[b * 4];
+      float x1 = rois_data[b * 4 + 1];
+      float y2 = rois_data[b * 4 + 2];
+      float x2 = rois_data[b * 4 + 3];
+      if (use_mini_mask) {
+        // Transform ROI corrdinates from normalized image space
+        // to normalized mini-mask space.
+        const float* gt_box = gt_boxes_data + g * 4;
+        const float gt_h = gt_box[2] - gt_box[0];
+        const float gt_w = gt_box[3] - gt_box[1];
+        y1 = (y1 - gt_box[0]) / gt_h;
+        x1 = (x1 - gt_box[1]) / gt_w;
+        y2 = (y2 - gt_box[0]) / gt_h;
+        x2 = (x2 - gt_box[1]) / gt_w;
+      }
+
+      const float height_scale =
+          (mask_height > 1) ? (y2 - y1) * (image_height - 1) / (mask_height - 1)
+                            : 0;
+      const float width_scale =
+          (mask_width > 1) ? (x2 - x1) * (image_width - 1) / (mask_width - 1)
+                           : 0;
+
+      for (int x = 0; x < mask_width; ++x) {
+        const float in_x = (mask_width > 1)
+                               ? x1 * (image_width - 1) + x * width_scale
+                               : 0.5 * (x1 + x2) * (image_width - 1);
+        const bool valid = in_x >= 0 && in_x <= image_width - 1;
+        left[x] = valid ? static_cast<int>(floorf(in_x)) : 0;
+        right[x] = valid ? static_cast<int>(ceilf(in_x)) : 0;
+        x_lerp[x] = valid ? in_x - left[x] : 0;
+        x_valid[x] = valid ? 1.f : 0.f;
+      }
+
+      const float* pimage = masks_data + g * image_elements;
+      float* ptarget = targets_data + b * target_elements;
+      const int* pleft = left.data();
+      const int* pright = right.data();
+      const float* px_lerp = x_lerp.data();
+      const float* px_valid = x_valid.data();
+
+      for (int y = 0; y < mask_height; ++y) {
+        const float in_y = (mask_height > 1)
+                               ? y1 * (image_height - 1) + y * height_scale
+                               : 0.5 * (y1 + y2) * (image_height - 1);
+        if (in_y < 0 || in_y > image_height - 1) {
+          continue;
+        }
+        const int top_y_index = floorf(in_y);
+        const int bottom_y_index = ceilf(in_y);
+        const float y_lerp = in_y - top_y_index;
+        const float* top_row = pimage + top_y_index * image_width;
+        const float* bottom_row = pimage + bottom_y_index * image_width;
+        float* target_row = ptarget + y * mask_width;
+
+#pragma omp simd
+        for (int x = 0; x < mask_width; ++x) {
+          const float top_left = top_row[pleft[x]];
+          const float top_right = top_row[pright[x]];
+          const float bottom_left = bottom_row[pleft[x]];
+          const float bottom_right = bottom_row[pright[x]];
+          const float top = top_left + (top_right - top_left) * px_lerp[x];
+          const float bottom =
+              bottom_left + (bottom_right - bottom_left) * px_lerp[x];
+          const float value = top + (bottom - top) * y_lerp;
+          // torch::round rounds halves to even, so 0.5 becomes 0
+          target_row[x] = value > 0.5f ? px_valid[x] : 0.f;
+        }
+      }
+    }
+  }
+}
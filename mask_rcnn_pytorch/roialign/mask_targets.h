@@ -0,0 +1,21 @@
+#include <torch/torch.h>
+
+/* Generates binary mask targets for the positive ROIs in one pass, GT masks
+ * are sampled in place instead of being gathered per ROI first. Sampling
+ * matches crop_and_resize_forward followed by rounding.
+ * masks: [num_gt, height, width] GT masks, mini masks if use_mini_mask
+ * rois: [num_rois, (y1, x1, y2, x2)] in normalized coordinates
+ * gt_boxes: [num_gt, (y1, x1, y2, x2)] in normalized coordinates, used to
+ *           transform ROIs to mini mask space
+ * roi_gt_index: [num_rois] int GT index of each ROI, ROIs with negative
+ *               index get zero targets
+ * targets: resized to [num_rois, mask_height, mask_width]
+ */
+void mask_targets_forward(at::Tensor masks,
+                          at::Tensor rois,
+                          at::Tensor gt_boxes,
+                          at::Tensor roi_gt_index,
+                          const bool use_mini_mask,
+                          const int mask_height,
+                          const int mask_width,
+                          at::Tensor targets);
@@ -0,0 +1,34 @@
+#include "mask_targets_gpu.h"
+#include <torch/torch.h>
+#include "cuda/mask_targets_kernel.h"
+
+void mask_targets_gpu_forward(at::Tensor masks,
+                              at::Tensor rois,
+                              at::Tensor gt_boxes,
+                              at::Tensor roi_gt_index,
+                              const bool use_mini_mask,
+                              const int mask_height,
+                              const int mask_width,
+                              at::Tensor targets) {
+  assert(masks.is_cuda());
+  assert(rois.is_cuda());
+  assert(gt_boxes.is_cuda());
+  assert(roi_gt_index.is_cuda());
+  assert(targets.is_cuda());
+
+  const int num_gt = masks.size(0);
+  const int image_height = masks.size(1);
+  const int image_width = masks.size(2);
+
+  const int num_rois = rois.size(0);
+
+  // init output space, the kernel writes every element
+  targets.resize_({num_rois, mask_height, mask_width});
+
+  MaskTargetsLauncher(masks.contiguous().data<float>(),
+                      rois.contiguous().data<float>(),
+                      gt_boxes.contiguous().data<float>(),
+                      roi_gt_index.contiguous().data<int>(), num_rois, num_gt,
+                      image_height, image_width, use_mini_mask, mask_height,
+                      mask_width, targets.data<float>());
+}
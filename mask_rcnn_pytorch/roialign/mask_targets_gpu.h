@@ -0,0 +1,11 @@
+#include <torch/torch.h>
+
+// CUDA version of mask_targets_forward, see mask_targets.h
+void mask_targets_gpu_forward(at::Tensor masks,
+                              at::Tensor rois,
+                              at::Tensor gt_boxes,
+                              at::Tensor roi_gt_index,
+                              const bool use_mini_mask,
+                              const int mask_height,
+                              const int mask_width,
+                              at::Tensor targets);
@@ -20,11 +20,17 @@ RPNImpl::RPNImpl(uint32_t anchors_per_location,
   register_module("relu", relu_);
   register_module("conv_class", conv_class_);
   register_module("conv_bbox", conv_bbox_);
+
+  // Padding depends on the feature map size if anchor stride isn't 1
+  padding_folded_ = FoldSamePadding(*conv_shared_, *padding_);
 }
 
 std::tuple<at::Tensor, at::Tensor, at::Tensor> RPNImpl::forward(at::Tensor x) {
   // Shared convolutional base of the RPN
-  x = relu_->forward(conv_shared_->forward(padding_->forward(x)));
+  if (!padding_folded_)
+    x = padding_->forward(x);
+  x = conv_shared_->forward(x);
+  x = fused_ ? x.relu_() : relu_->forward(x);
 
   // Anchor Score. [batch, anchors per location * 2, height, width].
   auto rpn_class_logits = conv_class_->forward(x);
@@ -48,3 +54,7 @@ std::tuple<at::Tensor, at::Tensor, at::Tensor> RPNImpl::forward(at::Tensor x) {
 
   return {rpn_class_logits, rpn_probs, rpn_bbox};
 }
+
+void RPNImpl::Fuse() {
+  fused_ = true;
+}
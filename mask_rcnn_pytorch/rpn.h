@@ -27,12 +27,17 @@ class RPNImpl : public torch::nn::Module {
   std::tuple<torch::Tensor, torch::Tensor, torch::Tensor> forward(
       torch::Tensor x);
 
+  // Applies ReLU in place, used for inference only
+  void Fuse();
+
  private:
   SamePad2d padding_{nullptr};
   torch::nn::Conv2d conv_shared_{nullptr};
   torch::nn::Functional relu_{nullptr};
   torch::nn::Conv2d conv_class_{nullptr};
   torch::nn::Conv2d conv_bbox_{nullptr};
+  bool padding_folded_{false};
+  bool fused_{false};
 };
 
 TORCH_MODULE(RPN);
@@ -0,0 +1,72 @@
+#include "catch.hpp"
+
+#include "../nnutils.h"
+#include "../resnet.h"
+
+namespace {
+void RandomizeBatchNorms(torch::nn::Module& module) {
+  torch::NoGradGuard no_grad;
+  for (auto& m : module.modules()) {
+    if (m->name().find("BatchNorm") == std::string::npos)
+      continue;
+    for (auto& p : m->parameters())
+      p.normal_(0, 0.5);
+    for (auto& buffer : m->named_buffers()) {
+      if (buffer.key().find("running_variance") != std::string::npos)
+        buffer.value().uniform_(0.5, 2);
+      else if (buffer.key().find("running_mean") != std::string::npos)
+        buffer.value().normal_(0, 0.5);
+    }
+  }
+}
+}  // namespace
+
+TEST_CASE("FoldBatchNorm keeps convolution output", "[fusion]") {
+  torch::manual_seed(0);
+  torch::nn::Conv2d conv(torch::nn::Conv2dOptions(4, 8, 3).stride(1));
+  torch::nn::BatchNorm bn(torch::nn::BatchNormOptions(8).eps(0.001));
+  RandomizeBatchNorms(*bn);
+  bn->eval();
+  auto x = torch::rand({2, 4, 9, 9});
+  auto expected = bn->forward(conv->forward(x));
+  FoldBatchNorm(*conv, *bn);
+  auto y = conv->forward(x);
+  REQUIRE(y.allclose(expected, /*rtol*/ 1e-4, /*atol*/ 1e-5));
+}
+
+TEST_CASE("SamePad2d folds into convolution for stride 1", "[fusion]") {
+  torch::manual_seed(0);
+  SamePad2d padding(/*kernel_size*/ 3, /*stride*/ 1);
+  torch::nn::Conv2d conv(torch::nn::Conv2dOptions(2, 2, 3).stride(1));
+  auto x = torch::rand({1, 2, 7, 7});
+  auto expected = conv->forward(padding->forward(x));
+  REQUIRE(FoldSamePadding(*conv, *padding));
+  REQUIRE(conv->forward(x).allclose(expected, 1e-5, 1e-6));
+
+  SamePad2d strided(/*kernel_size*/ 3, /*stride*/ 2);
+  REQUIRE(strided->GetConvPadding() == -1);
+  REQUIRE_FALSE(FoldSamePadding(*conv, *strided));
+}
+
+TEST_CASE("Fused Bottleneck matches original", "[fusion]") {
+  torch::manual_seed(0);
+  torch::nn::Sequential downsample(
+      torch::nn::Conv2d(torch::nn::Conv2dOptions(16, 32, 1).stride(2)),
+      torch::nn::BatchNorm(
+          torch::nn::BatchNormOptions(32).eps(0.001).momentum(0.01)));
+  Bottleneck block(/*inplanes*/ 16, /*planes*/ 8, /*stride*/ 2, downsample);
+  Bottleneck identity_block(/*inplanes*/ 32, /*planes*/ 8);
+  RandomizeBatchNorms(*block);
+  RandomizeBatchNorms(*identity_block);
+  block->eval();
+  identity_block->eval();
+
+  torch::NoGradGuard no_grad;
+  auto x = torch::rand({2, 16, 12, 12});
+  auto expected = identity_block->forward(block->forward(x));
+  block->Fuse();
+  identity_block->Fuse();
+  auto y = identity_block->forward(block->forward(x));
+  REQUIRE(y.sizes() == expected.sizes());
+  REQUIRE(y.allclose(expected, /*rtol*/ 1e-4, /*atol*/ 1e-4));
+}
@@ -0,0 +1,75 @@
+#include "catch.hpp"
+
+#include "../imageutils.h"
+
+TEST_CASE("PolygonRasterizer square", "[imageutils]") {
+  std::vector<int32_t> square{2, 2, 7, 2, 7, 7, 2, 7};
+  auto mask = ConvertPolygonToMask(square, cv::Size(10, 10));
+  REQUIRE(mask.type() == CV_8UC1);
+  // boundary is included as cv::drawContours does
+  REQUIRE(cv::countNonZero(mask) == 36);
+  REQUIRE(mask.at<uchar>(2, 2) == 255);
+  REQUIRE(mask.at<uchar>(7, 7) == 255);
+  REQUIRE(mask.at<uchar>(8, 7) == 0);
+  REQUIRE(mask.at<uchar>(7, 8) == 0);
+  REQUIRE(mask.at<uchar>(1, 2) == 0);
+}
+
+TEST_CASE("PolygonRasterizer thin polygons", "[imageutils]") {
+  std::vector<float> thin{1, 5.2f, 8, 5.2f, 8, 5.4f, 1, 5.4f};
+  PolygonRasterizer rasterizer;
+  rasterizer.AddPolygon(thin.data(), thin.size());
+  cv::Mat mask = cv::Mat::zeros(cv::Size(10, 10), CV_8UC1);
+  rasterizer.Render(MaskTransform(), mask);
+  REQUIRE(cv::countNonZero(mask) == 8);
+  REQUIRE(mask.at<uchar>(5, 4) == 255);
+
+  std::vector<int32_t> line{2, 3, 7, 3};
+  REQUIRE(cv::countNonZero(ConvertPolygonToMask(line, cv::Size(10, 10))) == 6);
+}
+
+TEST_CASE("PolygonRasterizer hole", "[imageutils]") {
+  std::vector<float> outer{0, 0, 10, 0, 10, 10, 0, 10};
+  std::vector<float> hole{3, 3, 7, 3, 7, 7, 3, 7};
+  PolygonRasterizer rasterizer;
+  rasterizer.AddPolygon(outer.data(), outer.size());
+  rasterizer.AddPolygon(hole.data(), hole.size());
+  cv::Mat mask = cv::Mat::zeros(cv::Size(12, 12), CV_32FC1);
+  rasterizer.Render(MaskTransform(), mask);
+  // the hole boundary belongs to the polygon
+  REQUIRE(cv::countNonZero(mask) == 121 - 9);
+  REQUIRE(mask.at<float>(1, 1) == Approx(1));
+  REQUIRE(mask.at<float>(3, 3) == Approx(1));
+  REQUIRE(mask.at<float>(5, 5) == Approx(0));
+}
+
+TEST_CASE("RenderMasks matches resized masks", "[imageutils]") {
+  std::vector<int32_t> triangle{8, 4, 150, 40, 40, 120};
+  cv::Size size(160, 128);
+  Padding padding{3, 3, 5, 5, 0, 0};
+  float scale = 2.f;
+
+  std::vector<PolygonRasterizer> instances(1);
+  instances[0].AddPolygon(triangle.data(), triangle.size());
+  cv::Size resized_size(static_cast<int>(size.width * scale) + 10,
+                        static_cast<int>(size.height * scale) + 6);
+  auto masks = RenderMasks(instances, scale, padding, resized_size);
+  auto expected = ResizeMasks({ConvertPolygonToMask(triangle, size)}, scale,
+                              padding);
+  REQUIRE(masks[0].size() == expected[0].size());
+
+  cv::Mat diff;
+  cv::compare(masks[0], expected[0] > 127, diff, cv::CMP_NE);
+  // only the boundary pixels can differ
+  REQUIRE(cv::countNonZero(diff) < cv::countNonZero(masks[0]) / 10);
+
+  std::vector<float> boxes{3 + 4 * scale, 5 + 8 * scale, 3 + 120 * scale,
+                           5 + 150 * scale};
+  auto mini_masks =
+      RenderMiniMasks(instances, scale, padding, resized_size, boxes, 28, 28);
+  auto expected_mini = MinimizeMasks(boxes, expected, 28, 28);
+  REQUIRE(mini_masks[0].type() == CV_32FC1);
+  REQUIRE(mini_masks[0].size() == cv::Size(28, 28));
+  cv::compare(mini_masks[0], expected_mini[0], diff, cv::CMP_NE);
+  REQUIRE(cv::countNonZero(diff) < cv::countNonZero(mini_masks[0]) / 10);
+}
@@ -0,0 +1,131 @@
+#include "catch.hpp"
+
+#include "../config.h"
+#include "../inferenceserver.h"
+#include "../maskrcnn.h"
+
+namespace {
+class TinyConfig : public Config {
+ public:
+  explicit TinyConfig(bool padding) {
+    gpu_count = 0;
+    images_per_gpu = 1;
+    num_classes = 3;
+    image_min_dim = 64;
+    image_max_dim = 64;
+    image_padding = padding;
+    post_nms_rois_inference = 100;
+    detection_max_instances = 10;
+
+    UpdateSettings();
+  }
+};
+
+cv::Mat MakeImage(int width, int height) {
+  cv::Mat image(height, width, CV_8UC3);
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+  return image;
+}
+
+std::unique_ptr<InferenceServer> MakeServer(
+    const InferenceServerOptions& options,
+    bool padding = true) {
+  torch::manual_seed(0);
+  auto config = std::make_shared<TinyConfig>(padding);
+  MaskRCNN model("", config);
+  return std::make_unique<InferenceServer>(model, config, options);
+}
+}  // namespace
+
+TEST_CASE("InferenceServer batches requests by size", "[inferenceserver]") {
+  InferenceServerOptions options;
+  options.max_batch_size = 2;
+  // batches are only started when they are full
+  options.max_batch_delay = std::chrono::seconds(30);
+  auto server = MakeServer(options);
+
+  std::vector<std::future<InferenceResult>> results;
+  for (int i = 0; i < 4; ++i)
+    results.push_back(server->Submit(MakeImage(64, 48)));
+  for (auto& result : results)
+    REQUIRE_NOTHROW(result.get());
+
+  auto stats = server->GetStats();
+  REQUIRE(stats.requests == 4);
+  REQUIRE(stats.batches == 2);
+  REQUIRE(stats.mean_batch_size == Approx(2));
+}
+
+TEST_CASE("InferenceServer starts batch on deadline", "[inferenceserver]") {
+  InferenceServerOptions options;
+  options.max_batch_size = 4;
+  options.max_batch_delay = std::chrono::milliseconds(20);
+  auto server = MakeServer(options);
+
+  server->Submit(MakeImage(64, 64)).get();
+  auto stats = server->GetStats();
+  REQUIRE(stats.batches == 1);
+  REQUIRE(stats.mean_batch_size == Approx(1));
+  REQUIRE(stats.latency.p50 >= 20);
+}
+
+TEST_CASE("InferenceServer Stop finishes queued requests",
+          "[inferenceserver]") {
+  InferenceServerOptions options;
+  options.max_batch_size = 4;
+  options.max_batch_delay = std::chrono::seconds(30);
+  auto server = MakeServer(options);
+
+  std::vector<std::future<InferenceResult>> results;
+  for (int i = 0; i < 3; ++i)
+    results.push_back(server->Submit(MakeImage(64, 64)));
+  // the batch isn't full, Stop runs it without waiting for the deadline
+  server->Stop();
+  for (auto& result : results) {
+    REQUIRE(result.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready);
+    REQUIRE_NOTHROW(result.get());
+  }
+  REQUIRE(server->GetStats().requests == 3);
+  REQUIRE_THROWS_AS(server->Submit(MakeImage(64, 64)), std::logic_error);
+  server->Stop();  // the second call does nothing
+}
+
+TEST_CASE("InferenceServer fails only broken requests", "[inferenceserver]") {
+  InferenceServerOptions options;
+  options.max_batch_size = 2;
+  options.max_batch_delay = std::chrono::seconds(30);
+  auto server = MakeServer(options);
+
+  REQUIRE_THROWS_AS(server->Submit(cv::Mat()), std::invalid_argument);
+  REQUIRE_THROWS_AS(server->Submit(cv::Mat(64, 64, CV_8UC1)),
+                    std::invalid_argument);
+
+  // resized to zero height, so MoldInputs throws
+  auto broken = server->Submit(MakeImage(1000, 1));
+  REQUIRE_THROWS(broken.get());
+  auto first = server->Submit(MakeImage(64, 64));
+  auto second = server->Submit(MakeImage(64, 64));
+  REQUIRE_NOTHROW(first.get());
+  REQUIRE_NOTHROW(second.get());
+
+  // the failed request doesn't keep Stop waiting for its molding
+  server->Stop();
+  auto stats = server->GetStats();
+  REQUIRE(stats.requests == 3);
+  REQUIRE(stats.batches == 1);
+}
+
+TEST_CASE("InferenceServer rejects other image sizes without padding",
+          "[inferenceserver]") {
+  InferenceServerOptions options;
+  options.max_batch_size = 2;
+  options.max_batch_delay = std::chrono::milliseconds(1);
+  auto server = MakeServer(options, /*padding*/ false);
+
+  // molded images keep the size and can't be concatenated with others
+  auto result = server->Submit(MakeImage(64, 64));
+  REQUIRE_THROWS_AS(server->Submit(MakeImage(64, 48)), std::invalid_argument);
+  REQUIRE_NOTHROW(result.get());
+  REQUIRE_NOTHROW(server->Submit(MakeImage(64, 64)).get());
+}
@@ -0,0 +1,70 @@
+#include "catch.hpp"
+
+#include "../roialign/crop_and_resize.h"
+#include "../roialign/mask_targets.h"
+
+namespace {
+at::Tensor ReferenceMaskTargets(at::Tensor masks,
+                                at::Tensor rois,
+                                at::Tensor gt_boxes,
+                                at::Tensor roi_gt_index,
+                                bool use_mini_mask,
+                                int mask_height,
+                                int mask_width) {
+  auto index = roi_gt_index.to(at::kLong);
+  auto roi_masks = masks.index_select(0, index);
+  auto boxes = rois;
+  if (use_mini_mask) {
+    auto roi_gt_boxes = gt_boxes.index_select(0, index);
+    auto yxyx = rois.chunk(4, /*dim*/ 1);
+    auto gyxyx = roi_gt_boxes.chunk(4, /*dim*/ 1);
+    auto gt_h = gyxyx[2] - gyxyx[0];
+    auto gt_w = gyxyx[3] - gyxyx[1];
+    auto y1 = (yxyx[0] - gyxyx[0]) / gt_h;
+    auto x1 = (yxyx[1] - gyxyx[1]) / gt_w;
+    auto y2 = (yxyx[2] - gyxyx[0]) / gt_h;
+    auto x2 = (yxyx[3] - gyxyx[1]) / gt_w;
+    boxes = torch::cat({y1, x1, y2, x2}, /*dim*/ 1);
+  }
+  auto box_ids = torch::arange(rois.size(0), at::dtype(at::kInt));
+  auto crops = torch::zeros({});
+  crop_and_resize_forward(roi_masks.unsqueeze(1), boxes, box_ids, 0,
+                          mask_height, mask_width, crops);
+  return torch::round(crops.squeeze(1));
+}
+}  // namespace
+
+TEST_CASE("mask targets match crop and resize", "[roialign]") {
+  torch::manual_seed(0);
+  auto masks = (torch::rand({3, 20, 24}) > 0.5f).to(at::kFloat);
+  auto rois = torch::rand({16, 4}) * 0.5f;
+  rois.narrow(1, 2, 2) += 0.4f;
+  auto gt_boxes = torch::rand({3, 4}) * 0.4f;
+  gt_boxes.narrow(1, 2, 2) += 0.5f;
+  auto roi_gt_index = torch::randint(0, 3, {16}, at::dtype(at::kInt));
+
+  for (bool use_mini_mask : {false, true}) {
+    auto expected = ReferenceMaskTargets(masks, rois, gt_boxes, roi_gt_index,
+                                         use_mini_mask, 14, 12);
+    auto targets = torch::zeros({});
+    mask_targets_forward(masks, rois, gt_boxes, roi_gt_index, use_mini_mask,
+                         14, 12, targets);
+    REQUIRE(targets.size(0) == 16);
+    REQUIRE(targets.size(1) == 14);
+    REQUIRE(targets.size(2) == 12);
+    REQUIRE(targets.equal(expected));
+  }
+}
+
+TEST_CASE("mask targets skip unassigned ROIs", "[roialign]") {
+  auto masks = torch::ones({1, 8, 8});
+  auto rois = torch::tensor({0.f, 0.f, 1.f, 1.f, 0.f, 0.f, 1.f, 1.f})
+                  .reshape({2, 4});
+  auto gt_boxes = torch::tensor({0.f, 0.f, 1.f, 1.f}).reshape({1, 4});
+  auto roi_gt_index = torch::tensor({0, -1}, at::dtype(at::kInt));
+  auto targets = torch::zeros({});
+  mask_targets_forward(masks, rois, gt_boxes, roi_gt_index,
+                       /*use_mini_mask*/ true, 4, 4, targets);
+  REQUIRE(targets[0].sum().item<float>() == Approx(16));
+  REQUIRE(targets[1].sum().item<float>() == Approx(0));
+}
@@ -4,6 +4,7 @@
 #include "config.h"
 #include "debug.h"
 #include "imageutils.h"
+#include "imagecache.h"
 #include "maskrcnn.h"
 #include "stateloader.h"
 
@@ -32,7 +33,43 @@ class TrainConfig : public Config {
 const cv::String keys =
     "{help h usage ? |      | print this message   }"
     "{@data_dir      |<none>| path to coco dataset root folder}"
-    "{@params        |<none>| path to trained parameters }";
+    "{@params        |<none>| path to trained parameters }"
+    "{cache          |0     | size of decoded images cache in MB, 0 disables it}";
+
+// The cache segment is shared by all the processes which train on the same
+// annotations file with the same resize settings, the stamp drops images
+// cached for a previous version of the file
+std::shared_ptr<ImageCache> MakeImageCache(const fs::path& annotations_file,
+                                           const Config& config,
+                                           std::size_t size_mb) {
+  std::size_t max_image_bytes = static_cast<std::size_t>(config.image_max_dim) *
+                                static_cast<std::size_t>(config.image_max_dim) * 3;
+  if ((size_mb << 20) < max_image_bytes)
+    return nullptr;
+  auto name = "/mrcnn_" + annotations_file.stem().string() + "_" +
+              std::to_string(config.image_min_dim) + "_" +
+              std::to_string(config.image_max_dim);
+  ImageCacheStamp stamp;
+  stamp.dataset_size = fs::file_size(annotations_file);
+  stamp.dataset_mtime =
+      fs::last_write_time(annotations_file).time_since_epoch().count();
+  stamp.min_dim = config.image_min_dim;
+  stamp.max_dim = config.image_max_dim;
+  stamp.padding = config.image_padding;
+  return std::make_shared<ImageCache>(name, size_mb << 20, max_image_bytes,
+                                      stamp);
+}
+
+void PrintImageCacheStats(const std::string& name,
+                          const std::shared_ptr<ImageCache>& cache) {
+  if (!cache)
+    return;
+  auto stats = cache->GetStats();
+  std::cout << name << " images cache: hits " << stats.hits << ", misses "
+            << stats.misses << ", evictions " << stats.evictions
+            << ", entries " << stats.entries << "/" << stats.capacity
+            << std::endl;
+}
 
 int main(int argc, char** argv) {
 #ifndef NDEBUG
@@ -54,6 +91,7 @@ int main(int argc, char** argv) {
 
     std::string data_path = parser.get<cv::String>(0);
     std::string params_path = parser.get<cv::String>(1);
+    auto cache_size = parser.get<std::size_t>("cache");
 
     // Chech parsing errors
     if (!parser.check()) {
@@ -104,6 +142,9 @@ int main(int argc, char** argv) {
     std::cout << "begin\n";
     auto train_set =
         std::make_unique<VehicleDataset>(std::move(train_loader), config);
+    auto train_cache = MakeImageCache(
+        fs::path(data_path) / "train_df_full.csv", *config, cache_size);
+    train_set->SetImageCache(train_cache);
     std::cout << "end\n";
 
     auto val_loader = std::make_unique<VehicleLoader>(
@@ -111,6 +152,10 @@ int main(int argc, char** argv) {
         fs::path(data_path) / "dev_df_full.csv",
         GetDatasetClasses());
     auto val_set = std::make_unique<VehicleDataset>(std::move(val_loader), config);
+    // validation images are read less often, so they get a smaller cache
+    auto val_cache = MakeImageCache(fs::path(data_path) / "dev_df_full.csv",
+                                    *config, cache_size / 4);
+    val_set->SetImageCache(val_cache);
 
     //    // Training - Stage 1
     std::cout << "Training network heads" << std::endl;
@@ -130,6 +175,9 @@ int main(int argc, char** argv) {
     model->Train(*train_set, *val_set, config->learning_rate / 10,
                  /*epochs*/ 160, "all");  // 160
 
+    PrintImageCacheStats("Train", train_cache);
+    PrintImageCacheStats("Validation", val_cache);
+
   } catch (const std::exception& err) {
     std::cout << err.what() << std::endl;
     return 1;
@@ -144,18 +144,24 @@ VehicleDataset::VehicleDataset(std::shared_ptr<VehicleLoader> loader, std::share
 
 Sample VehicleDataset::get(size_t index)
 {
-    cv::Mat image = this->vehicle_loader_->LoadImage(index);
-    ImageShape image_shape(image.size().width, image.size().height);
-
-    auto [temp_image, window, scale, padding] =
-        ResizeImage(image, config_->image_min_dim, config_->image_max_dim, config_->image_padding);
-
-    
-    std::pair<std::vector<cv::Mat>, std::vector<std::int32_t>> mask_class_pair = this->vehicle_loader_->LoadMask(index);
-    
+    // decoding is the most expensive part, so resized images are cached
+    CachedImage resized;
+    if (!image_cache_ || !image_cache_->Get(index, resized))
+    {
+        cv::Mat image = this->vehicle_loader_->LoadImage(index);
+        resized.original_size = image.size();
+        std::tie(resized.image, resized.window, resized.scale, resized.padding) =
+            ResizeImage(image, config_->image_min_dim, config_->image_max_dim, config_->image_padding);
+        if (image_cache_)
+            image_cache_->Put(index, resized);
+    }
+    ImageShape image_shape(resized.original_size.width, resized.original_size.height);
+    cv::Mat temp_image = resized.image;
+    const auto &window = resized.window;
+    auto scale = resized.scale;
+    const auto &padding = resized.padding;
 
-    auto masks = ResizeMasks(mask_class_pair.first, scale, padding);
-    
+    auto class_ids = this->vehicle_loader_->GetInstanceClassIds(index);
 
     std::vector<float> boxes;
 
@@ -170,10 +176,23 @@ Sample VehicleDataset::get(size_t index)
         boxes.push_back(padding.left_pad + std::ceil((bbox.x + bbox.width) * scale));
     }
 
+    // Masks are rendered right at the resized image or mini mask scale
+    auto polygons = this->vehicle_loader_->LoadPolygons(index);
+    std::vector<cv::Mat> masks;
+    if (config_->use_mini_mask)
+    {
+        masks = RenderMiniMasks(polygons, scale, padding, temp_image.size(), boxes,
+                                config_->mini_mask_shape[0], config_->mini_mask_shape[1]);
+    }
+    else
+    {
+        masks = RenderMasks(polygons, scale, padding, temp_image.size());
+    }
+
     // Make training sample
     Sample result;
 
-    image = MoldImage(temp_image, *config_);
+    cv::Mat image = MoldImage(temp_image, *config_);
     
     result.data.image = CvImageToTensor(image);
     result.data.image_meta.image_id = static_cast<int32_t>(index);
@@ -194,7 +213,8 @@ Sample VehicleDataset::get(size_t index)
     result.target.gt_boxes = torch::tensor(boxes, at::dtype(at::kFloat))
                                  .reshape({annotations_num, 4})
                                  .clone();
-    result.target.gt_class_ids = torch::tensor(mask_class_pair.second, at::dtype(at::kInt)).clone();
+    result.target.gt_class_ids =
+        torch::tensor(std::vector<std::int32_t>(class_ids.begin(), class_ids.end()), at::dtype(at::kInt)).clone();
 
     
     std::cout << "load mask" << std::endl;
@@ -226,6 +246,11 @@ Sample VehicleDataset::get(size_t index)
     return result;
 };
 
+void VehicleDataset::SetImageCache(std::shared_ptr<ImageCache> cache)
+{
+    image_cache_ = cache;
+}
+
 torch::optional<size_t> VehicleDataset::size() const
 {
     return vehicle_loader_->GetImagesCount();
@@ -4,6 +4,7 @@
 #include "vehicleloader.h"
 #include "config.h"
 #include "imageutils.h"
+#include "imagecache.h"
 
 #include <torch/torch.h>
 #include <string>
@@ -32,12 +33,16 @@ class VehicleDataset : public torch::data::Dataset<VehicleDataset, Sample>
     VehicleDataset(std::shared_ptr<VehicleLoader> loader);
     VehicleDataset(std::shared_ptr<VehicleLoader> loader, std::shared_ptr<const Config> config);
     Sample get(size_t index) override;
+    /// \brief Resized images are taken from the cache, which can be shared
+    ///        with other datasets of the same images
+    void SetImageCache(std::shared_ptr<ImageCache> cache);
     torch::optional<size_t> size() const override;
 
   private:
     std::shared_ptr<VehicleLoader> vehicle_loader_;
     std::shared_ptr<const Config> config_;
     torch::Tensor anchors_;
+    std::shared_ptr<ImageCache> image_cache_;
 };
 
 #endif // VEHICLEDATASET_H
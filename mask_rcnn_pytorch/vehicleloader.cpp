@@ -4,54 +4,190 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
 #include <ctype.h>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "vehicleloader.h"
 #include "imageutils.h"
+#include "imageprobe.h"
 #include "fileutil.h"
 #include "util.h"
-#include "csvparser.hpp"
 
 const std::set<std::string> VehicleLoader::csv_fields{"file", "pts", "labels", "has_mask"};
 
-void VehicleLoader::_ParseContours(const std::string &string_points, ImageInfo &image_info)
+namespace
 {
-    int index = 0;
+std::string_view TrimView(std::string_view s)
+{
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+        s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back())))
+        s.remove_suffix(1);
+    return s;
+}
+
+/// \brief Splits the text to CSV rows, new lines inside quoted fields don't
+///        end rows. Chunks are scanned in parallel, then quote parity at the
+///        beginning of every chunk selects which new lines are row ends.
+std::vector<std::string_view> SplitRows(const std::string &text)
+{
+#ifdef _OPENMP
+    std::size_t threads = static_cast<std::size_t>(omp_get_max_threads());
+#else
+    std::size_t threads = 1;
+#endif
+    std::size_t step = text.size() / threads + 1;
+    // new line positions with quotes parity from the chunk beginning
+    std::vector<std::vector<std::pair<std::size_t, bool>>> new_lines(threads);
+    std::vector<std::size_t> quotes(threads, 0);
+#pragma omp parallel for
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        std::size_t end = std::min(text.size(), (t + 1) * step);
+        for (std::size_t i = t * step; i < end; ++i)
+        {
+            if (text[i] == '"')
+                ++quotes[t];
+            else if (text[i] == '\n')
+                new_lines[t].emplace_back(i, quotes[t] % 2 != 0);
+        }
+    }
+
+    std::vector<std::string_view> rows;
+    std::string_view view(text);
+    std::size_t row_begin = 0;
+    bool odd_quotes = false;
+    auto add_row = [&](std::size_t row_end) {
+        auto row = view.substr(row_begin, row_end - row_begin);
+        if (!row.empty() && row.back() == '\r')
+            row.remove_suffix(1);
+        if (!TrimView(row).empty())
+            rows.push_back(row);
+        row_begin = row_end + 1;
+    };
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        for (const auto &new_line : new_lines[t])
+        {
+            if (new_line.second == odd_quotes)
+                add_row(new_line.first);
+        }
+        odd_quotes = odd_quotes != (quotes[t] % 2 != 0);
+    }
+    if (row_begin < text.size())
+        add_row(text.size());
+    return rows;
+}
+
+/// \brief Splits the row to fields, quotes around fields are removed but
+///        doubled quotes inside them are kept
+void SplitFields(std::string_view row, std::vector<std::string_view> &fields)
+{
+    fields.clear();
+    std::size_t pos = 0;
+    while (pos <= row.size())
+    {
+        std::size_t first = pos;
+        while (first < row.size() && row[first] == ' ')
+            ++first;
+        if (first < row.size() && row[first] == '"')
+        {
+            std::size_t last = first + 1;
+            while (last < row.size() && (row[last] != '"' || (last + 1 < row.size() && row[last + 1] == '"')))
+                last += row[last] == '"' ? 2 : 1;
+            fields.push_back(row.substr(first + 1, last - first - 1));
+            pos = row.find(',', last);
+        }
+        else
+        {
+            pos = row.find(',', pos);
+            fields.push_back(row.substr(first, pos == std::string_view::npos ? pos : pos - first));
+        }
+        if (pos == std::string_view::npos)
+            break;
+        ++pos;
+    }
+}
+
+std::string Unquote(std::string_view field)
+{
+    std::string value(field);
+    for (std::size_t pos = value.find("\"\""); pos != std::string::npos; pos = value.find("\"\"", pos + 1))
+        value.erase(pos, 1);
+    return value;
+}
+} // namespace
+
+void VehicleLoader::_ParseContours(std::string_view string_points, ImageInfo &image_info)
+{
+    // "[[x, y, x, y, ...], [...]]", numbers are parsed straight from the text,
+    // which is the part of zero terminated annotations file
     int level = 0;
-    int previous_pos = 0;
-    for (int i = 0; i < string_points.length(); i++){
-        if (string_points[i] == '['){
+    const char *pos = string_points.data();
+    const char *end = pos + string_points.size();
+    image_info.contour_offsets.assign(1, 0);
+    image_info.coordinates.clear();
+    while (pos < end)
+    {
+        if (*pos == '[')
+        {
             level++;
-            if (level == 2){
-                previous_pos = i + 1;
-            }
+            ++pos;
         }
-        if (string_points[i] == ']'){
+        else if (*pos == ']')
+        {
             level--;
-            if (level == 1){
-                std::string ss = string_points.substr(previous_pos, i - previous_pos);
-                image_info.contours.emplace_back();
-                std::vector<std::string> v_points_string = SplitString(ss, ',');
-                for (auto &s : v_points_string)
-                {
-                    image_info.AddContourCoordinates(std::strtof(s.c_str(), 0));
-                }
-            }
+            if (level == 1)
+                image_info.contour_offsets.push_back(static_cast<std::uint32_t>(image_info.coordinates.size()));
+            ++pos;
+        }
+        else if (level == 2 && *pos != ',' && !std::isspace(static_cast<unsigned char>(*pos)))
+        {
+            char *number_end = nullptr;
+            float value = std::strtof(pos, &number_end);
+            if (number_end == pos || number_end > end)
+                throw std::runtime_error("Wrong contour coordinate: " + std::string(string_points));
+            image_info.coordinates.push_back(static_cast<std::int32_t>(value));
+            pos = number_end;
+        }
+        else
+        {
+            ++pos;
         }
     }
-    // std::cout << string_points << std::endl;
-    // std::vector<std::string> v_string_points = SplitString(string_points, '|');
-    // std::cout << v_string_points.size() <<  std::endl;
-    // for (const auto &s : v_string_points)
-    // {
-    //     std::cout << s <<  std::endl;
-    //     image_info.contours.emplace_back();
-    //     // assumption is string_points are comma separated values of x,y like "0,0,1,1,2,3"
-    //     std::vector<std::string> v_points_string = SplitString(s, ';');
-    //     for (auto &s : v_points_string)
-    //     {
-    //         image_info.AddContourCoordinates(std::strtof(s.c_str(), 0));
-    //     }
-    // }
+}
+
+void VehicleLoader::_ParseClassIds(std::string_view labels,
+                                   const std::unordered_map<std::string, std::int32_t> &class_ids,
+                                   ImageInfo &image_info)
+{
+    // "['car', 'truck', ...]", unknown classes are skipped
+    image_info.class_ids.clear();
+    labels = TrimView(labels);
+    if (labels.size() < 2)
+        return;
+    labels = labels.substr(1, labels.size() - 2);
+    std::string name;
+    while (!labels.empty())
+    {
+        auto comma = labels.find(',');
+        auto token = TrimView(labels.substr(0, comma));
+        labels = comma == std::string_view::npos ? std::string_view() : labels.substr(comma + 1);
+        if (token.size() < 2)
+            continue;
+        name.assign(token.substr(1, token.size() - 2));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name == "pedestrian")
+            name = "other";
+        auto id = class_ids.find(name);
+        if (id != class_ids.end())
+            image_info.class_ids.push_back(id->second);
+    }
 }
 
 void VehicleLoader::_AddClassesToBase(const std::vector<std::string> &classes)
@@ -98,66 +234,47 @@ VehicleLoader::VehicleLoader(const std::string &images_folder,
 
 std::pair<std::vector<cv::Mat>, std::vector<std::int32_t>> VehicleLoader::LoadMask(const std::uint64_t &image_id)
 {
-    ImageInfo info = this->image_infos_[image_id];
-    //std::cout << info.source << " " << info.path << " " << info.contours.size() << std::endl;
-
     assert(this->has_mask_);
 
-    cv::Size size(info.width, info.height);
-
-    std::vector<cv::Mat> masks(info.contours.size());
+    cv::Size size(this->GetImageWidth(image_id), this->GetImageHeight(image_id));
 
-    std::size_t c_idx = 0;
-    for (const auto &contour : info.contours)
+    std::vector<cv::Mat> masks(this->GetContoursCount(image_id));
+    for (std::size_t c_idx = 0; c_idx < masks.size(); ++c_idx)
     {
-        //std::cout << contour.size() << std::endl;
-        cv::Mat mask = ConvertPolygonToMask(contour, size);
-        masks[c_idx] = mask;
-        ++c_idx;
+        auto contour = this->GetContour(image_id, c_idx);
+        masks[c_idx] = ConvertPolygonToMask(contour.data(), contour.size(), size);
     }
 
-    std::cout << info.class_ids << std::endl;
+    auto class_ids = this->GetInstanceClassIds(image_id);
+    return std::make_pair(masks, std::vector<std::int32_t>(class_ids.begin(), class_ids.end()));
+}
 
-    std::vector<std::string> s_class_ids = SplitString(info.class_ids, ',');
-    std::vector<std::int32_t> class_ids;
-    for (auto &s : s_class_ids)
+std::vector<PolygonRasterizer> VehicleLoader::LoadPolygons(const std::uint64_t &image_id) const
+{
+    std::vector<PolygonRasterizer> polygons(this->GetContoursCount(image_id));
+    for (std::size_t c_idx = 0; c_idx < polygons.size(); ++c_idx)
     {
-
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-        trim(s);
-        s = s.substr(1, s.length() - 2);
-        if (s.compare("pedestrian") == 0){
-            s = "other";
-        }
-
-        if (this->class_id_from_class_name_map_.find(s) != this->class_id_from_class_name_map_.end())
-            class_ids.push_back(this->class_id_from_class_name_map_[s]);
+        auto contour = this->GetContour(image_id, c_idx);
+        polygons[c_idx].AddPolygon(contour.data(), contour.size());
     }
-
-    //        std::transform(s_class_ids.begin(), s_class_ids.end(), std::back_inserter(class_ids),
-    //                        [](const std::string &str){ return std::stoi(str); });
-    return std::make_pair(masks, class_ids);
+    return polygons;
 }
 
 std::vector<BoundingBox> VehicleLoader::LoadBBoxes(const std::uint64_t &image_id)
 {
-    ImageInfo info = this->image_infos_[image_id];
-
     assert(this->has_mask_);
 
-    cv::Size size(info.width, info.height);
-
-    std::vector<BoundingBox> boxes(info.contours.size());
+    std::vector<BoundingBox> boxes(this->GetContoursCount(image_id));
 
-    std::size_t c_idx = 0;
     int x1, y1, x2, y2;
-    for (const auto &contour : info.contours)
+    for (std::size_t c_idx = 0; c_idx < boxes.size(); ++c_idx)
     {
+        auto contour = this->GetContour(image_id, c_idx);
         x1 = 1000000000;
         y1 = 1000000000;
         x2 = -1000000000;
         y2 = -1000000000;
-        int len = info.contours.size() / 2;
+        int len = static_cast<int>(contour.size() / 2);
         for (int i = 0; i < len; i++){
             x1 = std::min(x1, contour[i * 2]);
             y1 = std::min(y1, contour[i * 2 + 1]);
@@ -170,7 +287,6 @@ std::vector<BoundingBox> VehicleLoader::LoadBBoxes(const std::uint64_t &image_id
         box.width = x2 - x1;
         box.height = y2 - y1;
         boxes[c_idx] = box;
-        ++c_idx;
     }
 
     return boxes;
@@ -186,12 +302,11 @@ std::pair<std::uint32_t, std::vector<float>> VehicleLoader::LoadRotatedBBox(cons
     return {};
 }
 
-std::string VehicleLoader::ImageReference(const std::uint64_t &image_id)
+std::string_view VehicleLoader::ImageReference(const std::uint64_t &image_id)
 {
-    ImageInfo info = this->image_infos_[image_id];
-    if (info.source == VEHICLE_SOURCE)
+    if (this->GetImageSource(image_id) == VEHICLE_SOURCE)
     {
-        return info.path;
+        return this->GetImagePath(image_id);
     }
     else
     {
@@ -201,91 +316,104 @@ std::string VehicleLoader::ImageReference(const std::uint64_t &image_id)
 
 void VehicleLoader::LoadData()
 {
-    std::ifstream f(annotations_file_);
-    aria::csv::CsvParser parser = aria::csv::CsvParser(f);
+    std::ifstream f(annotations_file_, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    std::vector<std::string_view> rows = SplitRows(text);
+    if (rows.empty())
+        throw std::runtime_error(std::string(__func__) + ": annotations file is empty");
+
+    // column indices are resolved once by the header
+    std::vector<std::string_view> header;
+    SplitFields(rows[0], header);
     std::map<std::string, int> field_indices;
-    int field_index = 0;
-
-    bool header_parsed = false;
-    int index = 0;
-    for (auto &row : parser)
+    for (std::size_t i = 0; i < header.size(); ++i)
+        field_indices[std::string(TrimView(header[i]))] = static_cast<int>(i);
+    for (const auto &field : csv_fields)
     {
-        if (!header_parsed)
+        if (field_indices.find(field) == field_indices.end())
         {
-            for (auto &field : row)
-            {
-                field_indices[field] = field_index++;
-            }
-
-            // check all the fields
-            for (const auto &field : csv_fields)
-            {
-                if (field_indices.find(field) == field_indices.end())
-                {
-                    throw std::runtime_error(std::string(__func__) + ": header doesn't contain " + field);
-                }
-            }
-
-            header_parsed = true;
+            throw std::runtime_error(std::string(__func__) + ": header doesn't contain " + field);
         }
-        else
+    }
+    const std::size_t file_index = field_indices["file"];
+    const std::size_t pts_index = field_indices["pts"];
+    const std::size_t labels_index = field_indices["labels"];
+    const std::size_t has_mask_index = field_indices["has_mask"];
+    std::size_t min_fields = std::max({file_index, pts_index, labels_index, has_mask_index}) + 1;
+
+    // class names are lower case, bg is the class 0
+    std::unordered_map<std::string, std::int32_t> class_ids;
+    for (std::size_t i = 0; i < this->class_infos_.size(); ++i)
+        class_ids.emplace(this->class_infos_[i].class_name, static_cast<std::int32_t>(i));
+
+    // ----------- Parse rows in parallel
+    std::size_t rows_count = rows.size() - 1;
+    std::vector<ImageInfo> infos(rows_count);
+    std::vector<char> complete(rows_count, 0);
+    std::vector<std::string> errors(rows_count);
+#pragma omp parallel
+    {
+        std::vector<std::string_view> fields;
+#pragma omp for schedule(dynamic, 64)
+        for (std::size_t row = 0; row < rows_count; ++row)
         {
-            bool contains_all_fields = true;
+            SplitFields(rows[row + 1], fields);
             // check all the fields
-            for (const auto &field : csv_fields)
-            {
-                if (row[field_indices[field]].empty())
-                {
-                    contains_all_fields = false;
-                    break;
-                }
-            }
+            if (fields.size() < min_fields || fields[file_index].empty() || fields[pts_index].empty() ||
+                fields[labels_index].empty() || fields[has_mask_index].empty())
+                continue;
 
-            if (!contains_all_fields)
+            auto &image_info = infos[row];
+            try
             {
-                std::cout << "Row[" << std::left << std::setw(3) << index << "] doesn't contain all the fields.\n";
-                index++;
-                continue;
+                std::string file = Unquote(fields[file_index]);
+                trim(file);
+                // images are looked up by the path from the file
+                image_info.id = file;
+                image_info.source = VEHICLE_SOURCE;
+                image_info.path = file;
+                this->_ParseContours(fields[pts_index], image_info);
+                this->_ParseClassIds(fields[labels_index], class_ids, image_info);
+                std::string has_mask(TrimView(fields[has_mask_index]));
+                std::transform(has_mask.begin(), has_mask.end(), has_mask.begin(), ::tolower);
+                image_info.has_mask = (has_mask == "true") ? true : false;
+                complete[row] = 1;
             }
-
-            fs::path image_path(this->images_folder_);
-            std::string file(row[field_indices["file"]]);
-            trim(file);
-
-            std::string labels(row[field_indices["labels"]]);
-            trim(labels);
-
-            std::string contours(row[field_indices["pts"]]);
-            trim(contours);
-
-            std::string has_mask(row[field_indices["has_mask"]]);
-            trim(has_mask);
-
-            image_path = file;
-
-            if (!fs::exists(image_path))
+            catch (const std::exception &err)
             {
-                std::cout << "Row[" << std::left << std::setw(3) << index << "] image doesn't contain exist.\n";
-                index++;
-                continue;
+                errors[row] = err.what();
             }
+        }
+    }
 
-            cv::Mat image = cv::imread(image_path.string());
-            ImageInfo image_info;
-            image_info.id = file;
-            image_info.source = VEHICLE_SOURCE;
-            image_info.width = image.size().width;
-            image_info.height = image.size().height;
-            image_info.path = image_path.string();
-            image_info.class_ids = labels.substr(1, labels.length() - 2);
-
-            // do something about the contours
-            this->_ParseContours(contours, image_info);
-            std::transform(has_mask.begin(), has_mask.end(), has_mask.begin(), ::tolower);
-            image_info.has_mask = (has_mask == "true") ? true : false;
-
-            this->AddImage(image_info);
-            index++;
+    // images are added after their sizes are probed all together
+    std::vector<std::size_t> pending_rows;
+    std::vector<std::string> pending_paths;
+    for (std::size_t row = 0; row < rows_count; ++row)
+    {
+        if (!errors[row].empty())
+            std::cout << "Row[" << std::left << std::setw(3) << row << "] " << errors[row] << "\n";
+        else if (!complete[row])
+            std::cout << "Row[" << std::left << std::setw(3) << row << "] doesn't contain all the fields.\n";
+        else
+        {
+            pending_rows.push_back(row);
+            pending_paths.push_back(infos[row].path);
+        }
+    }
+
+    // only headers are read, sizes are cached next to the annotations
+    std::vector<ImageSize> sizes = GetImageSizes(pending_paths, annotations_file_ + ".sizes");
+    for (std::size_t i = 0; i < pending_rows.size(); ++i)
+    {
+        if (sizes[i].IsEmpty())
+        {
+            std::cout << "Row[" << std::left << std::setw(3) << pending_rows[i] << "] image doesn't exist.\n";
+            continue;
         }
+        auto &image_info = infos[pending_rows[i]];
+        image_info.width = sizes[i].width;
+        image_info.height = sizes[i].height;
+        this->AddImage(image_info);
     }
 }
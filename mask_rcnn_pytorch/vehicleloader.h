@@ -2,8 +2,10 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include "loader.h"
+#include "imageutils.h"
 #include <cstdint>
 #include <experimental/filesystem>
 
@@ -30,16 +32,22 @@ class VehicleLoader : public Loader
     void LoadData() override;
     std::pair<std::vector<cv::Mat>, std::vector<std::int32_t>> LoadMask(const std::uint64_t &image_id) override;
 
+    /// \brief Instance polygons to render the masks at the final scale
+    std::vector<PolygonRasterizer> LoadPolygons(const std::uint64_t &image_id) const;
+
     std::vector<BoundingBox> LoadBBoxes(const std::uint64_t &image_id);
 
     std::pair<std::uint32_t, std::vector<float>> LoadBBox(const std::uint64_t &image_id) override;
     std::pair<std::uint32_t, std::vector<float>> LoadRotatedBBox(const std::uint64_t &image_id) override;
-    std::string ImageReference(const std::uint64_t &image_id) override;
+    std::string_view ImageReference(const std::uint64_t &image_id) override;
 
   private:
     std::string images_folder_;
     std::string annotations_file_;
     void _AddClassesToBase(const std::vector<std::string> &classes);
-    void _ParseContours(const std::string &string_points, ImageInfo &image_info);
+    void _ParseContours(std::string_view string_points, ImageInfo &image_info);
+    void _ParseClassIds(std::string_view labels,
+                        const std::unordered_map<std::string, std::int32_t> &class_ids,
+                        ImageInfo &image_info);
 
 }; //class VehicleDataLoader
\ No newline at end of file
@@ -11,15 +11,23 @@
 #include <xtensor/xbuilder.hpp>
 #include <xtensor/xeval.hpp>
 #include <xtensor/xio.hpp>
+#include <xtensor/xnoalias.hpp>
+#include <xtensor/xvectorize.hpp>
 
 // stl includes
 #include <algorithm>
+#include <cmath>
 #include <experimental/filesystem>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <random>
+#include <stdexcept>
 #include <string>
 
 // application includes
+#include "../chunkprefetcher.h"
+#include "../csvreader.h"
 #include "../ioutils.h"
 #include "../utils.h"
 
@@ -47,29 +55,108 @@ auto minmax_scale(const Matrix& v, DType rmin, DType rmax) {
   return xt::eval(vs * (rmax - rmin) - rmin);
 }
 
+// Online mean and sample standard deviation (Welford)
+struct Moments {
+  void add(DType value) {
+    ++n;
+    auto delta = value - mean;
+    mean += delta / static_cast<DType>(n);
+    m2 += delta * (value - mean);
+  }
+  DType sd() const {
+    return n > 1 ? std::sqrt(m2 / static_cast<DType>(n - 1)) : 1;
+  }
+
+  size_t n{0};
+  DType mean{0};
+  DType m2{0};
+};
+
+// Scaling of the polynomial columns, it matches generate_polynomial
+struct PolynomialScaling {
+  DType x_mean{0};
+  DType x_sd{1};
+  DType y_mean{0};
+  DType y_sd{1};
+  std::vector<DType> mean;  // for every polynomial column
+  std::vector<DType> sd;
+};
+
+// Writes polynomial terms of one sample to `row`, powers are computed with
+// incremental multiplication
+void fill_polynomial_row(DType x,
+                         const PolynomialScaling& scaling,
+                         DType* row) {
+  auto degree = scaling.mean.size();
+  row[0] = 1;
+  DType z = (x - scaling.x_mean) / scaling.x_sd;
+  DType power = 1;
+  for (size_t i = 1; i < degree; ++i) {
+    power *= z;
+    row[i] = (power - scaling.mean[i]) / scaling.sd[i];
+  }
+}
+
+/*
+ * Generates standardized polynomial terms in one pass over rows: every row is
+ * filled with incremental powers, which also update Welford moments of the
+ * columns, then the power columns are standardized in place.
+ */
 auto generate_polynomial(const Matrix& x, size_t degree) {
   assert(x.shape().size() == 1);
   auto rows = x.shape()[0];
-  auto poly_shape = std::vector<size_t>{rows, degree};
-  Matrix poly_x = xt::zeros<DType>(poly_shape);
-  // fill additional column for simpler vectorization
-  {
-    auto xv = xt::view(poly_x, xt::all(), 0);
-    xv = xt::ones<DType>({rows});
-  }
-  // copy initial data
-  {
-    auto xv = xt::view(poly_x, xt::all(), 1);
-    xv = std::get<0>(standardize(x));
-  }
-  // generate additional terms
-  auto x_col = xt::view(poly_x, xt::all(), 1);
+  Moments x_moments;
+  for (auto value : x)
+    x_moments.add(value);
+  PolynomialScaling scaling;
+  scaling.x_mean = x_moments.mean;
+  scaling.x_sd = x_moments.sd();
+  scaling.mean.assign(degree, 0);
+  scaling.sd.assign(degree, 1);  // raw powers are generated first
+
+  Matrix poly_x = xt::zeros<DType>({rows, degree});
+  std::vector<Moments> moments(degree);
+  for (size_t r = 0; r < rows; ++r) {
+    DType* row = &poly_x(r, 0);
+    fill_polynomial_row(x(r), scaling, row);
+    for (size_t i = 2; i < degree; ++i)
+      moments[i].add(row[i]);
+  }
+  // the first two columns are ones and the standardized X
   for (size_t i = 2; i < degree; ++i) {
-    auto xv = xt::view(poly_x, xt::all(), i);
-    xv = xt::pow(x_col, static_cast<DType>(i));
-    xv = std::get<0>(standardize(xv));
+    scaling.mean[i] = moments[i].mean;
+    scaling.sd[i] = moments[i].sd();
   }
-  return poly_x;
+  for (size_t r = 0; r < rows; ++r) {
+    DType* row = &poly_x(r, 0);
+    for (size_t i = 2; i < degree; ++i)
+      row[i] = (row[i] - scaling.mean[i]) / scaling.sd[i];
+  }
+  return std::make_tuple(poly_x, scaling);
+}
+
+/*
+ * Lazy expression of the model values for `x`, polynomial terms of a point
+ * are generated only when its value is evaluated, so the design matrix for
+ * new points is never allocated.
+ */
+template <typename E>
+auto predict_polynomial(E&& x,
+                        const Matrix& b,
+                        const PolynomialScaling& scaling) {
+  auto predict = [b, scaling](DType value) {
+    auto degree = scaling.mean.size();
+    DType z = (value - scaling.x_mean) / scaling.x_sd;
+    DType power = 1;
+    DType y = b(0);
+    for (size_t i = 1; i < degree; ++i) {
+      power *= z;
+      y += b(i) * (power - scaling.mean[i]) / scaling.sd[i];
+    }
+    // restore scaling for predicted values
+    return y * scaling.y_sd + scaling.y_mean;
+  };
+  return xt::vectorize(predict)(std::forward<E>(x));
 }
 
 auto bgd(const Matrix& x, const Matrix& y, size_t batch_size) {
@@ -111,6 +198,116 @@ auto bgd(const Matrix& x, const Matrix& y, size_t batch_size) {
   return b;
 }
 
+// ----------- Closed form solution
+
+/*
+ * Terms of the normal equation (X^T X) b = X^T y. They are summed over row
+ * blocks in parallel, every thread has its own accumulators, so besides the
+ * rows only O(d^2) memory is used and X can be passed in parts.
+ */
+struct NormalEquation {
+  explicit NormalEquation(size_t cols)
+      : xtx(xt::zeros<DType>({cols, cols})), xty(xt::zeros<DType>({cols})) {}
+
+  // `x` has `rows` row major rows with d values each
+  void add(const DType* x, const DType* y, size_t rows) {
+    const size_t cols = xty.shape()[0];
+    const size_t block_size = 256;
+    const size_t blocks = (rows + block_size - 1) / block_size;
+#pragma omp parallel
+    {
+      // only the upper triangle of the symmetric X^T X is accumulated
+      std::vector<DType> local_xtx(cols * cols, 0);
+      std::vector<DType> local_xty(cols, 0);
+#pragma omp for schedule(static)
+      for (size_t bi = 0; bi < blocks; ++bi) {
+        auto end = std::min(rows, (bi + 1) * block_size);
+        for (size_t r = bi * block_size; r < end; ++r) {
+          const DType* row = x + r * cols;
+          for (size_t i = 0; i < cols; ++i) {
+            const DType xi = row[i];
+            DType* xtx_row = local_xtx.data() + i * cols;
+#pragma omp simd
+            for (size_t j = i; j < cols; ++j)
+              xtx_row[j] += xi * row[j];
+            local_xty[i] += xi * y[r];
+          }
+        }
+      }
+#pragma omp critical
+      {
+        for (size_t i = 0; i < cols; ++i) {
+          for (size_t j = i; j < cols; ++j)
+            xtx(i, j) += local_xtx[i * cols + j];
+          xty(i) += local_xty[i];
+        }
+      }
+    }
+    for (size_t i = 0; i < cols; ++i) {
+      for (size_t j = 0; j < i; ++j)
+        xtx(i, j) = xtx(j, i);
+    }
+  }
+
+  Matrix xtx;
+  Matrix xty;
+};
+
+/*
+ * Solves the normal equation with Cholesky decomposition X^T X = L L^T.
+ * Returns false if the decomposition fails or the system is too ill
+ * conditioned to trust it, condition number is estimated with L diagonal.
+ */
+bool solve_cholesky(const NormalEquation& eq, Matrix& b) {
+  const DType max_condition = 1e12;
+  const size_t cols = eq.xty.shape()[0];
+  Matrix l;
+  try {
+    l = xt::linalg::cholesky(eq.xtx);
+  } catch (const std::runtime_error&) {
+    return false;  // matrix isn't positive definite
+  }
+  auto diag = xt::eval(xt::abs(xt::diagonal(l)));
+  auto minmax = xt::minmax(diag)();
+  if (!(minmax[0] > 0) ||
+      std::pow(minmax[1] / minmax[0], 2) > max_condition)
+    return false;
+
+  // L z = X^T y, then L^T b = z
+  b = xt::zeros<DType>({cols});
+  for (size_t i = 0; i < cols; ++i) {
+    DType sum = eq.xty(i);
+    for (size_t k = 0; k < i; ++k)
+      sum -= l(i, k) * b(k);
+    b(i) = sum / l(i, i);
+  }
+  for (size_t i = cols; i-- > 0;) {
+    DType sum = b(i);
+    for (size_t k = i + 1; k < cols; ++k)
+      sum -= l(k, i) * b(k);
+    b(i) = sum / l(i, i);
+  }
+  return true;
+}
+
+// Least squares with QR decomposition X = Q R, it works on X directly so
+// doesn't square its condition number
+Matrix solve_qr(const Matrix& x, const Matrix& y) {
+  Matrix q;
+  Matrix r;
+  std::tie(q, r) = xt::linalg::qr(x);
+  Matrix qty = xt::linalg::dot(xt::transpose(q), y);
+  const size_t cols = r.shape()[1];
+  Matrix b = xt::zeros<DType>({cols});
+  for (size_t i = cols; i-- > 0;) {
+    DType sum = qty(i);
+    for (size_t k = i + 1; k < cols; ++k)
+      sum -= r(i, k) * b(k);
+    b(i) = sum / r(i, i);
+  }
+  return b;
+}
+
 auto make_regression_model(const Matrix& data_x,
                            const Matrix& data_y,
                            size_t p_degree,
@@ -119,14 +316,21 @@ auto make_regression_model(const Matrix& data_x,
   auto [y, ym, ysd] = standardize(data_y);
 
   // X standardization & polynomization
-  Matrix x = xt::eval(generate_polynomial(data_x, p_degree));
+  Matrix x;
+  PolynomialScaling scaling;
+  std::tie(x, scaling) = generate_polynomial(data_x, p_degree);
+  scaling.y_mean = ym;
+  scaling.y_sd = ysd;
 
   Matrix b;
   if (equation) {
-    // calculate parameters witn normal equation
-    auto xt = xt::transpose(x);
-    b = xt::linalg::dot(
-        xt::linalg::dot(xt::linalg::inv(xt::linalg::dot(xt, x)), xt), y);
+    // calculate parameters with normal equation in one pass over rows
+    NormalEquation eq(p_degree);
+    eq.add(x.data(), y.data(), x.shape()[0]);
+    if (!solve_cholesky(eq, b)) {
+      std::cout << "normal equation is ill conditioned, using QR" << std::endl;
+      b = solve_qr(x, y);
+    }
     auto cost = (xt::sum(xt::pow(y - xt::linalg::dot(x, b), 2.f)) /
                  static_cast<DType>(x.shape()[0]))[0];
     std::cout << "calculated cost : " << cost << std::endl;
@@ -136,13 +340,177 @@ auto make_regression_model(const Matrix& data_x,
   }
 
   // create model
-  auto model = [b, ym, ysd, p_degree](const auto& data_x) {
-    auto x = xt::eval(generate_polynomial(data_x, p_degree));
-    Matrix yhat = xt::linalg::dot(x, b);
-    // restore scaling for predicted line values
+  auto model = [b, scaling](const auto& data_x) {
+    return predict_polynomial(data_x, b, scaling);
+  };
+  return model;
+}
+
+// ----------- Out of core training
+
+// Calls func(values, rows) for every chunk of the file with (x, y) rows, the
+// next chunk is parsed in background
+template <typename F>
+void for_each_chunk(csv::Reader& reader, F&& func) {
+  csv::ChunkPrefetcher<DType> prefetcher(reader);
+  const DType* values = nullptr;
+  const uint32_t* labels = nullptr;
+  size_t rows = 0;
+  while (prefetcher.Next(&values, &labels, &rows))
+    func(values, rows);
+}
 
-    yhat = (yhat * ysd) + ym;
-    return yhat;
+// Two passes over the file: the first for X and Y moments, the second for
+// moments of the standardized X powers
+auto get_polynomial_scaling(csv::Reader& reader, size_t degree) {
+  Moments x_moments;
+  Moments y_moments;
+  for_each_chunk(reader, [&](const DType* values, size_t rows) {
+    for (size_t r = 0; r < rows; ++r) {
+      auto x = values[r * 2];
+      auto y = values[r * 2 + 1];
+      if (std::isfinite(x) && std::isfinite(y)) {
+        x_moments.add(x);
+        y_moments.add(y);
+      }
+    }
+  });
+  if (x_moments.n < 2)
+    throw std::runtime_error("Not enough samples in the training file");
+
+  PolynomialScaling scaling;
+  scaling.x_mean = x_moments.mean;
+  scaling.x_sd = x_moments.sd();
+  scaling.y_mean = y_moments.mean;
+  scaling.y_sd = y_moments.sd();
+  scaling.mean.assign(degree, 0);
+  scaling.sd.assign(degree, 1);  // the first two columns aren't scaled
+  if (degree <= 2)
+    return scaling;
+
+  std::vector<Moments> power_moments(degree);
+  for_each_chunk(reader, [&](const DType* values, size_t rows) {
+    for (size_t r = 0; r < rows; ++r) {
+      auto x = values[r * 2];
+      auto y = values[r * 2 + 1];
+      if (std::isfinite(x) && std::isfinite(y)) {
+        DType z = (x - scaling.x_mean) / scaling.x_sd;
+        DType power = z;
+        for (size_t i = 2; i < degree; ++i) {
+          power *= z;
+          power_moments[i].add(power);
+        }
+      }
+    }
+  });
+  for (size_t i = 2; i < degree; ++i) {
+    scaling.mean[i] = power_moments[i].mean;
+    scaling.sd[i] = power_moments[i].sd();
+  }
+  return scaling;
+}
+
+/*
+ * Mini-batch AdaDelta over the file which doesn't fit into memory. Chunks are
+ * read with prefetch, polynomial features are generated for every batch into
+ * the same buffers and rows are shuffled inside a chunk.
+ */
+auto adadelta_stream(csv::Reader& reader,
+                     const PolynomialScaling& scaling,
+                     size_t batch_size) {
+  size_t n_epochs = 5000;
+  size_t patience = 10;  // epochs without improvement before stop
+  DType rho = 0.99;
+  DType eps = 1e-6;
+
+  auto cols = scaling.mean.size();
+  Matrix b = xt::zeros<DType>({cols});
+  Matrix grad = xt::zeros<DType>({cols});
+  Matrix delta = xt::zeros<DType>({cols});
+  Matrix eg_sum = xt::zeros<DType>({cols});
+  Matrix ex_sum = xt::zeros<DType>({cols});
+  Matrix batch_x = xt::zeros<DType>({batch_size, cols});
+  Matrix batch_y = xt::zeros<DType>({batch_size});
+  Matrix error = xt::zeros<DType>({batch_size});
+
+  // returns squared error sum of the batch before the update
+  auto step = [&]() {
+    xt::blas::gemv(batch_x, b, error);
+    xt::noalias(error) -= batch_y;
+    auto cost = std::inner_product(error.begin(), error.end(), error.begin(),
+                                   DType{0});
+    xt::blas::gemv(batch_x, error, grad, true);
+    grad /= static_cast<DType>(batch_size);
+
+    xt::noalias(eg_sum) = rho * eg_sum + (1 - rho) * grad * grad;
+    xt::noalias(delta) =
+        -xt::sqrt(ex_sum + eps) / xt::sqrt(eg_sum + eps) * grad;
+    xt::noalias(ex_sum) = rho * ex_sum + (1 - rho) * delta * delta;
+    xt::noalias(b) += delta;
+    return cost;
+  };
+
+  std::mt19937 generator(3465467546);
+  std::vector<size_t> order;
+  DType best_cost = std::numeric_limits<DType>::max();
+  Matrix best_b = b;  // coefficients of the best epoch
+  size_t bad_epochs = 0;
+  for (size_t i = 0; i < n_epochs && bad_epochs < patience; ++i) {
+    DType cost = 0;
+    size_t cost_rows = 0;
+    size_t filled = 0;  // rows of the current batch
+    for_each_chunk(reader, [&](const DType* values, size_t rows) {
+      order.resize(rows);
+      std::iota(order.begin(), order.end(), 0);
+      std::shuffle(order.begin(), order.end(), generator);
+      for (auto r : order) {
+        auto x = values[r * 2];
+        auto y = values[r * 2 + 1];
+        if (!std::isfinite(x) || !std::isfinite(y))
+          continue;  // ignore bad formated samples
+        fill_polynomial_row(x, scaling, &batch_x(filled, 0));
+        batch_y(filled) = (y - scaling.y_mean) / scaling.y_sd;
+        if (++filled == batch_size) {
+          cost += step();
+          cost_rows += batch_size;
+          filled = 0;
+        }
+      }
+    });
+    // samples of the last incomplete batch are skipped
+    if (cost_rows == 0)
+      throw std::runtime_error("Training file has less samples than batch");
+    cost /= static_cast<DType>(cost_rows);
+
+    std::cout << "Stream iteration : " << i << " Cost = " << cost
+              << std::endl;
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_b = b;
+      bad_epochs = 0;
+    } else {
+      ++bad_epochs;  // early stopping
+    }
+  }
+  return best_b;
+}
+
+auto make_stream_regression_model(const std::string& file_name,
+                                  size_t p_degree,
+                                  size_t batch_size) {
+  csv::ReadOptions options;
+  options.delimiter = '\t';
+  options.has_header = false;
+  options.has_labels = false;
+  csv::Reader reader(file_name, options);
+  if (reader.GetFeaturesCount() != 2)
+    throw std::runtime_error("Training file should have X and Y columns");
+
+  auto scaling = get_polynomial_scaling(reader, p_degree);
+  Matrix b = adadelta_stream(reader, scaling, batch_size);
+
+  auto model = [b, scaling](const auto& data_x) {
+    return predict_polynomial(data_x, b, scaling);
   };
   return model;
 }
@@ -214,11 +582,16 @@ int main() {
   auto line_model = make_regression_model(data_x, data_y, 2, false);
   Matrix line_values = line_model(new_x);
 
+  // poly line trained out of core
+  auto poly_model_stream = make_stream_regression_model(data_path, 10, 15);
+  Matrix poly_line_values_stream = poly_model_stream(new_x);
+
   // create adaptors with STL like interfaces
   auto x_coord = xt::view(new_x, xt::all());
   auto line = xt::view(line_values, xt::all());
   auto polyline = xt::view(poly_line_values, xt::all());
   auto polyline_eq = xt::view(poly_line_values_eq, xt::all());
+  auto polyline_stream = xt::view(poly_line_values_stream, xt::all());
 
   // plot the data we read and approximate
   plotcpp::Plot plt(true);
@@ -247,7 +620,11 @@ int main() {
              plotcpp::Lines(x_coord.begin(), x_coord.end(), polyline.begin(),
                             "poly line approx d = 10", "lc rgb 'cyan' lw 2"),
              plotcpp::Lines(x_coord.begin(), x_coord.end(), polyline_eq.begin(),
-                            "poly line approx d = 64", "lc rgb 'green' lw 2"));
+                            "poly line approx d = 64", "lc rgb 'green' lw 2"),
+             plotcpp::Lines(x_coord.begin(), x_coord.end(),
+                            polyline_stream.begin(),
+                            "stream poly line approx d = 10",
+                            "lc rgb 'blue' lw 2"));
   plt.Flush();
 
   return 0;
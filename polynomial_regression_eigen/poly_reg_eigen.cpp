@@ -9,12 +9,18 @@
 
 // stl includes
 #include <algorithm>
+#include <cmath>
 #include <experimental/filesystem>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <random>
+#include <stdexcept>
 #include <string>
 
 // application includes
+#include "../chunkprefetcher.h"
+#include "../csvreader.h"
 #include "../ioutils.h"
 #include "../utils.h"
 
@@ -22,6 +28,8 @@
 namespace fs = std::experimental::filesystem;
 typedef double DType;
 using Matrix = Eigen::Matrix<DType, Eigen::Dynamic, Eigen::Dynamic>;
+using RowMatrix =
+    Eigen::Matrix<DType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
 
 auto standardize(const Matrix& v) {
   assert(v.cols() == 1);
@@ -37,25 +45,31 @@ auto generate_polynomial(const Matrix& x, size_t degree) {
   assert(x.cols() == 1);
   auto rows = x.rows();
 
-  Matrix poly_x = Matrix::Zero(rows, degree);
+  Matrix poly_x(rows, degree);
   // fill additional column for simpler vectorization
-  {
-    auto xv = poly_x.block(0, 0, rows, 1);
-    xv.setOnes();
-  }
-  // copy initial data
-  {
-    auto xv = poly_x.block(0, 1, rows, 1);
-    xv = x;
-  }
-  // generate additional terms
-  for (size_t i = 2; i < degree; ++i) {
-    auto xv = poly_x.block(0, i, rows, 1);
-    xv = x.array().pow(static_cast<DType>(i));
-  }
+  poly_x.col(0).setOnes();
+  // every term is the previous one multiplied by X, columns are contiguous so
+  // each term is one vectorized pass without pow() calls
+  for (size_t i = 1; i < degree; ++i)
+    poly_x.col(i) = poly_x.col(i - 1).cwiseProduct(x.col(0));
   return poly_x;
 }
 
+/*
+ * Lazy expression of the polynomial values for `x`, every value is evaluated
+ * with Horner's rule when the expression is assigned, so the design matrix
+ * for new points is never allocated.
+ */
+template <typename X>
+auto predict_polynomial(const Eigen::MatrixBase<X>& x, const Matrix& b) {
+  return x.unaryExpr([b](DType value) {
+    DType y = 0;
+    for (auto i = b.rows(); i-- > 0;)
+      y = y * value + b(i, 0);
+    return y;
+  });
+}
+
 auto bgd(const Matrix& x, const Matrix& y) {
   size_t batch_size = 8;
   size_t n_epochs = 1000;
@@ -94,6 +108,228 @@ auto bgd(const Matrix& x, const Matrix& y) {
   return b;
 }
 
+// ----------- Closed form solution
+
+/*
+ * Terms of the normal equation (X^T X) b = X^T y. They are summed over row
+ * blocks in parallel, every thread has its own accumulators, so besides the
+ * rows only O(d^2) memory is used and X can be passed in parts.
+ */
+struct NormalEquation {
+  explicit NormalEquation(Eigen::Index cols)
+      : xtx(Matrix::Zero(cols, cols)), xty(Matrix::Zero(cols, 1)) {}
+
+  template <typename X, typename Y>
+  void add(const Eigen::MatrixBase<X>& x, const Eigen::MatrixBase<Y>& y) {
+    const Eigen::Index cols = xtx.cols();
+    const Eigen::Index block_size = 256;
+    const Eigen::Index blocks = (x.rows() + block_size - 1) / block_size;
+#pragma omp parallel
+    {
+      Matrix local_xtx = Matrix::Zero(cols, cols);
+      Matrix local_xty = Matrix::Zero(cols, 1);
+#pragma omp for schedule(static)
+      for (Eigen::Index bi = 0; bi < blocks; ++bi) {
+        auto s = bi * block_size;
+        auto n = std::min(block_size, x.rows() - s);
+        auto block_x = x.middleRows(s, n);
+        // symmetric rank update fills the lower triangle only
+        local_xtx.selfadjointView<Eigen::Lower>().rankUpdate(
+            block_x.transpose());
+        local_xty.noalias() += block_x.transpose() * y.middleRows(s, n);
+      }
+#pragma omp critical
+      {
+        xtx.triangularView<Eigen::Lower>() += local_xtx;
+        xty += local_xty;
+      }
+    }
+  }
+
+  Matrix xtx;  // lower triangle is valid
+  Matrix xty;
+};
+
+/*
+ * Solves the normal equation with Cholesky decomposition, if it fails or the
+ * system is too ill conditioned, least squares are solved with pivoting QR
+ * of X, which doesn't square the condition number.
+ */
+Matrix solve_normal_equation(const NormalEquation& eq,
+                             const Matrix& x,
+                             const Matrix& y) {
+  const DType min_rcond = 1e-12;
+  Eigen::LLT<Matrix, Eigen::Lower> llt(eq.xtx);
+  if (llt.info() == Eigen::Success && llt.rcond() > min_rcond)
+    return llt.solve(eq.xty);
+  std::cout << "normal equation is ill conditioned, using QR" << std::endl;
+  return x.colPivHouseholderQr().solve(y);
+}
+
+// ----------- Out of core training
+
+// Online mean and sample standard deviation (Welford)
+struct Moments {
+  void add(DType value) {
+    ++n;
+    auto delta = value - mean;
+    mean += delta / static_cast<DType>(n);
+    m2 += delta * (value - mean);
+  }
+  DType sd() const {
+    return n > 1 ? std::sqrt(m2 / static_cast<DType>(n - 1)) : 1;
+  }
+
+  size_t n{0};
+  DType mean{0};
+  DType m2{0};
+};
+
+// Standardization and scale of X and Y, same as in main for in memory data
+struct StreamScaling {
+  DType x_mean{0};
+  DType x_sd{1};
+  DType y_mean{0};
+  DType y_sd{1};
+  DType scale{1};
+};
+
+// Calls func(values, rows) for every chunk of the file with (x, y) rows, the
+// next chunk is parsed in background
+template <typename F>
+void for_each_chunk(csv::Reader& reader, F&& func) {
+  csv::ChunkPrefetcher<DType> prefetcher(reader);
+  const DType* values = nullptr;
+  const uint32_t* labels = nullptr;
+  size_t rows = 0;
+  while (prefetcher.Next(&values, &labels, &rows))
+    func(values, rows);
+}
+
+StreamScaling get_stream_scaling(csv::Reader& reader, DType scale) {
+  Moments x_moments;
+  Moments y_moments;
+  for_each_chunk(reader, [&](const DType* values, size_t rows) {
+    for (size_t r = 0; r < rows; ++r) {
+      auto x = values[r * 2];
+      auto y = values[r * 2 + 1];
+      if (std::isfinite(x) && std::isfinite(y)) {
+        x_moments.add(x);
+        y_moments.add(y);
+      }
+    }
+  });
+  if (x_moments.n < 2)
+    throw std::runtime_error("Not enough samples in the training file");
+  StreamScaling scaling;
+  scaling.x_mean = x_moments.mean;
+  scaling.x_sd = x_moments.sd();
+  scaling.y_mean = y_moments.mean;
+  scaling.y_sd = y_moments.sd();
+  scaling.scale = scale;
+  return scaling;
+}
+
+// Writes polynomial terms of one sample to the row of the batch, powers are
+// computed with incremental multiplication
+template <typename Row>
+void fill_polynomial_row(DType x, const StreamScaling& scaling, Row&& row) {
+  DType z = (x - scaling.x_mean) / scaling.x_sd * scaling.scale;
+  DType power = 1;
+  for (Eigen::Index i = 0; i < row.size(); ++i) {
+    row(i) = power;
+    power *= z;
+  }
+}
+
+/*
+ * Mini-batch AdaDelta over the file which doesn't fit into memory. Chunks are
+ * read with prefetch, polynomial features are generated for every batch into
+ * the same buffers and rows are shuffled inside a chunk.
+ */
+Matrix adadelta_stream(csv::Reader& reader,
+                       const StreamScaling& scaling,
+                       size_t p_degree) {
+  size_t batch_size = 8;
+  size_t n_epochs = 1000;
+  size_t patience = 10;  // epochs without improvement before stop
+  DType rho = 0.99;
+  DType eps = 1e-6;
+
+  auto cols = static_cast<Eigen::Index>(p_degree);
+  auto batch_rows = static_cast<Eigen::Index>(batch_size);
+  Matrix b = Matrix::Zero(cols, 1);
+  Matrix grad = Matrix::Zero(cols, 1);
+  Matrix delta = Matrix::Zero(cols, 1);
+  Matrix eg_sum = Matrix::Zero(cols, 1);
+  Matrix ex_sum = Matrix::Zero(cols, 1);
+  // rows are filled one by one, so the batch is row major
+  RowMatrix batch_x = RowMatrix::Zero(batch_rows, cols);
+  Matrix batch_y = Matrix::Zero(batch_rows, 1);
+  Matrix error = Matrix::Zero(batch_rows, 1);
+
+  // returns squared error sum of the batch before the update
+  auto step = [&]() {
+    error.noalias() = batch_x * b;
+    error -= batch_y;
+    grad.noalias() = batch_x.transpose() * error;
+    grad /= static_cast<DType>(batch_size);
+
+    eg_sum = rho * eg_sum + (1 - rho) * grad.cwiseAbs2();
+    delta = -((ex_sum.array() + eps).sqrt() / (eg_sum.array() + eps).sqrt() *
+              grad.array())
+                 .matrix();
+    ex_sum = rho * ex_sum + (1 - rho) * delta.cwiseAbs2();
+    b += delta;
+    return error.squaredNorm();
+  };
+
+  std::mt19937 generator(3465467546);
+  std::vector<size_t> order;
+  DType best_cost = std::numeric_limits<DType>::max();
+  Matrix best_b = b;  // coefficients of the best epoch
+  size_t bad_epochs = 0;
+  for (size_t i = 0; i < n_epochs && bad_epochs < patience; ++i) {
+    DType cost = 0;
+    size_t cost_rows = 0;
+    Eigen::Index filled = 0;  // rows of the current batch
+    for_each_chunk(reader, [&](const DType* values, size_t rows) {
+      order.resize(rows);
+      std::iota(order.begin(), order.end(), 0);
+      std::shuffle(order.begin(), order.end(), generator);
+      for (auto r : order) {
+        auto x = values[r * 2];
+        auto y = values[r * 2 + 1];
+        if (!std::isfinite(x) || !std::isfinite(y))
+          continue;  // ignore bad formated samples
+        fill_polynomial_row(x, scaling, batch_x.row(filled));
+        batch_y(filled, 0) =
+            (y - scaling.y_mean) / scaling.y_sd * scaling.scale;
+        if (++filled == batch_rows) {
+          cost += step();
+          cost_rows += batch_size;
+          filled = 0;
+        }
+      }
+    });
+    // samples of the last incomplete batch are skipped
+    if (cost_rows == 0)
+      throw std::runtime_error("Training file has less samples than batch");
+    cost /= static_cast<DType>(cost_rows);
+
+    std::cout << "Stream iteration : " << i << " Cost = " << cost
+              << std::endl;
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_b = b;
+      bad_epochs = 0;
+    } else {
+      ++bad_epochs;  // early stopping
+    }
+  }
+  return best_b;
+}
+
 int main() {
   // Download the data
   const std::string data_path{"web_traffic.tsv"};
@@ -140,7 +376,9 @@ int main() {
   const auto data_x = Eigen::Map<Matrix>(raw_data_x.data(), rows, 1);
   std::cout << "X shape " << data_x.rows() << ":" << data_x.cols() << std::endl;
   Matrix x;
-  std::tie(x, std::ignore, std::ignore) = standardize(data_x);
+  DType xm{0};
+  DType xsd{0};
+  std::tie(x, xm, xsd) = standardize(data_x);
 
   const auto data_y = Eigen::Map<Matrix>(raw_data_y.data(), rows, 1);
   std::cout << "Y shape " << data_y.rows() << ":" << data_y.cols() << std::endl;
@@ -158,8 +396,9 @@ int main() {
 
   // solve normal equation
   Matrix poly_x = generate_polynomial(x, p_degree);
-  Matrix b_eq =
-      (poly_x.transpose() * poly_x).ldlt().solve(poly_x.transpose() * y);
+  NormalEquation eq(p_degree);
+  eq.add(poly_x, y);
+  Matrix b_eq = solve_normal_equation(eq, poly_x, y);
   auto cost =
       (y - poly_x * b_eq).array().pow(2.f).sum() / static_cast<DType>(rows);
   std::cout << "cost for normal equation solution : " << cost << std::endl;
@@ -167,25 +406,40 @@ int main() {
   // optimize with BGD
   Matrix b = bgd(poly_x, y);
 
+  // optimize with AdaDelta reading the file in chunks
+  csv::ReadOptions stream_options;
+  stream_options.delimiter = '\t';
+  stream_options.has_header = false;
+  stream_options.has_labels = false;
+  csv::Reader stream_reader(data_path, stream_options);
+  auto stream_scaling = get_stream_scaling(stream_reader, scale);
+  Matrix b_stream = adadelta_stream(stream_reader, stream_scaling, p_degree);
+
   // generate new data
   const size_t new_x_size = 500;
   std::vector<DType> x_coord(new_x_size);
   auto new_x = Eigen::Map<Matrix>(x_coord.data(), new_x_size, 1);
   new_x = Eigen::Matrix<DType, Eigen::Dynamic, 1>::LinSpaced(
       new_x_size, data_x.minCoeff(), data_x.maxCoeff());
-  Matrix new_x_std;
-  std::tie(new_x_std, std::ignore, std::ignore) = standardize(new_x);
-  new_x_std *= scale;
-  Matrix new_poly_x = generate_polynomial(new_x_std, p_degree);
+  // new values are scaled the same way as the training ones
+  Matrix new_x_std = ((new_x.array() - xm) / xsd * scale).matrix();
 
   // make predictions
   std::vector<DType> polyline_eq(new_x_size);
   auto new_y_eq = Eigen::Map<Matrix>(polyline_eq.data(), new_x_size, 1);
-  new_y_eq = new_poly_x * b_eq;
+  new_y_eq = predict_polynomial(new_x_std, b_eq);
 
   std::vector<DType> polyline(new_x_size);
   auto new_y = Eigen::Map<Matrix>(polyline.data(), new_x_size, 1);
-  new_y = new_poly_x * b;
+  new_y = predict_polynomial(new_x_std, b);
+
+  std::vector<DType> polyline_stream(new_x_size);
+  auto new_y_stream =
+      Eigen::Map<Matrix>(polyline_stream.data(), new_x_size, 1);
+  Matrix stream_x = ((new_x.array() - stream_scaling.x_mean) /
+                     stream_scaling.x_sd * stream_scaling.scale)
+                        .matrix();
+  new_y_stream = predict_polynomial(stream_x, b_stream);
 
   // restore scalenew_y
   new_y_eq /= scale;
@@ -194,6 +448,10 @@ int main() {
   new_y /= scale;
   new_y = (new_y * ysd).array() + ym;
 
+  new_y_stream /= scale;
+  new_y_stream = (new_y_stream * stream_scaling.y_sd).array() +
+                 stream_scaling.y_mean;
+
   // plot the data we read and approximate
   plotcpp::Plot plt(true);
   plt.SetTerminal("qt");
@@ -219,7 +477,10 @@ int main() {
              plotcpp::Lines(x_coord.begin(), x_coord.end(), polyline_eq.begin(),
                             "neq approx", "lc rgb 'red' lw 2"),
              plotcpp::Lines(x_coord.begin(), x_coord.end(), polyline.begin(),
-                            "bgd approx", "lc rgb 'cyan' lw 2"));
+                            "bgd approx", "lc rgb 'cyan' lw 2"),
+             plotcpp::Lines(x_coord.begin(), x_coord.end(),
+                            polyline_stream.begin(), "stream approx",
+                            "lc rgb 'blue' lw 2"));
   plt.Flush();
 
   return 0;
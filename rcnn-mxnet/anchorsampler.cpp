@@ -1,8 +1,31 @@
 #include "anchorsampler.h"
-#include "bbox.h"
 
-#include <iostream>
-#include <random>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+const uint32_t seed = 5675317;
+
+inline float Overlap(const float* anchor,
+                     float anchor_area,
+                     const float* gt_box) {
+  auto iw = std::min(anchor[2], gt_box[2]) - std::max(anchor[0], gt_box[0]) + 1;
+  if (iw > 0) {
+    auto ih =
+        std::min(anchor[3], gt_box[3]) - std::max(anchor[1], gt_box[1]) + 1;
+    if (ih > 0) {
+      auto all_area = anchor_area + gt_box[4] - iw * ih;
+      return iw * ih / all_area;
+    }
+  }
+  return 0;
+}
+
+inline float Area(const float* box) {
+  return (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+}
+}  // namespace
 
 AnchorSampler::AnchorSampler(const Params& params)
     : allowed_border_(params.rpn_allowed_border),
@@ -13,158 +36,152 @@ AnchorSampler::AnchorSampler(const Params& params)
   num_fg_ = static_cast<Eigen::Index>(num_batch_ * fg_fraction_);
 }
 
-std::tuple<Eigen::MatrixXf, Eigen::MatrixXf, Eigen::MatrixXf>
-AnchorSampler::Assign(const Eigen::MatrixXf& anchors,
-                      const Eigen::MatrixXf& all_gt_boxes,
-                      float im_width,
-                      float im_height) {
-  // filter out padded gt_boxes
-  auto num_valid_boxes = (all_gt_boxes.rightCols(1).array() > 0).count();
-  auto boxes_cols = all_gt_boxes.cols();
-  Eigen::MatrixXf gt_boxes(num_valid_boxes, all_gt_boxes.cols());
-  for (Eigen::Index i = 0, j = 0; i < num_valid_boxes; ++i) {
-    if (all_gt_boxes(i, boxes_cols - 1) > 0.f) {
-      gt_boxes.row(j++) = all_gt_boxes.row(i);
-    }
+/*
+ * Leaves `keep` random labels from `indices`, other ones are set to -1. Only
+ * `keep` elements are drawn (partial Fisher-Yates), instead of the full
+ * shuffle.
+ */
+void AnchorSampler::Subsample(std::vector<Eigen::Index>& indices,
+                              size_t keep,
+                              float* labels) {
+  auto n = indices.size();
+  for (size_t i = 0; i < keep; ++i) {
+    std::uniform_int_distribution<size_t> dist(i, n - 1);
+    std::swap(indices[i], indices[dist(random_engine_)]);
   }
+  for (size_t i = keep; i < n; ++i) {
+    labels[indices[i]] = -1;
+  }
+}
 
+void AnchorSampler::Assign(const Eigen::MatrixXf& anchors,
+                           const Eigen::Ref<const RowMatrix>& gt_boxes,
+                           float im_width,
+                           float im_height,
+                           float* labels,
+                           float* bbox_targets,
+                           float* bbox_weights) {
+  random_engine_.seed(seed);
   auto n_anchors = anchors.rows();
-  // filter out anchors outside the image region
-  Eigen::ArrayXf indices_base = Eigen::ArrayXf::Constant(n_anchors, 1.f);
-
-  Eigen::ArrayXf inds_inside =
-      (anchors.block(0, 0, n_anchors, 1).array() >= -allowed_border_)
-          .select(indices_base, -indices_base);
-  inds_inside = (anchors.block(0, 1, n_anchors, 1).array() >= -allowed_border_)
-                    .select(inds_inside, -indices_base);
-  inds_inside =
-      (anchors.block(0, 2, n_anchors, 1).array() < im_width + allowed_border_)
-          .select(inds_inside, -indices_base);
-  inds_inside =
-      (anchors.block(0, 3, n_anchors, 1).array() < im_height + allowed_border_)
-          .select(inds_inside, -indices_base);
+  std::fill_n(labels, n_anchors, -1.f);
+  std::fill_n(bbox_targets, n_anchors * 4, 0.f);
+  std::fill_n(bbox_weights, n_anchors * 4, 0.f);
 
-  auto num_valid = (inds_inside > 0).count();
-
-  Eigen::MatrixXf valid_anchors(num_valid, anchors.cols());
-  for (Eigen::Index i = 0, j = 0; i < n_anchors; ++i) {
-    if (inds_inside[i] >= 1.f) {
-      valid_anchors.row(j++) = anchors.row(i);
+  // filter out padded gt_boxes
+  gt_boxes_.clear();
+  auto boxes_cols = gt_boxes.cols();
+  for (Eigen::Index i = 0; i < gt_boxes.rows(); ++i) {
+    if (gt_boxes(i, boxes_cols - 1) > 0.f) {
+      float box[4] = {gt_boxes(i, 0), gt_boxes(i, 1), gt_boxes(i, 2),
+                      gt_boxes(i, 3)};
+      gt_boxes_.insert(gt_boxes_.end(), box, box + 4);
+      gt_boxes_.push_back(Area(box));
     }
   }
+  auto n_gt = gt_boxes_.size() / 5;
 
-  // label: 1 is positive, 0 is negative, -1 is dont care
-  Eigen::MatrixXf labels = Eigen::MatrixXf::Constant(num_valid, 1, -1.f);
-  Eigen::MatrixXf bbox_targets = Eigen::MatrixXf::Zero(num_valid, 4);
-  Eigen::MatrixXf bbox_weights = Eigen::MatrixXf::Zero(num_valid, 4);
-
-  // std::random_device rd;
-  std::mt19937 mt(5675317);  // rd());
-
-  // sample for positive labels
-  if (gt_boxes.rows() > 0) {
-    // overlap between the anchors and the gt boxes
-    // result is 2d matrix with ratio of overlap (anchors, gt_boxes)
-    auto overlaps = bbox_overlaps(valid_anchors, gt_boxes);
-
-    // fg anchors: anchor with highest overlap for each gt
-    Eigen::Matrix<bool, Eigen::Dynamic, Eigen::Dynamic> gt_max_overlaps =
-        (overlaps.array() ==
-         overlaps.colwise().maxCoeff().array().replicate(overlaps.rows(), 1))
-            .matrix()
-            .rowwise()
-            .any();
-    labels = (gt_max_overlaps.array() > 0).select(1.f, labels);
-
-    // fg anchors: anchor with overlap > iou thresh
-    Eigen::MatrixXf max_overlaps = overlaps.rowwise().maxCoeff();
-    auto fg_indices_expr = max_overlaps.array() >= fg_overlap_;
-    auto fg_indices = expr_row_indices(fg_indices_expr);
-    for (auto index : fg_indices) {
-      labels(index) = 1;
-    }
-
-    // bg anchors: anchor with overlap < iou thresh
-    auto bg_indices_expr = max_overlaps.array() < bg_overlap_;
-    auto bg_indices = expr_row_indices(bg_indices_expr);
-    for (auto index : bg_indices) {
-      if (labels(index) < 0)  // don't reset previously selected rois
-        labels(index) = 0;
+  // filter out anchors outside the image region
+  inside_indices_.clear();
+  for (Eigen::Index i = 0; i < n_anchors; ++i) {
+    if (anchors(i, 0) >= -allowed_border_ &&
+        anchors(i, 1) >= -allowed_border_ &&
+        anchors(i, 2) < im_width + allowed_border_ &&
+        anchors(i, 3) < im_height + allowed_border_)
+      inside_indices_.push_back(i);
+  }
+  auto num_valid = inside_indices_.size();
+
+  if (n_gt > 0) {
+    // overlap between the anchors and the gt boxes, keep only max values
+    max_overlaps_.resize(num_valid);
+    argmax_overlaps_.resize(num_valid);
+    gt_max_overlaps_.assign(n_gt, 0.f);
+    for (size_t j = 0; j < num_valid; ++j) {
+      auto i = inside_indices_[j];
+      float anchor[4] = {anchors(i, 0), anchors(i, 1), anchors(i, 2),
+                         anchors(i, 3)};
+      auto area = Area(anchor);
+      float max_overlap = -1;
+      uint32_t max_index = 0;
+      for (size_t k = 0; k < n_gt; ++k) {
+        auto overlap = Overlap(anchor, area, &gt_boxes_[k * 5]);
+        if (overlap >= max_overlap) {  // last max index
+          max_overlap = overlap;
+          max_index = static_cast<uint32_t>(k);
+        }
+        gt_max_overlaps_[k] = std::max(gt_max_overlaps_[k], overlap);
+      }
+      max_overlaps_[j] = max_overlap;
+      argmax_overlaps_[j] = max_index;
     }
 
-    fg_indices.clear();
-    bg_indices.clear();
-    for (Eigen::Index i = 0; i < labels.rows(); ++i) {
-      if (labels(i, 0) > 0)
-        fg_indices.push_back(i);
-      else if (labels(i, 0) >= 0 && labels(i, 0) < 1)
-        bg_indices.push_back(i);
+    fg_indices_.clear();
+    bg_indices_.clear();
+    for (size_t j = 0; j < num_valid; ++j) {
+      auto i = inside_indices_[j];
+      // fg anchors: anchor with overlap > iou thresh
+      bool fg = max_overlaps_[j] >= fg_overlap_;
+      // fg anchors: anchor with highest overlap for each gt
+      if (!fg) {
+        float anchor[4] = {anchors(i, 0), anchors(i, 1), anchors(i, 2),
+                           anchors(i, 3)};
+        auto area = Area(anchor);
+        for (size_t k = 0; k < n_gt && !fg; ++k) {
+          fg = Overlap(anchor, area, &gt_boxes_[k * 5]) == gt_max_overlaps_[k];
+        }
+      }
+      if (fg) {
+        labels[i] = 1;
+        fg_indices_.push_back(i);
+      } else if (max_overlaps_[j] < bg_overlap_) {
+        // bg anchors: anchor with overlap < iou thresh
+        labels[i] = 0;
+        bg_indices_.push_back(i);
+      }
     }
 
     // subsample positive anchors
-    Eigen::Index fg_labels_count = static_cast<Eigen::Index>(fg_indices.size());
+    auto fg_labels_count = static_cast<Eigen::Index>(fg_indices_.size());
     assert(fg_labels_count >= 1);
     if (fg_labels_count > num_fg_) {
-      auto disable_inds = random_choice(
-          fg_indices, static_cast<size_t>(fg_labels_count - num_fg_), mt);
-      for (auto index : disable_inds) {
-        labels(index) = -1;
-      }
+      Subsample(fg_indices_, static_cast<size_t>(num_fg_), labels);
     }
 
     // subsample negative anchors
-    Eigen::Index bg_labels_count = static_cast<Eigen::Index>(bg_indices.size());
+    auto bg_labels_count = static_cast<Eigen::Index>(bg_indices_.size());
     auto max_neg = num_batch_ - std::min(num_fg_, fg_labels_count);
     if (bg_labels_count > max_neg) {
-      auto disable_inds = random_choice(
-          bg_indices, static_cast<size_t>(bg_labels_count - max_neg), mt);
-      for (auto index : disable_inds) {
-        labels(index) = -1;
-      }
+      Subsample(bg_indices_, static_cast<size_t>(max_neg), labels);
     }
 
-    assert(fg_labels_count >= (labels.array() > 0).count());
-    assert(max_neg >= (labels.array() == 0).count());
-
-    // make gt_box correspondence for each positive anchor
-    Eigen::MatrixXf anchors_gt_boxes(valid_anchors.rows(), gt_boxes.cols());
-    auto anchor_box_inds = argmax(overlaps).second;
-    assert(labels.rows() == anchor_box_inds.rows());
-    for (Eigen::Index i = 0; i < num_valid; ++i) {
-      anchors_gt_boxes.row(i) = gt_boxes.row(anchor_box_inds(i));
+    // calculate anchor vs bbox offsets, only fg anchors has bbox_targets
+    for (size_t j = 0; j < num_valid; ++j) {
+      auto i = inside_indices_[j];
+      if (labels[i] >= 1.f) {
+        const auto* gt_box = &gt_boxes_[argmax_overlaps_[j] * 5];
+        float ex_width = anchors(i, 2) - anchors(i, 0) + 1.f;
+        float ex_height = anchors(i, 3) - anchors(i, 1) + 1.f;
+        float ex_ctr_x = anchors(i, 0) + 0.5f * (ex_width - 1.f);
+        float ex_ctr_y = anchors(i, 1) + 0.5f * (ex_height - 1.f);
+        float gt_width = gt_box[2] - gt_box[0] + 1.f;
+        float gt_height = gt_box[3] - gt_box[1] + 1.f;
+        float gt_ctr_x = gt_box[0] + 0.5f * (gt_width - 1.f);
+        float gt_ctr_y = gt_box[1] + 0.5f * (gt_height - 1.f);
+
+        auto* target = bbox_targets + i * 4;
+        target[0] = (gt_ctr_x - ex_ctr_x) / (ex_width + 1e-14f);
+        target[1] = (gt_ctr_y - ex_ctr_y) / (ex_height + 1e-14f);
+        target[2] = std::log(gt_width / ex_width);
+        target[3] = std::log(gt_height / ex_height);
+        std::fill_n(bbox_weights + i * 4, 4, 1.f);
+      }
     }
-
-    // calculate anchor vs bbox offsets
-    auto raw_bbox_targets =
-        bbox_transform(valid_anchors, anchors_gt_boxes, {1, 1, 1, 1});
-    bbox_targets = (labels.replicate(1, bbox_targets.cols()).array() >= 1.f)
-                       .select(raw_bbox_targets, bbox_targets);
-
-    // only fg anchors has bbox_targets
-    bbox_weights = (labels.replicate(1, bbox_weights.cols()).array() >= 1.f)
-                       .select(1.f, bbox_weights);
   } else {
     // randomly draw bg anchors
-    std::vector<Eigen::Index> bg_inds(static_cast<size_t>(labels.rows()));
-    std::iota(bg_inds.begin(), bg_inds.end(), 0);
-    bg_inds = random_choice(bg_inds, static_cast<size_t>(num_batch_), mt);
-    for (auto index : bg_inds) {
-      labels(index) = 0;
+    auto keep = std::min(num_valid, static_cast<size_t>(num_batch_));
+    for (auto i : inside_indices_) {
+      labels[i] = 0;
     }
+    Subsample(inside_indices_, keep, labels);
   }
-
-  // make final result
-  Eigen::MatrixXf all_labels = Eigen::MatrixXf::Constant(n_anchors, 1, -1.f);
-  Eigen::MatrixXf all_bbox_targets = Eigen::MatrixXf::Zero(n_anchors, 4);
-  Eigen::MatrixXf all_bbox_weights = Eigen::MatrixXf::Zero(n_anchors, 4);
-  for (Eigen::Index i = 0, j = 0; i < n_anchors; ++i) {
-    if (inds_inside[i] >= 1.f) {
-      all_labels(i, 0) = labels(j, 0);
-      all_bbox_targets.row(i) = bbox_targets.row(j);
-      all_bbox_weights.row(i) = bbox_weights.row(j);
-      ++j;
-    }
-  }
-
-  return {all_labels, all_bbox_targets, all_bbox_weights};
 }
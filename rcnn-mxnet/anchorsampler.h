@@ -4,16 +4,42 @@
 #include "params.h"
 
 #include <Eigen/Dense>
-#include <tuple>
+
+#include <cstdint>
+#include <random>
+#include <vector>
 
 class AnchorSampler {
  public:
+  using RowMatrix =
+      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
   AnchorSampler(const Params& params);
-  std::tuple<Eigen::MatrixXf, Eigen::MatrixXf, Eigen::MatrixXf> Assign(
-      const Eigen::MatrixXf& anchors,
-      const Eigen::MatrixXf& gt_boxes,
-      float im_width,
-      float im_height);
+  AnchorSampler(const AnchorSampler&) = delete;
+  AnchorSampler& operator=(const AnchorSampler&) = delete;
+
+  /*
+   * anchors: [n_anchors, 4] (x1, y1, x2, y2)
+   * gt_boxes: [n, 4] padded with -1 rows, row major blocks of the batch
+   * boxes are referenced without copying
+   * Results are written to row major buffers:
+   * labels: [n_anchors] - 1 is positive, 0 is negative, -1 is dont care
+   * bbox_targets, bbox_weights: [n_anchors, 4]
+   * Internal buffers are reused between calls, so one sampler should be used
+   * by one thread only.
+   */
+  void Assign(const Eigen::MatrixXf& anchors,
+              const Eigen::Ref<const RowMatrix>& gt_boxes,
+              float im_width,
+              float im_height,
+              float* labels,
+              float* bbox_targets,
+              float* bbox_weights);
+
+ private:
+  void Subsample(std::vector<Eigen::Index>& indices,
+                 size_t keep,
+                 float* labels);
 
  private:
   float allowed_border_ = 0;
@@ -22,6 +48,16 @@ class AnchorSampler {
   float fg_fraction_ = 0;
   float fg_overlap_ = 0;
   float bg_overlap_ = 0;
+
+  // workspace
+  std::mt19937 random_engine_;
+  std::vector<float> gt_boxes_;  // [n, 5] x1, y1, x2, y2, area
+  std::vector<float> gt_max_overlaps_;
+  std::vector<Eigen::Index> inside_indices_;
+  std::vector<float> max_overlaps_;
+  std::vector<uint32_t> argmax_overlaps_;
+  std::vector<Eigen::Index> fg_indices_;
+  std::vector<Eigen::Index> bg_indices_;
 };
 
 #endif  // ANCHORSAMPLER_H
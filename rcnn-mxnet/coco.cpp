@@ -2,14 +2,11 @@
 
 #include "imageutils.h"
 
-#include <rapidjson/error/en.h>
-#include <rapidjson/filereadstream.h>
-#include <rapidjson/reader.h>
-
 #include <cstdlib>
 #include <experimental/filesystem>
 #include <iostream>
 #include <string>
+#include <tuple>
 
 namespace fs = std::experimental::filesystem;
 
@@ -112,299 +109,97 @@ Coco::Coco(const std::string& path) {
     throw std::runtime_error(test_annotations_file_ + " file missed");
 }
 
-struct CocoHandler
-    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CocoHandler> {
-  CocoHandler(Coco* coco) : coco_(coco) {}
-  bool Double(double u) {
-    if (annotation_object_) {
-      if (bbox_array_) {
-        annotation_.push_bbox(u);
-      }
-    }
-    return true;
-  }
-
-  bool Uint(unsigned u) {
-    if (image_object_) {
-      if (key_ == "id") {
-        image_.id = u;
-      } else if (key_ == "width") {
-        image_.width = u;
-      } else if (key_ == "height") {
-        image_.height = u;
-      }
-    } else if (category_object_) {
-      if (key_ == "id") {
-        category_.id = u;
-      }
-    } else if (annotation_object_) {
-      if (key_ == "id") {
-        annotation_.id = u;
-      } else if (key_ == "image_id") {
-        annotation_.image_id = u;
-      } else if (key_ == "category_id") {
-        annotation_.category_id = u;
-      }
-    }
-    return true;
-  }
-
-  bool String(const char* str, rapidjson::SizeType length, bool /*copy*/) {
-    if (image_object_) {
-      if (key_ == "file_name") {
-        image_.name.assign(str, length);
-      }
-    } else if (category_object_) {
-      if (key_ == "name") {
-        category_.name.assign(str, length);
-      }
-    }
-    return true;
-  }
-  bool StartObject() {
-    if (image_array_) {
-      image_object_ = true;
-    } else if (category_array_) {
-      category_object_ = true;
-    } else if (annotation_array_) {
-      annotation_object_ = true;
-    }
-    return true;
-  }
-  bool Key(const char* str, rapidjson::SizeType length, bool /*copy*/) {
-    key_ = std::string(str, length);
-    return true;
-  }
-  bool EndObject(rapidjson::SizeType /*memberCount*/) {
-    if (image_array_ && image_object_) {
-      coco_->AddImage(image_);
-      image_object_ = false;
-    } else if (category_array_ && category_object_) {
-      coco_->AddCategory(category_);
-      category_object_ = false;
-    } else if (annotation_array_ && annotation_object_) {
-      coco_->AddAnnotation(annotation_);
-      annotation_object_ = false;
-    }
-    key_.clear();
-    return true;
-  }
-  bool StartArray() {
-    if (key_ == "images") {
-      image_array_ = true;
-      array_close_ = &image_array_;
-    } else if (key_ == "categories") {
-      category_array_ = true;
-      array_close_ = &category_array_;
-    } else if (key_ == "annotations") {
-      annotation_array_ = true;
-      array_close_ = &annotation_array_;
-    } else if (annotation_object_ && key_ == "bbox") {
-      bbox_array_ = true;
-      array_close_ = &bbox_array_;
-    } else {
-      array_close_ = nullptr;
-    }
-    return true;
-  }
-  bool EndArray(rapidjson::SizeType /*elementCount*/) {
-    if (array_close_) {
-      *array_close_ = false;
-    }
-    key_.clear();
-    return true;
-  }
-
-  std::string key_;
-
-  CocoAnnotation annotation_;
-  bool annotation_array_ = false;
-  bool annotation_object_ = false;
-
-  CocoCategory category_;
-  bool category_array_ = false;
-  bool category_object_ = false;
-
-  CocoImage image_;
-  bool image_array_ = false;
-  bool image_object_ = false;
-
-  bool bbox_array_ = false;
-
-  bool* array_close_ = nullptr;
-  Coco* coco_ = nullptr;
-};
-
 void Coco::LoadTrainData(const std::vector<uint32_t>& keep_classes,
                          float keep_aspect) {
-  auto* file = std::fopen(train_annotations_file_.c_str(), "r");
-  if (file) {
-    char readBuffer[65536];
-    rapidjson::FileReadStream is(file, readBuffer, sizeof(readBuffer));
-    rapidjson::Reader reader;
-    CocoHandler handler(this);
-    const uint32_t n_reserve = 100000;
-    images_.reserve(n_reserve);
-    annotations_.reserve(n_reserve);
-    categories_.reserve(n_reserve);
-    auto res = reader.Parse(is, handler);
-    std::fclose(file);
-
-    if (!res) {
-      throw std::runtime_error(rapidjson::GetParseError_En(res.Code()));
-    }
-
-    // remove images without annotations
-    std::vector<uint32_t> images_to_remove;
-    for (auto& img : images_) {
-      auto image_id = img.first;
-      auto i = image_to_ant_index_.find(image_id);
-      if (i == image_to_ant_index_.end()) {
-        images_to_remove.push_back(image_id);
-      }
-    }
-    for (auto image_id : images_to_remove) {
-      images_.erase(image_id);
-    }
-
-    // map categories to classes
-    for (auto& cat : categories_) {
-      auto i =
-          std::find(coco_classes.begin(), coco_classes.end(), cat.second.name);
-      auto pos = std::distance(coco_classes.begin(), i);
-      cat_ind_to_class_ind_.insert({cat.second.id, static_cast<uint32_t>(pos)});
-    }
-    // filter - leave images with required aspect ration only
-    if (keep_aspect > 0) {
-      images_to_remove.clear();
-      for (auto& img : images_) {
-        auto aspect = static_cast<float>(img.second.width) /
-                      static_cast<float>(img.second.height);
-        if (std::abs(aspect - keep_aspect) > 0.001f) {
-          images_to_remove.push_back(img.first);
-        }
-      }
-      for (auto image_id : images_to_remove) {
-        images_.erase(image_id);
-      }
-    }
-
-    // filter - leave only required classes
-    if (!keep_classes.empty()) {
-      std::unordered_set<uint32_t> keep_classes_set;
-      keep_classes_set.insert(keep_classes.begin(), keep_classes.end());
-      images_to_remove.clear();
-      for (auto& img : images_) {
-        auto image_id = img.first;
-        bool skip = true;
-        std::vector<uint32_t> ant_to_remove;
-        auto& ants = image_to_ant_index_[image_id];
-        for (auto ant_id : ants) {
-          auto class_ind =
-              cat_ind_to_class_ind_[annotations_[ant_id].category_id];
-          bool is_keep_class =
-              keep_classes_set.find(class_ind) != keep_classes_set.end();
-          if (is_keep_class) {
-            skip = false;
-          } else {
-            ant_to_remove.push_back(ant_id);
-          }
-        }
-
-        if (skip) {
-          images_to_remove.push_back(image_id);
-        } else {
-          for (auto ant_id : ant_to_remove) {
-            // leave only keep classes annotations
-            ants.erase(ant_id);
-          }
-        }
-      }
-      for (auto image_id : images_to_remove) {
-        images_.erase(image_id);
-      }
-    }
-  } else {
-    throw std::runtime_error(train_annotations_file_ + " file can't be opened");
-  }
+  coco::LoadOptions options;
+  options.classes = coco_classes;
+  options.keep_classes = keep_classes;
+  options.keep_aspect = keep_aspect;
+  index_ = coco::Index::Load(train_annotations_file_, options,
+                             train_annotations_file_ + ".bin");
 }
 
-void Coco::AddImage(CocoImage image) {
-  images_.emplace(std::make_pair(image.id, image));
+uint32_t Coco::GetImagesCount() const {
+  return static_cast<uint32_t>(index_.GetImagesCount());
 }
 
-void Coco::AddAnnotation(CocoAnnotation annotation) {
-  if (annotation.bbox.height > 0 && annotation.bbox.width > 0 &&
-      annotation.bbox.x >= 0 && annotation.bbox.y >= 0) {
-    annotations_.emplace(std::make_pair(annotation.id, annotation));
-    image_to_ant_index_[annotation.image_id].insert(annotation.id);
+ImageDesc Coco::GetImage(uint32_t index,
+                         uint32_t height,
+                         uint32_t width) const {
+  const auto& image = index_.GetImage(index);
+  fs::path file_path(train_images_folder_);
+  file_path /= index_.GetImageName(image);
+  // std::cout << file_path << std::endl;
+  cv::Mat img;
+  float scale{0};
+  std::tie(img, scale) = LoadImageFitSize(file_path.string(), height, width);
+  if (!img.empty()) {
+    ImageDesc result;
+    result.image = img;
+    result.scale = scale;
+    result.height = img.rows;
+    result.width = img.cols;
+    auto ants = index_.GetAnnotations(image);
+    result.boxes.reserve(ants.size());
+    result.classes.reserve(ants.size());
+    for (const auto& ant : ants) {
+      result.boxes.push_back(
+          LabelBBox{ant.bbox.x, ant.bbox.y, ant.bbox.width, ant.bbox.height});
+      result.classes.push_back(static_cast<float>(ant.class_index));
+    }
+    return result;
+  } else {
+    throw std::runtime_error(file_path.string() + " file can't be opened");
   }
 }
 
-void Coco::AddCategory(CocoCategory category) {
-  categories_.emplace(std::make_pair(category.id, category));
-}
-
-uint32_t Coco::GetImagesCount() const {
-  return static_cast<uint32_t>(images_.size());
-}
-
 ImageDesc Coco::GetImage(uint32_t index,
                          uint32_t height,
-                         uint32_t width) const {
-  if (index < images_.size()) {
-    auto i = images_.begin();
-    std::advance(i, index);
-    fs::path file_path(train_images_folder_);
-    file_path /= i->second.name;
-    // std::cout << file_path << std::endl;
-    cv::Mat img;
-    float scale{0};
-    std::tie(img, scale) = LoadImageFitSize(file_path.string(), height, width);
-    if (!img.empty()) {
-      ImageDesc result;
-      result.image = img;
-      result.scale = scale;
-      result.height = img.rows;
-      result.width = img.cols;
-      auto& ants = image_to_ant_index_.at(i->second.id);
-      result.boxes.reserve(ants.size());
-      result.classes.reserve(ants.size());
-      for (const auto ant_id : ants) {
-        const auto& ant = annotations_.at(ant_id);
-        result.boxes.push_back(LabelBBox{static_cast<float>(ant.bbox.x),
-                                         static_cast<float>(ant.bbox.y),
-                                         static_cast<float>(ant.bbox.width),
-                                         static_cast<float>(ant.bbox.height)});
-        const auto& cat = categories_.at(ant.category_id);
-        uint32_t class_ind = cat_ind_to_class_ind_.at(cat.id);
-        result.classes.push_back(static_cast<float>(class_ind));
-      }
-      return result;
-    } else {
-      throw std::runtime_error(file_path.string() + " file can't be opened");
+                         uint32_t width,
+                         float* data) const {
+  const auto& image = index_.GetImage(index);
+  fs::path file_path(train_images_folder_);
+  file_path /= index_.GetImageName(image);
+  cv::Size size;
+  float scale{0};
+  std::tie(size, scale) =
+      LoadImageFitSize(file_path.string(), height, width, data);
+  if (!size.empty()) {
+    ImageDesc result;
+    result.scale = scale;
+    // padded size, the same as for the image returned by the other overload
+    result.height = height;
+    result.width = width;
+    auto ants = index_.GetAnnotations(image);
+    result.boxes.reserve(ants.size());
+    result.classes.reserve(ants.size());
+    for (const auto& ant : ants) {
+      result.boxes.push_back(
+          LabelBBox{ant.bbox.x, ant.bbox.y, ant.bbox.width, ant.bbox.height});
+      result.classes.push_back(static_cast<float>(ant.class_index));
     }
+    return result;
   } else {
-    throw std::out_of_range("Image index is out of bounds");
+    throw std::runtime_error(file_path.string() + " file can't be opened");
   }
 }
 
 cv::Mat Coco::DrawAnnotedImage(uint32_t id) const {
-  const auto& image = images_.at(id);
+  auto index = index_.FindImage(id);
+  const auto& image = index_.GetImage(index);
   fs::path file_path(train_images_folder_);
-  file_path /= image.name;
+  file_path /= index_.GetImageName(image);
   auto img = cv::imread(file_path.string());
   if (!img.empty()) {
-    for (const auto ant_id : image_to_ant_index_.at(id)) {
-      const auto& ant = annotations_.at(ant_id);
+    for (const auto& ant : index_.GetAnnotations(image)) {
       cv::Point tl(static_cast<int32_t>(ant.bbox.x),
                    static_cast<int32_t>(ant.bbox.y));
       cv::Point br(tl.x + static_cast<int32_t>(ant.bbox.width),
                    tl.y + static_cast<int32_t>(ant.bbox.height));
       cv::rectangle(img, tl, br, cv::Scalar(255, 0, 0));
-      const auto& cat = categories_.at(ant.category_id);
-      cv::putText(img, cat.name, tl, cv::FONT_HERSHEY_PLAIN, 1,
-                  cv::Scalar(0, 0, 255));
+      const auto* cat = index_.FindCategory(ant.category_id);
+      cv::putText(img, index_.GetCategoryName(*cat), tl,
+                  cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar(0, 0, 255));
     }
     return img;
   } else {
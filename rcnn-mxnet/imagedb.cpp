@@ -1,3 +1,19 @@
 #include "imagedb.h"
+#include "imageutils.h"
 
 ImageDb::~ImageDb() = default;
+
+ImageDesc ImageDb::GetImage(uint32_t index,
+                            uint32_t height,
+                            uint32_t width,
+                            float* data) const {
+  auto result = GetImage(index, height, width);
+  cv::Mat padded;
+  cv::copyMakeBorder(result.image, padded, 0,
+                     static_cast<int>(height) - result.image.rows, 0,
+                     static_cast<int>(width) - result.image.cols,
+                     cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 0));
+  CVToMxnetFormat(padded, data);
+  result.image = cv::Mat();
+  return result;
+}
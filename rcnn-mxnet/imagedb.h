@@ -26,6 +26,12 @@ class ImageDb {
   virtual ImageDesc GetImage(uint32_t index,
                              uint32_t height,
                              uint32_t width) const = 0;
+  // Writes the padded image in the planar RGB format to the `data` buffer of
+  // 3 * height * width size, returned description has empty image.
+  virtual ImageDesc GetImage(uint32_t index,
+                             uint32_t height,
+                             uint32_t width,
+                             float* data) const;
 };
 
 #endif  // IMAGEDB_H
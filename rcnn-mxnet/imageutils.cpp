@@ -25,24 +25,29 @@ std::pair<cv::Mat, float> LoadImage(const std::string& file_name,
   return {cv::Mat(), 0};
 }
 
+static float FitScale(const cv::Mat& img, uint32_t height, uint32_t width) {
+  float scale = 1.f;
+  // assume that an image width in most cases is bigger than height
+  float ratio = static_cast<float>(img.cols) / static_cast<float>(img.rows);
+  auto new_height = static_cast<int>(width / ratio);
+  if (new_height <= static_cast<int>(height)) {
+    scale = static_cast<float>(new_height) / static_cast<float>(img.rows);
+  } else {
+    ratio = static_cast<float>(img.rows) / static_cast<float>(img.cols);
+    auto new_width = static_cast<int>(height / ratio);
+    assert(new_width <= static_cast<int>(width));
+    scale = static_cast<float>(new_width) / static_cast<float>(img.cols);
+  }
+  return scale;
+}
+
 std::tuple<cv::Mat, float> LoadImageFitSize(const std::string& file_name,
                                             uint32_t height,
                                             uint32_t width) {
   auto img = cv::imread(file_name);
   if (!img.empty()) {
     img.convertTo(img, CV_32FC3);
-    float scale = 1.f;
-    // assume that an image width in most cases is bigger than height
-    float ratio = static_cast<float>(img.cols) / static_cast<float>(img.rows);
-    auto new_height = static_cast<int>(width / ratio);
-    if (new_height <= static_cast<int>(height)) {
-      scale = static_cast<float>(new_height) / static_cast<float>(img.rows);
-    } else {
-      ratio = static_cast<float>(img.rows) / static_cast<float>(img.cols);
-      auto new_width = static_cast<int>(height / ratio);
-      assert(new_width <= static_cast<int>(width));
-      scale = static_cast<float>(new_width) / static_cast<float>(img.cols);
-    }
+    float scale = FitScale(img, height, width);
 
     // resize
     cv::resize(img, img, cv::Size(), static_cast<double>(scale),
@@ -61,21 +66,58 @@ std::tuple<cv::Mat, float> LoadImageFitSize(const std::string& file_name,
   return {cv::Mat(), 0};
 }
 
+std::tuple<cv::Size, float> LoadImageFitSize(const std::string& file_name,
+                                             uint32_t height,
+                                             uint32_t width,
+                                             float* data) {
+  auto img = cv::imread(file_name);
+  if (!img.empty()) {
+    float scale = FitScale(img, height, width);
+
+    // resize in 8 bit, it is cheaper than in float
+    cv::resize(img, img, cv::Size(), static_cast<double>(scale),
+               static_cast<double>(scale),
+               scale >= 1.f ? cv::INTER_LINEAR : cv::INTER_AREA);
+    assert(img.rows <= static_cast<int>(height) &&
+           img.cols <= static_cast<int>(width));
+
+    // write planes directly into the buffer, padding is filled with zeros
+    auto rows = static_cast<int>(height);
+    auto cols = static_cast<int>(width);
+    auto plane_size = static_cast<size_t>(rows * cols);
+    cv::Mat channels[3];
+    cv::split(img, channels);
+    for (int c = 0; c < 3; ++c) {
+      // Convert to from BGR
+      cv::Mat plane(rows, cols, CV_32FC1, data + (2 - c) * plane_size);
+      if (img.cols < cols)
+        plane.colRange(img.cols, cols).setTo(0);
+      if (img.rows < rows)
+        plane.rowRange(img.rows, rows).setTo(0);
+      cv::Mat roi = plane(cv::Rect(0, 0, img.cols, img.rows));
+      channels[c].convertTo(roi, CV_32F);
+    }
+    return std::make_tuple(img.size(), scale);
+  }
+  return std::make_tuple(cv::Size(), 0.f);
+}
+
+void CVToMxnetFormat(const cv::Mat& img, float* data) {
+  assert(img.type() == CV_32FC3);
+  auto plane_size = static_cast<size_t>(img.rows * img.cols);
+  // Convert to from BGR, split writes to the planes in place
+  cv::Mat planes[3] = {
+      cv::Mat(img.rows, img.cols, CV_32FC1, data + 2 * plane_size),
+      cv::Mat(img.rows, img.cols, CV_32FC1, data + plane_size),
+      cv::Mat(img.rows, img.cols, CV_32FC1, data)};
+  cv::split(img, planes);
+}
+
 std::vector<float> CVToMxnetFormat(const cv::Mat& img) {
   assert(img.type() == CV_32FC3);
   auto size = img.channels() * img.rows * img.cols;
   std::vector<float> array(static_cast<size_t>(size));
-  size_t k = 0;
-  // Convert to from BGR
-  for (int c = 2; c >= 0; --c) {
-    for (int y = 0; y < img.rows; ++y) {
-      for (int x = 0; x < img.cols; ++x) {
-        auto t = (y * img.cols + x) * 3 + c;
-        array[k] = img.ptr<float>()[t];
-        ++k;
-      }
-    }
-  }
+  CVToMxnetFormat(img, array.data());
   return array;
 }
 
@@ -18,8 +18,19 @@ std::tuple<cv::Mat, float> LoadImageFitSize(const std::string& file_name,
                                             uint32_t height,
                                             uint32_t width);
 
+// load, resize with constraint proportions and write padded image to the `data`
+// buffer of 3 * height * width size in the planar RGB format
+std::tuple<cv::Size, float> LoadImageFitSize(const std::string& file_name,
+                                             uint32_t height,
+                                             uint32_t width,
+                                             float* data);
+
 std::vector<float> CVToMxnetFormat(const cv::Mat& img);
 
+// convert to the planar RGB format in place, `data` should have
+// 3 * rows * cols size
+void CVToMxnetFormat(const cv::Mat& img, float* data);
+
 void ShowResult(const std::vector<Detection>& detection,
                 const std::string& file_name,
                 const std::string& out_file_name,
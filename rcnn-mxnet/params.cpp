@@ -1,9 +1,100 @@
 #include "params.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+const char snapshot_magic[8] = {'R', 'C', 'N', 'N', 'P', 'R', 'M', '1'};
+const uint64_t snapshot_alignment = 64;
+
+uint64_t Align(uint64_t offset) {
+  return (offset + snapshot_alignment - 1) / snapshot_alignment *
+         snapshot_alignment;
+}
+
+bool IsParameterName(const std::string& name) {
+  return name.rfind("data", 0) != 0 && name.rfind("im_info", 0) != 0 &&
+         name.rfind("gt_boxes", 0) != 0 && name.rfind("label", 0) != 0 &&
+         name.rfind("bbox_target", 0) != 0 &&
+         name.rfind("bbox_weight", 0) != 0;
+}
+
+/*
+ * Layout: magic, entries count, index size, index, aligned arrays.
+ * Index entry: name length, name, ndim, dims, array offset.
+ */
+void WriteSnapshot(const std::string& param_file,
+                   const std::vector<ParamsSaver::Entry>& entries) {
+  uint64_t index_size = 0;
+  for (const auto& e : entries) {
+    index_size += sizeof(uint32_t) + e.name.size() + sizeof(uint32_t) +
+                  e.shape.size() * sizeof(mx_uint) + sizeof(uint64_t);
+  }
+  uint64_t count = entries.size();
+  uint64_t offset =
+      Align(sizeof(snapshot_magic) + 2 * sizeof(uint64_t) + index_size);
+
+  std::vector<char> header;
+  auto put = [&header](const void* data, size_t size) {
+    auto bytes = reinterpret_cast<const char*>(data);
+    header.insert(header.end(), bytes, bytes + size);
+  };
+  put(snapshot_magic, sizeof(snapshot_magic));
+  put(&count, sizeof(count));
+  put(&index_size, sizeof(index_size));
+  std::vector<uint64_t> offsets;
+  for (const auto& e : entries) {
+    auto name_size = static_cast<uint32_t>(e.name.size());
+    auto ndim = static_cast<uint32_t>(e.shape.size());
+    put(&name_size, sizeof(name_size));
+    put(e.name.data(), e.name.size());
+    put(&ndim, sizeof(ndim));
+    put(e.shape.data(), e.shape.size() * sizeof(mx_uint));
+    put(&offset, sizeof(offset));
+    offsets.push_back(offset);
+    offset = Align(offset + e.data.size() * sizeof(float));
+  }
+
+  // write to the temporary file, so a crash never leaves broken check-point
+  auto tmp_file = param_file + ".tmp";
+  std::ofstream file(tmp_file, std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error(tmp_file + " file can't be opened");
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  uint64_t pos = header.size();
+  const char zeros[snapshot_alignment] = {};
+  for (size_t i = 0; i < entries.size(); ++i) {
+    file.write(zeros, static_cast<std::streamsize>(offsets[i] - pos));
+    const auto& data = entries[i].data;
+    file.write(reinterpret_cast<const char*>(data.data()),
+               static_cast<std::streamsize>(data.size() * sizeof(float)));
+    pos = offsets[i] + data.size() * sizeof(float);
+  }
+  file.close();
+  if (!file)
+    throw std::runtime_error(tmp_file + " file can't be written");
+  if (std::rename(tmp_file.c_str(), param_file.c_str()) != 0)
+    throw std::runtime_error(param_file + " file can't be written");
+}
+}  // namespace
+
 std::pair<std::map<std::string, mxnet::cpp::NDArray>,
           std::map<std::string, mxnet::cpp::NDArray>>
 LoadNetParams(const mxnet::cpp::Context& ctx, const std::string& param_file) {
   using namespace mxnet::cpp;
+  if (ParamsSnapshot::IsSnapshot(param_file)) {
+    return ParamsSnapshot(param_file).Load(ctx);
+  }
   //---------- Load parameters
   std::map<std::string, NDArray> paramters;
   NDArray::Load(param_file, nullptr, &paramters);
@@ -25,19 +116,184 @@ LoadNetParams(const mxnet::cpp::Context& ctx, const std::string& param_file) {
 }
 
 void SaveNetParams(const std::string& param_file, mxnet::cpp::Executor* exe) {
+  ParamsSaver saver;
+  saver.Save(param_file, exe);
+  saver.Wait();
+}
+
+ParamsSnapshot::ParamsSnapshot(const std::string& file_name) {
+  auto fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(file_name + " file can't be opened");
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error(file_name + " file can't be opened");
+  }
+  mapping_size_ = static_cast<size_t>(st.st_size);
+  mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = nullptr;
+    throw std::runtime_error(file_name + " file can't be mapped");
+  }
+
+  const char* begin = static_cast<const char*>(mapping_);
+  const char* end = begin + mapping_size_;
+  const char* pos = begin;
+  auto get = [&](void* data, size_t size) {
+    if (static_cast<size_t>(end - pos) < size) {
+      munmap(mapping_, mapping_size_);
+      mapping_ = nullptr;
+      throw std::runtime_error(file_name + " file is broken");
+    }
+    std::memcpy(data, pos, size);
+    pos += size;
+  };
+  char magic[sizeof(snapshot_magic)];
+  uint64_t count = 0;
+  uint64_t index_size = 0;
+  get(magic, sizeof(magic));
+  get(&count, sizeof(count));
+  get(&index_size, sizeof(index_size));
+  if (std::memcmp(magic, snapshot_magic, sizeof(magic)) != 0) {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    throw std::runtime_error(file_name + " isn't a parameters snapshot");
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    uint32_t name_size = 0;
+    get(&name_size, sizeof(name_size));
+    std::string name(name_size, '\0');
+    get(&name[0], name_size);
+    uint32_t ndim = 0;
+    get(&ndim, sizeof(ndim));
+    Entry entry;
+    entry.shape.resize(ndim);
+    get(entry.shape.data(), ndim * sizeof(mx_uint));
+    uint64_t offset = 0;
+    get(&offset, sizeof(offset));
+    entry.size = std::accumulate(entry.shape.begin(), entry.shape.end(),
+                                 size_t{1}, std::multiplies<size_t>());
+    if (offset + entry.size * sizeof(float) > mapping_size_) {
+      munmap(mapping_, mapping_size_);
+      mapping_ = nullptr;
+      throw std::runtime_error(file_name + " file is broken");
+    }
+    entry.data = reinterpret_cast<const float*>(begin + offset);
+    if (name.rfind("aux:", 0) == 0)
+      auxs_.emplace(name.substr(4), std::move(entry));
+    else if (name.rfind("arg:", 0) == 0)
+      args_.emplace(name.substr(4), std::move(entry));
+  }
+  // arrays are read sequentially
+  madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+}
+
+ParamsSnapshot::~ParamsSnapshot() {
+  if (mapping_)
+    munmap(mapping_, mapping_size_);
+}
+
+bool ParamsSnapshot::IsSnapshot(const std::string& file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  char magic[sizeof(snapshot_magic)];
+  return file.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, snapshot_magic, sizeof(magic)) == 0;
+}
+
+std::map<std::string, std::vector<mx_uint>> ParamsSnapshot::GetArgShapes()
+    const {
+  std::map<std::string, std::vector<mx_uint>> shapes;
+  for (const auto& e : args_)
+    shapes.emplace(e.first, e.second.shape);
+  return shapes;
+}
+
+std::map<std::string, std::vector<mx_uint>> ParamsSnapshot::GetAuxShapes()
+    const {
+  std::map<std::string, std::vector<mx_uint>> shapes;
+  for (const auto& e : auxs_)
+    shapes.emplace(e.first, e.second.shape);
+  return shapes;
+}
+
+void ParamsSnapshot::LoadTo(mxnet::cpp::Executor* exe) const {
+  LoadTo(args_, exe->arg_dict());
+  LoadTo(auxs_, exe->aux_dict());
   mxnet::cpp::NDArray::WaitAll();
-  std::map<std::string, mxnet::cpp::NDArray> params;
-  for (auto& iter : exe->arg_dict()) {
-    if (iter.first.rfind("data", 0) != 0 &&
-        iter.first.rfind("im_info", 0) != 0 &&
-        iter.first.rfind("gt_boxes", 0) != 0 &&
-        iter.first.rfind("label", 0) != 0 &&
-        iter.first.rfind("bbox_target", 0) != 0 &&
-        iter.first.rfind("bbox_weight", 0) != 0)
-      params.insert({"arg:" + iter.first, iter.second});
-  }
-  for (auto iter : exe->aux_dict()) {
-    params.insert({"aux:" + iter.first, iter.second});
-  }
-  mxnet::cpp::NDArray::Save(param_file, params);
+}
+
+void ParamsSnapshot::LoadTo(
+    const std::map<std::string, Entry>& entries,
+    const std::map<std::string, mxnet::cpp::NDArray>& arrays) const {
+  for (const auto& a : arrays) {
+    auto i = entries.find(a.first);
+    if (i != entries.end()) {
+      auto array = a.second;
+      if (array.Size() != i->second.size)
+        throw std::runtime_error("Snapshot parameter " + a.first +
+                                 " has wrong size");
+      array.SyncCopyFromCPU(i->second.data, i->second.size);
+    }
+  }
+}
+
+std::pair<std::map<std::string, mxnet::cpp::NDArray>,
+          std::map<std::string, mxnet::cpp::NDArray>>
+ParamsSnapshot::Load(const mxnet::cpp::Context& ctx) const {
+  using namespace mxnet::cpp;
+  std::map<std::string, NDArray> args_map;
+  std::map<std::string, NDArray> aux_map;
+  for (const auto& e : args_) {
+    args_map.emplace(e.first,
+                     NDArray(e.second.data, Shape(e.second.shape), ctx));
+  }
+  for (const auto& e : auxs_) {
+    aux_map.emplace(e.first,
+                    NDArray(e.second.data, Shape(e.second.shape), ctx));
+  }
+  NDArray::WaitAll();
+  return std::make_pair(args_map, aux_map);
+}
+
+ParamsSaver::~ParamsSaver() {
+  try {
+    Wait();
+  } catch (const std::exception& err) {
+    std::cerr << "Failed to save parameters : " << err.what() << std::endl;
+  }
+}
+
+void ParamsSaver::Save(const std::string& param_file,
+                       mxnet::cpp::Executor* exe) {
+  // staging buffers are used by the previous save
+  Wait();
+  mxnet::cpp::NDArray::WaitAll();
+  size_t n = 0;
+  auto stage = [&](const std::string& name, mxnet::cpp::NDArray array) {
+    if (entries_.size() <= n)
+      entries_.emplace_back();
+    auto& entry = entries_[n++];
+    entry.name = name;
+    entry.shape = array.GetShape();
+    entry.data.resize(array.Size());
+    array.SyncCopyToCPU(entry.data.data(), entry.data.size());
+  };
+  for (const auto& iter : exe->arg_dict()) {
+    if (IsParameterName(iter.first))
+      stage("arg:" + iter.first, iter.second);
+  }
+  for (const auto& iter : exe->aux_dict()) {
+    stage("aux:" + iter.first, iter.second);
+  }
+  entries_.resize(n);
+  task_ = std::async(std::launch::async, [this, param_file]() {
+    WriteSnapshot(param_file, entries_);
+  });
+}
+
+void ParamsSaver::Wait() {
+  if (task_.valid())
+    task_.get();
 }
@@ -4,6 +4,8 @@
 #include <mxnet-cpp/MxNetCpp.h>
 
 #include <stdint.h>
+#include <future>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -50,4 +52,70 @@ LoadNetParams(const mxnet::cpp::Context& ctx, const std::string& param_file);
 
 void SaveNetParams(const std::string& param_file, mxnet::cpp::Executor* exe);
 
+/*
+ * Parameters snapshot - binary file with index and 64 bytes aligned arrays,
+ * it is memory mapped so arrays are read directly from the page cache and
+ * only when they are copied to the device.
+ */
+class ParamsSnapshot {
+ public:
+  explicit ParamsSnapshot(const std::string& file_name);
+  ~ParamsSnapshot();
+  ParamsSnapshot(const ParamsSnapshot&) = delete;
+  ParamsSnapshot& operator=(const ParamsSnapshot&) = delete;
+
+  static bool IsSnapshot(const std::string& file_name);
+
+  std::map<std::string, std::vector<mx_uint>> GetArgShapes() const;
+  std::map<std::string, std::vector<mx_uint>> GetAuxShapes() const;
+
+  // Copies values to the bound executor arrays without intermediate buffers
+  void LoadTo(mxnet::cpp::Executor* exe) const;
+  std::pair<std::map<std::string, mxnet::cpp::NDArray>,
+            std::map<std::string, mxnet::cpp::NDArray>>
+  Load(const mxnet::cpp::Context& ctx) const;
+
+ private:
+  struct Entry {
+    std::vector<mx_uint> shape;
+    const float* data{nullptr};
+    size_t size{0};
+  };
+  void LoadTo(const std::map<std::string, Entry>& entries,
+              const std::map<std::string, mxnet::cpp::NDArray>& arrays) const;
+
+ private:
+  void* mapping_{nullptr};
+  size_t mapping_size_{0};
+  std::map<std::string, Entry> args_;
+  std::map<std::string, Entry> auxs_;
+};
+
+/*
+ * Saves parameters snapshots in the background thread. Only copying from the
+ * device to the host staging buffers blocks the caller, buffers are reused
+ * between saves.
+ */
+class ParamsSaver {
+ public:
+  ParamsSaver() = default;
+  ~ParamsSaver();
+  ParamsSaver(const ParamsSaver&) = delete;
+  ParamsSaver& operator=(const ParamsSaver&) = delete;
+
+  void Save(const std::string& param_file, mxnet::cpp::Executor* exe);
+  // waits for the previous save, rethrows its error
+  void Wait();
+
+  struct Entry {
+    std::string name;
+    std::vector<mx_uint> shape;
+    std::vector<float> data;
+  };
+
+ private:
+  std::vector<Entry> entries_;
+  std::future<void> task_;
+};
+
 #endif  // PARAMS_H
@@ -11,6 +11,7 @@
 
 #include <experimental/filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
 
 namespace fs = std::experimental::filesystem;
@@ -73,8 +74,15 @@ int main(int argc, char** argv) {
       std::map<std::string, mxnet::cpp::NDArray> args_map;
       std::map<std::string, mxnet::cpp::NDArray> aux_map;
       std::cout << "Loading parameters ... " << std::endl;
-      if (!params_path.empty())
-        std::tie(args_map, aux_map) = LoadNetParams(global_ctx, params_path);
+      // check-point snapshot is copied directly to the executor after binding
+      std::unique_ptr<ParamsSnapshot> snapshot;
+      if (!params_path.empty()) {
+        if (!start_train && ParamsSnapshot::IsSnapshot(params_path)) {
+          snapshot = std::make_unique<ParamsSnapshot>(params_path);
+        } else {
+          std::tie(args_map, aux_map) = LoadNetParams(global_ctx, params_path);
+        }
+      }
 
       // ---------- Test parametes & Check Shapes - shouldn't fail
       std::cout << "Test shapes ..." << std::endl;
@@ -107,10 +115,21 @@ int main(int argc, char** argv) {
       if (!params_path.empty()) {
         std::vector<std::string> outs = net.ListOutputs();
         std::vector<std::string> auxs = net.ListAuxiliaryStates();
+        std::map<std::string, std::vector<mx_uint>> params_shapes;
+        std::map<std::string, std::vector<mx_uint>> aux_shapes;
+        if (snapshot) {
+          params_shapes = snapshot->GetArgShapes();
+          aux_shapes = snapshot->GetAuxShapes();
+        } else {
+          for (const auto& arg : args_map)
+            params_shapes[arg.first] = arg.second.GetShape();
+          for (const auto& aux : aux_map)
+            aux_shapes[aux.first] = aux.second.GetShape();
+        }
         for (const auto& arg_name : args) {
-          auto iter = args_map.find(arg_name);
-          if (iter != args_map.end()) {
-            arg_shapes[arg_name] = iter->second.GetShape();
+          auto iter = params_shapes.find(arg_name);
+          if (iter != params_shapes.end()) {
+            arg_shapes[arg_name] = iter->second;
           } else {
             std::cout << "Configurable or Missed argument : " << arg_name
                       << std::endl;
@@ -118,8 +137,8 @@ int main(int argc, char** argv) {
         }
 
         for (const auto& arg_name : auxs) {
-          auto iter = aux_map.find(arg_name);
-          if (iter != aux_map.end()) {
+          auto iter = aux_shapes.find(arg_name);
+          if (iter != aux_shapes.end()) {
           } else {
             std::cout << "Missed auxiliary state : " << arg_name << std::endl;
           }
@@ -162,6 +181,11 @@ int main(int argc, char** argv) {
           global_ctx, args_map, std::map<std::string, mxnet::cpp::NDArray>(),
           std::map<std::string, mxnet::cpp::OpReqType>(), aux_map);
       args = net.ListArguments();
+      if (snapshot) {
+        snapshot->LoadTo(executor);
+        snapshot.reset();
+        CheckMXnetError("load check-point");
+      }
 
       //      mxnet::cpp::Monitor monitor(1, std::regex("stage3.*"));
       //      //.*|bbox_pred.*|prop_target.*|bbox_loss.*|rpn.*"));
@@ -241,6 +265,7 @@ int main(int argc, char** argv) {
       RCNNLogLossMetric rcnn_log_loss_metric;
       RCNNL1LossMetric rcnn_l1_loss_metric;
 
+      ParamsSaver params_saver;
       uint32_t batch_num = 0;
       for (uint32_t epoch = 0; epoch < max_epoch; ++epoch) {
         batch_num = 0;
@@ -311,9 +336,11 @@ int main(int argc, char** argv) {
 
           ++batch_num;
         }
-        SaveNetParams(check_point_file, executor);
-        std::cout << "Parameters saved to " << check_point_file << std::endl;
+        // file is written in the background while the next epoch runs
+        params_saver.Save(check_point_file, executor);
+        std::cout << "Parameters saving to " << check_point_file << std::endl;
       }
+      params_saver.Wait();
       reporter.Stop();
 
       mxnet::cpp::NDArray::WaitAll();
@@ -0,0 +1,224 @@
+#include "roisampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+const uint32_t seed = 5675317;
+
+inline float Area(const float* box) {
+  return (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+}
+
+// boxes should have area at 4th position for candidates and 5th for gt boxes
+inline float Overlap(const float* box, const float* gt_box) {
+  auto iw = std::min(box[2], gt_box[2]) - std::max(box[0], gt_box[0]) + 1;
+  if (iw > 0) {
+    auto ih = std::min(box[3], gt_box[3]) - std::max(box[1], gt_box[1]) + 1;
+    if (ih > 0) {
+      auto all_area = box[4] + gt_box[5] - iw * ih;
+      return iw * ih / all_area;
+    }
+  }
+  return 0;
+}
+
+// moves `num` random elements to the front, without full shuffle
+template <class Rnd>
+void RandomChoice(std::vector<uint32_t>& indices, size_t num, Rnd& rnd) {
+  auto n = indices.size();
+  for (size_t i = 0; i < num && i + 1 < n; ++i) {
+    std::uniform_int_distribution<size_t> dist(i, n - 1);
+    std::swap(indices[i], indices[dist(rnd)]);
+  }
+}
+}  // namespace
+
+RoiSampler::RoiSampler(int num_classes,
+                       int batch_images,
+                       int batch_rois,
+                       float fg_fraction,
+                       float fg_overlap,
+                       const std::vector<float>& box_stds)
+    : num_classes_(num_classes),
+      batch_images_(batch_images),
+      rois_per_image_(batch_rois / batch_images),
+      fg_overlap_(fg_overlap),
+      workspaces_(static_cast<size_t>(batch_images)) {
+  fg_rois_per_image_ =
+      static_cast<int>(std::round(fg_fraction * rois_per_image_));
+  assert(box_stds.size() == 4);
+  std::copy(box_stds.begin(), box_stds.end(), box_stds_);
+}
+
+void RoiSampler::Sample(const float* all_rois,
+                        uint32_t n_rois,
+                        const float* all_gt_boxes,
+                        uint32_t n_gt,
+                        float* rois,
+                        float* labels,
+                        float* bbox_targets,
+                        float* bbox_weights) {
+  const size_t targets_cols = static_cast<size_t>(num_classes_) * 4;
+  // images write to separate blocks of the outputs
+#pragma omp parallel for schedule(static)
+  for (int batch_idx = 0; batch_idx < batch_images_; ++batch_idx) {
+    auto offset = static_cast<size_t>(batch_idx * rois_per_image_);
+    SampleImage(batch_idx, all_rois, n_rois,
+                all_gt_boxes + static_cast<size_t>(batch_idx) * n_gt * 5, n_gt,
+                workspaces_[static_cast<size_t>(batch_idx)], rois + offset * 5,
+                labels + offset, bbox_targets + offset * targets_cols,
+                bbox_weights + offset * targets_cols);
+  }
+}
+
+void RoiSampler::SampleImage(int batch_idx,
+                             const float* all_rois,
+                             uint32_t n_rois,
+                             const float* gt_boxes,
+                             uint32_t n_gt,
+                             Workspace& ws,
+                             float* rois,
+                             float* labels,
+                             float* bbox_targets,
+                             float* bbox_weights) {
+  ws.random_engine.seed(seed);
+
+  // select gt boxes with foreground class
+  ws.gt_boxes.clear();
+  for (uint32_t i = 0; i < n_gt; ++i) {
+    const auto* box = gt_boxes + i * 5;
+    if (box[4] > 0) {
+      ws.gt_boxes.insert(ws.gt_boxes.end(), box, box + 5);
+      ws.gt_boxes.push_back(Area(box));
+    }
+  }
+  auto gt_count = static_cast<uint32_t>(ws.gt_boxes.size() / 6);
+
+  // select rois related to the current batch element, images have different
+  // size so rois count can also be different, and include ground-truth boxes
+  // in the set of candidate rois
+  ws.candidates.clear();
+  for (uint32_t i = 0; i < n_rois; ++i) {
+    const auto* roi = all_rois + i * 5;
+    if (static_cast<int>(roi[0]) == batch_idx) {
+      ws.candidates.insert(ws.candidates.end(), roi + 1, roi + 5);
+      ws.candidates.push_back(Area(roi + 1));
+    }
+  }
+  for (uint32_t i = 0; i < gt_count; ++i) {
+    const auto* box = &ws.gt_boxes[i * 6];
+    ws.candidates.insert(ws.candidates.end(), box, box + 4);
+    ws.candidates.push_back(box[5]);
+  }
+  auto candidates_count = static_cast<uint32_t>(ws.candidates.size() / 5);
+
+  // overlaps with gt boxes, assign candidates to gt with max overlap
+  ws.max_overlaps.resize(candidates_count);
+  ws.gt_assignment.resize(candidates_count);
+  ws.fg_indices.clear();
+  ws.bg_indices.clear();
+  for (uint32_t i = 0; i < candidates_count; ++i) {
+    const auto* box = &ws.candidates[i * 5];
+    float max_overlap = -1;
+    uint32_t max_index = 0;
+    for (uint32_t k = 0; k < gt_count; ++k) {
+      auto overlap = Overlap(box, &ws.gt_boxes[k * 6]);
+      if (overlap >= max_overlap) {  // last max index
+        max_overlap = overlap;
+        max_index = k;
+      }
+    }
+    ws.max_overlaps[i] = max_overlap;
+    ws.gt_assignment[i] = max_index;
+    // select foreground RoI with FG_THRESH overlap
+    // select background RoIs as those within [0, FG_THRESH)
+    if (max_overlap >= fg_overlap_)
+      ws.fg_indices.push_back(i);
+    else
+      ws.bg_indices.push_back(i);
+  }
+
+  // guard against the case when an image has fewer than fg_rois_per_image
+  // foreground RoIs
+  auto fg_count = static_cast<int>(ws.fg_indices.size());
+  assert(fg_count > 0);
+  auto fg_rois_this_image = std::min(fg_rois_per_image_, fg_count);
+  // sample foreground regions without replacement
+  RandomChoice(ws.fg_indices, static_cast<size_t>(fg_rois_this_image),
+               ws.random_engine);
+
+  // compute number of background RoIs to take from this image (guarding
+  // against there being fewer than desired)
+  auto bg_count = static_cast<int>(ws.bg_indices.size());
+  auto bg_rois_this_image =
+      std::min(rois_per_image_ - fg_rois_this_image, bg_count);
+  // sample bg rois without replacement
+  RandomChoice(ws.bg_indices, static_cast<size_t>(bg_rois_this_image),
+               ws.random_engine);
+
+  // indexes selected
+  ws.keep_indices.assign(ws.fg_indices.begin(),
+                         ws.fg_indices.begin() + fg_rois_this_image);
+  ws.keep_indices.insert(ws.keep_indices.end(), ws.bg_indices.begin(),
+                         ws.bg_indices.begin() + bg_rois_this_image);
+
+  // pad more bg rois to ensure a fixed minibatch size
+  auto rois_per_image = static_cast<size_t>(rois_per_image_);
+  while (ws.keep_indices.size() < rois_per_image && !ws.bg_indices.empty()) {
+    auto gap =
+        std::min(ws.bg_indices.size(), rois_per_image - ws.keep_indices.size());
+    RandomChoice(ws.bg_indices, gap, ws.random_engine);
+    ws.keep_indices.insert(ws.keep_indices.end(), ws.bg_indices.begin(),
+                           ws.bg_indices.begin() + static_cast<long>(gap));
+  }
+
+  // sample rois and labels, compute bbox_target for fg rois
+  const size_t targets_cols = static_cast<size_t>(num_classes_) * 4;
+  std::fill_n(bbox_targets, rois_per_image * targets_cols, 0.f);
+  std::fill_n(bbox_weights, rois_per_image * targets_cols, 0.f);
+  for (size_t j = 0; j < ws.keep_indices.size(); ++j) {
+    auto i = ws.keep_indices[j];
+    const auto* box = &ws.candidates[i * 5];
+    auto* roi = rois + j * 5;
+    roi[0] = static_cast<float>(batch_idx);
+    std::copy_n(box, 4, roi + 1);
+
+    // set labels of bg rois to be 0
+    if (static_cast<int>(j) >= fg_rois_this_image) {
+      labels[j] = 0;
+      continue;
+    }
+    const auto* gt_box = &ws.gt_boxes[ws.gt_assignment[i] * 6];
+    labels[j] = gt_box[4];
+
+    float ex_width = box[2] - box[0] + 1.f;
+    float ex_height = box[3] - box[1] + 1.f;
+    float ex_ctr_x = box[0] + 0.5f * (ex_width - 1.f);
+    float ex_ctr_y = box[1] + 0.5f * (ex_height - 1.f);
+    float gt_width = gt_box[2] - gt_box[0] + 1.f;
+    float gt_height = gt_box[3] - gt_box[1] + 1.f;
+    float gt_ctr_x = gt_box[0] + 0.5f * (gt_width - 1.f);
+    float gt_ctr_y = gt_box[1] + 0.5f * (gt_height - 1.f);
+
+    auto cls_ind = static_cast<size_t>(gt_box[4]);
+    auto* target = bbox_targets + j * targets_cols + cls_ind * 4;
+    target[0] = (gt_ctr_x - ex_ctr_x) / (ex_width + 1e-14f) / box_stds_[0];
+    target[1] = (gt_ctr_y - ex_ctr_y) / (ex_height + 1e-14f) / box_stds_[1];
+    target[2] = std::log(gt_width / ex_width) / box_stds_[2];
+    target[3] = std::log(gt_height / ex_height) / box_stds_[3];
+    assert(target[0] < 1000 && target[1] < 1000 && target[2] < 1000 &&
+           target[3] < 1000);
+    std::fill_n(bbox_weights + j * targets_cols + cls_ind * 4, 4, 1.f);
+  }
+
+  // there are no bg rois to pad with when every candidate is foreground, fill
+  // the rest with empty bg rows, their targets and weights are zero already
+  for (size_t j = ws.keep_indices.size(); j < rois_per_image; ++j) {
+    auto* roi = rois + j * 5;
+    roi[0] = static_cast<float>(batch_idx);
+    std::fill_n(roi + 1, 4, 0.f);
+    labels[j] = 0;
+  }
+}
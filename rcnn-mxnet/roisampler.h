@@ -0,0 +1,77 @@
+#ifndef ROISAMPLER_H
+#define ROISAMPLER_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/*
+ * CPU part of the ProposalTarget operator: generates random sample of ROIs
+ * comprising foreground and background examples for every batch image.
+ * Doesn't depend on MXNet, works directly on the raw tensor memory.
+ */
+class RoiSampler {
+ public:
+  RoiSampler(int num_classes,
+             int batch_images,
+             int batch_rois,
+             float fg_fraction,
+             float fg_overlap,
+             const std::vector<float>& box_stds);
+  RoiSampler(const RoiSampler&) = delete;
+  RoiSampler& operator=(const RoiSampler&) = delete;
+
+  /*
+   * all_rois: [n_rois, 5] (batch_index, x1, y1, x2, y2)
+   * all_gt_boxes: [batch_images, n_gt, 5] (x1, y1, x2, y2, cls)
+   * Results are written to row major buffers:
+   * rois: [batch_rois, 5] (batch_index, x1, y1, x2, y2)
+   * labels: [batch_rois]
+   * bbox_targets, bbox_weights: [batch_rois, 4 * num_classes]
+   * Batch images are processed in parallel, scratch buffers are reused between
+   * calls, so one sampler can't be used from several threads.
+   */
+  void Sample(const float* all_rois,
+              uint32_t n_rois,
+              const float* all_gt_boxes,
+              uint32_t n_gt,
+              float* rois,
+              float* labels,
+              float* bbox_targets,
+              float* bbox_weights);
+
+ private:
+  struct Workspace {
+    std::mt19937 random_engine;
+    std::vector<float> candidates;  // [n, 5] x1, y1, x2, y2, area
+    std::vector<float> gt_boxes;    // [n, 6] x1, y1, x2, y2, cls, area
+    std::vector<float> max_overlaps;
+    std::vector<uint32_t> gt_assignment;
+    std::vector<uint32_t> fg_indices;
+    std::vector<uint32_t> bg_indices;
+    std::vector<uint32_t> keep_indices;
+  };
+
+  void SampleImage(int batch_idx,
+                   const float* all_rois,
+                   uint32_t n_rois,
+                   const float* gt_boxes,
+                   uint32_t n_gt,
+                   Workspace& ws,
+                   float* rois,
+                   float* labels,
+                   float* bbox_targets,
+                   float* bbox_weights);
+
+ private:
+  int num_classes_{0};
+  int batch_images_{0};
+  int rois_per_image_{0};
+  int fg_rois_per_image_{0};
+  float fg_overlap_{0};
+  float box_stds_[4]{1, 1, 1, 1};
+
+  std::vector<Workspace> workspaces_;  // one per batch image
+};
+
+#endif  // ROISAMPLER_H
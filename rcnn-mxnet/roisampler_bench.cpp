@@ -0,0 +1,101 @@
+#include "roisampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/*
+ * Standalone benchmark for the CPU part of the ProposalTarget operator, uses
+ * synthetic rois and gt boxes with the default training parameters.
+ * Usage: roisampler_bench [iterations] [rois per image]
+ */
+int main(int argc, char** argv) {
+  const int iterations = argc > 1 ? std::atoi(argv[1]) : 1000;
+  const int rois_per_image = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+  const int num_classes = 81;
+  const int batch_images = 4;
+  const int batch_rois = 128 * batch_images;
+  const int n_gt = 100;
+  const int valid_gt = 10;
+  const float width = 640;
+  const float height = 480;
+
+  std::mt19937 rnd(5675317);
+  std::uniform_real_distribution<float> x_dist(0, width - 1);
+  std::uniform_real_distribution<float> y_dist(0, height - 1);
+  std::uniform_real_distribution<float> size_dist(16, 256);
+  std::uniform_int_distribution<int> class_dist(1, num_classes - 1);
+
+  auto make_box = [&](float* box) {
+    box[0] = x_dist(rnd);
+    box[1] = y_dist(rnd);
+    box[2] = std::min(width - 1, box[0] + size_dist(rnd));
+    box[3] = std::min(height - 1, box[1] + size_dist(rnd));
+  };
+
+  std::vector<float> gt_boxes(batch_images * n_gt * 5, -1.f);
+  for (int b = 0; b < batch_images; ++b) {
+    for (int i = 0; i < valid_gt; ++i) {
+      auto* box = &gt_boxes[static_cast<size_t>((b * n_gt + i) * 5)];
+      make_box(box);
+      box[4] = static_cast<float>(class_dist(rnd));
+    }
+  }
+
+  // make part of rois close to gt boxes to have foreground samples
+  std::normal_distribution<float> jitter(0, 8);
+  std::vector<float> rois(batch_images * rois_per_image * 5);
+  for (int b = 0; b < batch_images; ++b) {
+    for (int i = 0; i < rois_per_image; ++i) {
+      auto* roi = &rois[static_cast<size_t>((b * rois_per_image + i) * 5)];
+      roi[0] = static_cast<float>(b);
+      if (i % 4 == 0) {
+        const auto* gt = &gt_boxes[static_cast<size_t>(
+            (b * n_gt + (i / 4) % valid_gt) * 5)];
+        for (int k = 0; k < 4; ++k)
+          roi[k + 1] = gt[k] + jitter(rnd);
+        roi[3] = std::max(roi[1], roi[3]);
+        roi[4] = std::max(roi[2], roi[4]);
+      } else {
+        make_box(roi + 1);
+      }
+    }
+  }
+
+  std::vector<float> out_rois(batch_rois * 5);
+  std::vector<float> out_labels(batch_rois);
+  std::vector<float> out_targets(batch_rois * num_classes * 4);
+  std::vector<float> out_weights(batch_rois * num_classes * 4);
+
+  RoiSampler sampler(num_classes, batch_images, batch_rois, 0.25f, 0.5f,
+                     {0.1f, 0.1f, 0.2f, 0.2f});
+  auto run = [&]() {
+    sampler.Sample(rois.data(),
+                   static_cast<uint32_t>(batch_images * rois_per_image),
+                   gt_boxes.data(), n_gt, out_rois.data(), out_labels.data(),
+                   out_targets.data(), out_weights.data());
+  };
+
+  run();  // warm up buffers
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    run();
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto total_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+          .count();
+
+  auto fg_count = std::count_if(out_labels.begin(), out_labels.end(),
+                                [](float l) { return l > 0; });
+  std::cout << "batch images : " << batch_images
+            << " rois per image : " << rois_per_image
+            << " fg rois : " << fg_count << "\n";
+  std::cout << "iterations : " << iterations << " mean time : "
+            << static_cast<double>(total_us) / iterations << " us\n";
+  return 0;
+}
@@ -28,6 +28,7 @@ TrainIter::TrainIter(ImageDb* image_db,
       anchor_sampler_(params) {
   assert(image_db_ != nullptr);
   size_ = image_db->GetImagesCount();
+  anchors_ = anchor_generator_.Generate(feat_width_, feat_height_);
   Reset();
 }
 
@@ -87,26 +88,22 @@ void TrainIter::GetData(mxnet::cpp::NDArray& im_arr,
 }
 
 void TrainIter::FillData() {
-  raw_gt_boxes_data_.clear();
-  raw_im_data_.clear();
-  raw_im_info_data_.clear();
-
-  auto if_i = std::back_insert_iterator<std::vector<float>>(raw_im_info_data_);
-  auto b_i = std::back_insert_iterator<std::vector<float>>(raw_gt_boxes_data_);
-
-  // gt_boxes padding markers
-  std::vector<std::pair<size_t, size_t>> gt_boxes_pad_markers;
-
-  for (auto index : batch_indices_) {
-    // image is loaded with padding
-    auto image_desc =
-        image_db_->GetImage(index, short_side_len_, long_side_len_);
-    // Fill image
-    auto array = CVToMxnetFormat(image_desc.image);
-    assert(array.size() <= one_image_size_);
-    raw_im_data_.insert(raw_im_data_.end(), array.begin(), array.end());
+  // buffers keep their capacity between batches
+  raw_im_data_.resize(static_cast<size_t>(batch_size_) * one_image_size_);
+  raw_im_info_data_.resize(static_cast<size_t>(batch_size_) * 3);
+  // gt_boxes are padded with -1
+  raw_gt_boxes_data_.assign(
+      static_cast<size_t>(batch_size_) * batch_gt_boxes_count_ * 5, -1.f);
+
+  for (uint32_t i = 0; i < batch_size_; ++i) {
+    auto index = batch_indices_[i];
+    // image is loaded with padding directly to the batch buffer
+    auto image_data = raw_im_data_.data() + i * one_image_size_;
+    auto image_desc = image_db_->GetImage(index, short_side_len_,
+                                          long_side_len_, image_data);
 
     // Fill info
+    auto if_i = raw_im_info_data_.begin() + i * 3;
     *if_i++ = image_desc.height;
     *if_i++ = image_desc.width;
     *if_i++ = image_desc.scale;
@@ -116,8 +113,10 @@ void TrainIter::FillData() {
     if (image_desc.boxes.size() > batch_gt_boxes_count_)
       image_desc.boxes.resize(batch_gt_boxes_count_);
 #ifdef IMG_DEBUG_TEST
-    cv::Mat imgCopy = image_desc.image.clone();
+    cv::Mat imgCopy =
+        image_db_->GetImage(index, short_side_len_, long_side_len_).image;
 #endif
+    auto b_i = raw_gt_boxes_data_.begin() + i * batch_gt_boxes_count_ * 5;
     auto ic = image_desc.classes.begin();
     for (const auto& b : image_desc.boxes) {
       // sanitize box
@@ -149,26 +148,12 @@ void TrainIter::FillData() {
 #ifdef IMG_DEBUG_TEST
     cv::imwrite("det.png", imgCopy);
 #endif
-    gt_boxes_pad_markers.push_back(
-        {raw_gt_boxes_data_.size(), image_desc.boxes.size()});
-  }
-
-  // Add padding to gt_boxes
-  size_t pad_pos = 0;
-  for (auto& pad_marker : gt_boxes_pad_markers) {
-    auto pad_size = batch_gt_boxes_count_ - pad_marker.second;
-    if (pad_size != 0) {
-      auto pos = raw_gt_boxes_data_.begin();
-      std::advance(pos, pad_marker.first + pad_pos);
-      raw_gt_boxes_data_.insert(pos, pad_size * 5, -1.f);
-      pad_pos += pad_size * 5;
-    }
   }
 }
 
 void TrainIter::FillLabels() {
   // all stacked image share same anchors
-  auto anchors = anchor_generator_.Generate(feat_width_, feat_height_);
+  const auto& anchors = anchors_;
 #ifdef IMG_DEBUG_TEST
   cv::Mat img = cv::imread("det.png");
   for (Eigen::Index i = 0; i < anchors.rows(); ++i) {
@@ -181,27 +166,14 @@ void TrainIter::FillLabels() {
   cv::imwrite("det.png", img);
 #endif
 
-  // prepare data bindings
-  raw_label_.resize(static_cast<size_t>(anchors.rows()) * batch_size_);
-  Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
-      label_map(raw_label_.data(), anchors.rows() * batch_size_, 1);
-
-  raw_bbox_target_.resize(
-      static_cast<size_t>(anchors.rows() * 4 * batch_size_));
-  Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
-      bbox_target_map(raw_bbox_target_.data(), anchors.rows() * batch_size_, 4);
-
-  raw_bbox_weight_.resize(
-      static_cast<size_t>(anchors.rows() * 4 * batch_size_));
-  Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
-      bbox_weight_map(raw_bbox_weight_.data(), anchors.rows() * batch_size_, 4);
+  // prepare data bindings, buffers keep their capacity between batches
+  auto n_anchors = static_cast<size_t>(anchors.rows());
+  raw_label_.resize(n_anchors * batch_size_);
+  raw_bbox_target_.resize(n_anchors * 4 * batch_size_);
+  raw_bbox_weight_.resize(n_anchors * 4 * batch_size_);
 
   // assign anchor according to their real size encoded in im_info
-  auto all_boxes = Eigen::Map<
-      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+  auto all_boxes = Eigen::Map<AnchorSampler::RowMatrix>(
       raw_gt_boxes_data_.data(),
       static_cast<mx_uint>(raw_gt_boxes_data_.size() / 5), 5);
   for (uint32_t i = 0, box_index = 0; i < batch_size_; ++i) {
@@ -210,28 +182,19 @@ void TrainIter::FillLabels() {
     auto boxes = all_boxes.block(box_index, 0, batch_gt_boxes_count_, 4);
     box_index += batch_gt_boxes_count_;
 
-    Eigen::MatrixXf b_label, b_bbox_target, b_bbox_weight;
-    std::tie(b_label, b_bbox_target, b_bbox_weight) =
-        anchor_sampler_.Assign(anchors, boxes, im_width, im_height);
-
     // Because we use fixed image size padding is not required - number of valid
     // anchors will be the same
-
-    label_map.block(i * anchors.rows(), 0, anchors.rows(), 1) = b_label;
-
-    bbox_target_map.block(i * anchors.rows(), 0, anchors.rows(), 4) =
-        b_bbox_target;
-    bbox_weight_map.block(i * anchors.rows(), 0, anchors.rows(), 4) =
-        b_bbox_weight;
+    anchor_sampler_.Assign(anchors, boxes, im_width, im_height,
+                           raw_label_.data() + i * n_anchors,
+                           raw_bbox_target_.data() + i * n_anchors * 4,
+                           raw_bbox_weight_.data() + i * n_anchors * 4);
   }
 
   // fix sizes
-  ReshapeLabels(static_cast<unsigned int>(label_map.rows()),
-                static_cast<unsigned int>(label_map.cols()));
-  ReshapeTargets(static_cast<unsigned int>(bbox_target_map.rows()),
-                 static_cast<unsigned int>(bbox_target_map.cols()));
-  ReshapeWeights(static_cast<unsigned int>(bbox_weight_map.rows()),
-                 static_cast<unsigned int>(bbox_weight_map.cols()));
+  auto rows = static_cast<unsigned int>(n_anchors * batch_size_);
+  ReshapeLabels(rows, 1);
+  ReshapeTargets(rows, 4);
+  ReshapeWeights(rows, 4);
 }
 
 void TrainIter::ReshapeLabels(unsigned int rows, unsigned int cols) {
@@ -61,6 +61,7 @@ class TrainIter {
 
   AnchorGenerator anchor_generator_;
   AnchorSampler anchor_sampler_;
+  Eigen::MatrixXf anchors_;
 
   // train input
   std::vector<float> raw_im_data_;